@@ -2,6 +2,9 @@
 #include <tiny_obj_loader.h>
 
 #include "callbacks.h"
+#include "gldebug.h"
+#include "passtimer.h"
+#include "profiler.h"
 
 void reshapeFunc(GLFWwindow* window, int w, int h) {
   int fb_w, fb_h;
@@ -9,14 +12,23 @@ void reshapeFunc(GLFWwindow* window, int w, int h) {
   glfwGetFramebufferSize(window, &fb_w, &fb_h);
 
   glViewport(0, 0, fb_w, fb_h);
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  gluPerspective(45.0, (float)w / (float)h, 0.01f, 100.0f);
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
+  // The core renderer builds its projection from width and height.
+  if (g_renderer == kRendererLegacy) {
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(45.0, (float)w / (float)h, 0.01f, 100.0f);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+  }
 
   width = w;
   height = h;
+  g_redraw = true;
+}
+
+void refreshFunc(GLFWwindow* window) {
+  (void)window;
+  g_redraw = true;
 }
 
 void keyboardFunc(GLFWwindow* window, int key, int scancode, int action,
@@ -25,6 +37,7 @@ void keyboardFunc(GLFWwindow* window, int key, int scancode, int action,
   (void)scancode;
   (void)mods;
   if (action == GLFW_PRESS || action == GLFW_REPEAT) {
+    g_redraw = true;
     // Move camera
     // float mv_x = 0, mv_y = 0, mv_z = 0;
     // if (key == GLFW_KEY_K)
@@ -55,6 +68,26 @@ void keyboardFunc(GLFWwindow* window, int key, int scancode, int action,
       g_cull_face = !g_cull_face;
     }
 
+    if (key == GLFW_KEY_F) {
+      // toggle view frustum culling
+      g_frustum_cull = !g_frustum_cull;
+    }
+
+    if (key == GLFW_KEY_O) {
+      // toggle occlusion culling
+      g_occlusion_cull = !g_occlusion_cull;
+    }
+
+    if (key == GLFW_KEY_L) {
+      // toggle level of detail
+      g_lod = !g_lod;
+    }
+
+    if (key == GLFW_KEY_H) {
+      // toggle the statistics overlay
+      g_show_hud = !g_show_hud;
+    }
+
     // init_frame = true;
   }
 }
@@ -107,15 +140,64 @@ void motionFunc(GLFWwindow* window, double mouse_x, double mouse_y) {
     eye[2] += transScale * (mouse_y - prevMouseY) / (float)height;
     lookat[2] += transScale * (mouse_y - prevMouseY) / (float)height;
   }
+  if (mouseLeftPressed || mouseMiddlePressed || mouseRightPressed) {
+    g_redraw = true;
+  }
 
   // Update mouse point
   prevMouseX = mouse_x;
   prevMouseY = mouse_y;
 }
 
+namespace  // Local utility functions
+{
+// Scale compact positions back to model space on the modelview matrix.
+void dequantizePositions(const DrawObject& o) {
+  if (o.vertex_format == kVertexFormatCompact) {
+    glTranslatef(o.position_offset[0], o.position_offset[1],
+                 o.position_offset[2]);
+    glScalef(o.position_scale[0], o.position_scale[1], o.position_scale[2]);
+  }
+}
+
+// Issue one batch. Base vertices differ from 0 in merged buffers and in
+// the 16-bit ranges of large shapes, which are both only built when the
+// driver supports them.
+void drawBatch(const DrawObject& o, const DrawBatch& b) {
+  GLsizei drawCount = static_cast<GLsizei>(b.counts.size());
+  if (GLEW_ARB_draw_elements_base_vertex) {
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, b.counts.data(), o.index_type,
+                                  b.offsets.data(), drawCount,
+                                  const_cast<GLint*>(b.base_vertices.data()));
+  } else {
+    glMultiDrawElements(GL_TRIANGLES, b.counts.data(), o.index_type,
+                        b.offsets.data(), drawCount);
+  }
+}
+
+// Issue one batch for every copy of `o`. The fixed-function path has no
+// instancing, so each copy is drawn with its matrix on the stack. The
+// compact positions of instanced objects are restored here, after the
+// instance matrix, instead of when the object is bound. Colors are baked
+// from the untransformed normals, so unlike the core renderer, rotated
+// copies keep the shading of the original.
+void drawInstances(const DrawObject& o, const DrawBatch& b) {
+  if (o.instances.empty()) {
+    drawBatch(o, b);
+    return;
+  }
+  for (size_t i = 0; i < o.instances.size(); i += 16) {
+    glPushMatrix();
+    glMultMatrixf(&o.instances[i]);
+    dequantizePositions(o);
+    drawBatch(o, b);
+    glPopMatrix();
+  }
+}
+}  // namespace
+
 void Draw(const std::vector<DrawObject>& drawObjects,
-          std::vector<tinyobj::material_t>& materials,
-          std::map<std::string, GLuint>& textures) {
+          const std::vector<DrawBatch>& batches) {
   glPolygonMode(GL_FRONT, GL_FILL);
   if (g_cull_face) {
     glPolygonMode(GL_BACK, GL_LINE);
@@ -125,61 +207,84 @@ void Draw(const std::vector<DrawObject>& drawObjects,
 
   glEnable(GL_POLYGON_OFFSET_FILL);
   glPolygonOffset(1.0, 1.0);
-  GLsizei stride = (3 + 3 + 3 + 2) * sizeof(float);
-  for (size_t i = 0; i < drawObjects.size(); i++) {
-    DrawObject o = drawObjects[i];
-    if (o.vb_id < 1) {
-      continue;
-    }
-
-    glBindBuffer(GL_ARRAY_BUFFER, o.vb_id);
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_NORMAL_ARRAY);
-    glEnableClientState(GL_COLOR_ARRAY);
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-    if ((o.material_id < materials.size())) {
-      std::string diffuse_texname = materials[o.material_id].diffuse_texname;
-      if (textures.find(diffuse_texname) != textures.end()) {
-        glBindTexture(GL_TEXTURE_2D, textures[diffuse_texname]);
+  // Batches are sorted by texture and then by object, so buffers and
+  // textures are only bound when they change.
+  glBindTexture(GL_TEXTURE_2D, 0);
+  {
+    PROFILE_ZONE("fill pass");
+    g_pass_timers.begin(kPassFill);
+    GLuint boundTexture = 0;
+    size_t boundObject = drawObjects.size();
+    for (size_t i = 0; i < batches.size(); i++) {
+      const DrawBatch& b = batches[i];
+      if (b.counts.empty()) {
+        continue;  // culled
+      }
+      const DrawObject& o = drawObjects[b.object];
+      if (b.object != boundObject) {
+        if (boundObject != drawObjects.size()) {
+          glPopMatrix();
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, o.vb_id);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, o.ib_id);
+        SetVertexPointers(o.vertex_format, true, true);
+        glPushMatrix();
+        if (o.instances.empty()) {
+          dequantizePositions(o);
+        }
+        boundObject = b.object;
+      }
+      if (b.texture != boundTexture) {
+        glBindTexture(GL_TEXTURE_2D, b.texture);
+        boundTexture = b.texture;
       }
+      drawInstances(o, b);
+      CHECK_GL_HOT("fill pass batch", i);
     }
-    glVertexPointer(3, GL_FLOAT, stride, (const void*)0);
-    glNormalPointer(GL_FLOAT, stride, (const void*)(sizeof(float) * 3));
-    glColorPointer(3, GL_FLOAT, stride, (const void*)(sizeof(float) * 6));
-    glTexCoordPointer(2, GL_FLOAT, stride, (const void*)(sizeof(float) * 9));
-
-    glDrawArrays(GL_TRIANGLES, 0, 3 * o.numTriangles);
-    CheckErrors("drawarrays");
-    glBindTexture(GL_TEXTURE_2D, 0);
+    if (boundObject != drawObjects.size()) {
+      glPopMatrix();
+    }
+    g_pass_timers.end(kPassFill);
   }
+  glBindTexture(GL_TEXTURE_2D, 0);
 
   // draw wireframe
   if (g_show_wire) {
+    PROFILE_ZONE("wire pass");
+    g_pass_timers.begin(kPassWire);
     glDisable(GL_POLYGON_OFFSET_FILL);
     glPolygonMode(GL_FRONT, GL_LINE);
     glPolygonMode(GL_BACK, GL_LINE);
 
-    glColor3f(0.0f, 0.0f, 0.4f);
-    for (size_t i = 0; i < drawObjects.size(); i++) {
-      DrawObject o = drawObjects[i];
-      if (o.vb_id < 1) {
-        continue;
+    glLineWidth(g_wire_width);
+    glColor3fv(g_wire_color);
+    size_t boundObject = drawObjects.size();
+    for (size_t i = 0; i < batches.size(); i++) {
+      const DrawBatch& b = batches[i];
+      if (b.counts.empty()) {
+        continue;  // culled
       }
-
-      glBindBuffer(GL_ARRAY_BUFFER, o.vb_id);
-      glEnableClientState(GL_VERTEX_ARRAY);
-      glEnableClientState(GL_NORMAL_ARRAY);
-      glDisableClientState(GL_COLOR_ARRAY);
-      glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-      glVertexPointer(3, GL_FLOAT, stride, (const void*)0);
-      glNormalPointer(GL_FLOAT, stride, (const void*)(sizeof(float) * 3));
-      glColorPointer(3, GL_FLOAT, stride, (const void*)(sizeof(float) * 6));
-      glTexCoordPointer(2, GL_FLOAT, stride, (const void*)(sizeof(float) * 9));
-
-      glDrawArrays(GL_TRIANGLES, 0, 3 * o.numTriangles);
-      CheckErrors("drawarrays");
+      const DrawObject& o = drawObjects[b.object];
+      if (b.object != boundObject) {
+        if (boundObject != drawObjects.size()) {
+          glPopMatrix();
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, o.vb_id);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, o.ib_id);
+        SetVertexPointers(o.vertex_format, false, false);
+        glPushMatrix();
+        if (o.instances.empty()) {
+          dequantizePositions(o);
+        }
+        boundObject = b.object;
+      }
+      drawInstances(o, b);
+      CHECK_GL_HOT("wireframe pass batch", i);
+    }
+    if (boundObject != drawObjects.size()) {
+      glPopMatrix();
     }
+    glLineWidth(1.0f);
+    g_pass_timers.end(kPassWire);
   }
 }
@@ -14,6 +14,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include "drawbatch.h"
 #include "drawobject.h"
 #include "global.h"
 #include "trackball.h"
@@ -31,6 +32,9 @@ void CheckErrors(std::string desc);
 
 void reshapeFunc(GLFWwindow* window, int w, int h);
 
+// The window has to be drawn again, e.g. after it was uncovered.
+void refreshFunc(GLFWwindow* window);
+
 void keyboardFunc(GLFWwindow* window, int key, int scancode, int action,
                   int mods);
 
@@ -39,7 +43,6 @@ void clickFunc(GLFWwindow* window, int button, int action, int mods);
 void motionFunc(GLFWwindow* window, double mouse_x, double mouse_y);
 
 void Draw(const std::vector<DrawObject>& drawObjects,
-          std::vector<tinyobj::material_t>& materials,
-          std::map<std::string, GLuint>& textures);
+          const std::vector<DrawBatch>& batches);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "camera.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "trackball.h"
+
+namespace  // Local utility functions
+{
+void identity(float m[16]) {
+  memset(m, 0, 16 * sizeof(float));
+  m[0] = m[5] = m[10] = m[15] = 1.0f;
+}
+
+void normalize(float v[3]) {
+  float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  if (len > 0.0f) {
+    v[0] /= len;
+    v[1] /= len;
+    v[2] /= len;
+  }
+}
+
+void cross(const float a[3], const float b[3], float c[3]) {
+  c[0] = a[1] * b[2] - a[2] * b[1];
+  c[1] = a[2] * b[0] - a[0] * b[2];
+  c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+void lookAtMatrix(const float eye[3], const float lookat[3], const float up[3],
+                  float m[16]) {
+  float f[3] = {lookat[0] - eye[0], lookat[1] - eye[1], lookat[2] - eye[2]};
+  normalize(f);
+  float s[3], u[3];
+  cross(f, up, s);
+  normalize(s);
+  cross(s, f, u);
+  identity(m);
+  for (int k = 0; k < 3; k++) {
+    m[4 * k + 0] = s[k];
+    m[4 * k + 1] = u[k];
+    m[4 * k + 2] = -f[k];
+  }
+  m[12] = -(s[0] * eye[0] + s[1] * eye[1] + s[2] * eye[2]);
+  m[13] = -(u[0] * eye[0] + u[1] * eye[1] + u[2] * eye[2]);
+  m[14] = f[0] * eye[0] + f[1] * eye[1] + f[2] * eye[2];
+}
+}  // namespace
+
+void PerspectiveMatrix(float fovy_degrees, float aspect, float znear,
+                       float zfar, float m[16]) {
+  float f = 1.0f / tanf(0.5f * fovy_degrees * float(M_PI) / 180.0f);
+  memset(m, 0, 16 * sizeof(float));
+  m[0] = f / aspect;
+  m[5] = f;
+  m[10] = (zfar + znear) / (znear - zfar);
+  m[11] = -1.0f;
+  m[14] = 2.0f * zfar * znear / (znear - zfar);
+}
+
+void MultiplyMatrix(const float a[16], const float b[16], float m[16]) {
+  float r[16];
+  for (int c = 0; c < 4; c++) {
+    for (int row = 0; row < 4; row++) {
+      r[4 * c + row] = a[row] * b[4 * c] + a[4 + row] * b[4 * c + 1] +
+                       a[8 + row] * b[4 * c + 2] + a[12 + row] * b[4 * c + 3];
+    }
+  }
+  memcpy(m, r, sizeof(r));
+}
+
+void NormalMatrix(const float m[16], float n[9]) {
+  // Cofactors of the upper 3x3, which are the inverse transpose times the
+  // determinant.
+  for (int c = 0; c < 3; c++) {
+    for (int r = 0; r < 3; r++) {
+      int c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+      int r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+      n[3 * c + r] = m[4 * c1 + r1] * m[4 * c2 + r2] -
+                     m[4 * c1 + r2] * m[4 * c2 + r1];
+    }
+  }
+  float det = m[0] * n[0] + m[1] * n[1] + m[2] * n[2];
+  if (det != 0.0f) {
+    for (int k = 0; k < 9; k++) {
+      n[k] /= det;
+    }
+  }
+}
+
+void ModelViewMatrix(const float eye[3], const float lookat[3],
+                     const float up[3], const float quat[4],
+                     const float bmin[3], const float bmax[3], float m[16]) {
+  lookAtMatrix(eye, lookat, up, m);
+
+  float rot[4][4];
+  build_rotmatrix(rot, quat);
+  MultiplyMatrix(m, &rot[0][0], m);
+
+  // Fit to -1, 1 and centerize, as the legacy path does.
+  float maxExtent = 0.0f;
+  for (int k = 0; k < 3; k++) {
+    maxExtent = std::fmax(maxExtent, 0.5f * (bmax[k] - bmin[k]));
+  }
+  float fit[16];
+  identity(fit);
+  fit[0] = fit[5] = fit[10] = 1.0f / maxExtent;
+  for (int k = 0; k < 3; k++) {
+    fit[12 + k] = -0.5f * (bmax[k] + bmin[k]) / maxExtent;
+  }
+  MultiplyMatrix(m, fit, m);
+}
+
+void OrbitCamera(int frame, int numFrames, float quat[4], float eye[3]) {
+  float t = numFrames > 0 ? float(frame) / numFrames : 0.0f;
+  float yAxis[3] = {0.0f, 1.0f, 0.0f};
+  float xAxis[3] = {1.0f, 0.0f, 0.0f};
+  float turn[4], tilt[4];
+  axis_to_quat(yAxis, 2.0f * float(M_PI) * t, turn);
+  axis_to_quat(xAxis, 0.4f * sinf(2.0f * float(M_PI) * t), tilt);
+  add_quats(turn, tilt, quat);
+  // From the initial distance of 3 to 1.5 and back.
+  eye[0] = 0.0f;
+  eye[1] = 0.0f;
+  eye[2] = 3.0f - 1.5f * sinf(float(M_PI) * t);
+}
@@ -0,0 +1,33 @@
+
+#ifndef CAMERA_H
+#define CAMERA_H
+
+// Column-major 4x4 matrices, as glUniformMatrix4fv and glLoadMatrixf take
+// them. These compute on the CPU what the legacy renderer asks of the
+// fixed-function matrix stack.
+
+// Same as gluPerspective.
+void PerspectiveMatrix(float fovy_degrees, float aspect, float znear,
+                       float zfar, float m[16]);
+
+// Same as gluLookAt followed by the trackball rotation `quat`, then a
+// scale and translation that fit the box [bmin, bmax] to [-1, 1].
+void ModelViewMatrix(const float eye[3], const float lookat[3],
+                     const float up[3], const float quat[4],
+                     const float bmin[3], const float bmax[3], float m[16]);
+
+// m = a * b
+void MultiplyMatrix(const float a[16], const float b[16], float m[16]);
+
+// Inverse transpose of the upper 3x3 of `m`, column-major, which carries
+// normals along with the positions `m` transforms. The transpose of the
+// cofactors is used if `m` is singular.
+void NormalMatrix(const float m[16], float n[9]);
+
+// Trackball rotation and eye position for `frame` of a `numFrames` long
+// orbit: one turn around the model while tilting up and down and moving
+// closer and back, so culling and LOD see a changing view. The same frame
+// always gives the same camera.
+void OrbitCamera(int frame, int numFrames, float quat[4], float eye[3]);
+
+#endif
@@ -0,0 +1,433 @@
+#include "corerenderer.h"
+
+#include <iostream>
+#include <string>
+
+#include "gldebug.h"
+#include "global.h"
+#include "passtimer.h"
+#include "profiler.h"
+#include "util.h"
+
+namespace  // Local utility functions
+{
+// Attribute locations, shared by the shaders and the vertex arrays. The
+// instance matrix takes four, one per column, and its normal matrix three.
+enum {
+  kPositionLocation,
+  kNormalLocation,
+  kColorLocation,
+  kTexcoordLocation,
+  kInstanceLocation,
+  kNormalMatrixLocation = kInstanceLocation + 4
+};
+
+const char* kVersion = "#version 330 core\n";
+
+// Defined in front of the shaders of the single-pass wireframe program.
+const char* kWireOverlayDefine = "#define WIRE_OVERLAY\n";
+
+// Normals go through the normal matrix of the instance, computed on the
+// CPU, so copies placed with a non-uniform scale still shade with unit
+// normals. The legacy renderer bakes its colors from the untransformed
+// normals, so rotated copies shade differently there.
+const char* kVertexShader =
+    "layout(location = 0) in vec3 a_position;\n"
+    "layout(location = 1) in vec3 a_normal;\n"
+    "layout(location = 3) in vec2 a_texcoord;\n"
+    "layout(location = 4) in mat4 a_instance;\n"
+    "layout(location = 8) in mat3 a_normal_matrix;\n"
+    "uniform mat4 u_projection;\n"
+    "uniform mat4 u_modelview;\n"
+    "uniform vec3 u_position_offset;\n"
+    "uniform vec3 u_position_scale;\n"
+    "out VertexData {\n"
+    "  vec3 normal;\n"
+    "  vec2 texcoord;\n"
+    "} vs_out;\n"
+    "void main() {\n"
+    "  vec3 p = u_position_offset + u_position_scale * a_position;\n"
+    "  vec3 n = a_normal_matrix * a_normal;\n"
+    "  vs_out.normal = dot(n, n) > 0.0 ? normalize(n) : n;\n"
+    "  vs_out.texcoord = a_texcoord;\n"
+    "  gl_Position =\n"
+    "      u_projection * u_modelview * a_instance * vec4(p, 1.0);\n"
+    "}\n";
+
+// Passes each corner its window space distance to the opposite edge, so
+// the interpolated minimum is the distance to the nearest edge.
+const char* kWireGeometryShader =
+    "layout(triangles) in;\n"
+    "layout(triangle_strip, max_vertices = 3) out;\n"
+    "uniform vec2 u_viewport;\n"
+    "in VertexData {\n"
+    "  vec3 normal;\n"
+    "  vec2 texcoord;\n"
+    "} gs_in[];\n"
+    "out VertexData {\n"
+    "  vec3 normal;\n"
+    "  vec2 texcoord;\n"
+    "} gs_out;\n"
+    "noperspective out vec3 g_edge;\n"
+    "void main() {\n"
+    "  vec2 p[3];\n"
+    "  bool behind = false;\n"
+    "  for (int i = 0; i < 3; i++) {\n"
+    "    vec4 c = gl_in[i].gl_Position;\n"
+    "    behind = behind || c.w <= 0.0;\n"
+    "    p[i] = 0.5 * u_viewport * c.xy / c.w;\n"
+    "  }\n"
+    "  float area = abs((p[1].x - p[0].x) * (p[2].y - p[0].y) -\n"
+    "                   (p[2].x - p[0].x) * (p[1].y - p[0].y));\n"
+    "  vec3 h = vec3(area / max(length(p[2] - p[1]), 1e-6),\n"
+    "                area / max(length(p[2] - p[0]), 1e-6),\n"
+    "                area / max(length(p[1] - p[0]), 1e-6));\n"
+    "  // No edges on triangles that cross the eye plane.\n"
+    "  if (behind) {\n"
+    "    h = vec3(1e6);\n"
+    "  }\n"
+    "  for (int i = 0; i < 3; i++) {\n"
+    "    gs_out.normal = gs_in[i].normal;\n"
+    "    gs_out.texcoord = gs_in[i].texcoord;\n"
+    "    g_edge = vec3(0.0);\n"
+    "    g_edge[i] = h[i];\n"
+    "    gl_Position = gl_in[i].gl_Position;\n"
+    "    EmitVertex();\n"
+    "  }\n"
+    "  EndPrimitive();\n"
+    "}\n";
+
+// Same blend LoadObjAndConvert bakes into the vertex colors. The overlay
+// blends the wire color in over `u_wire_width` pixels around each edge.
+const char* kFragmentShader =
+    "in VertexData {\n"
+    "  vec3 normal;\n"
+    "  vec2 texcoord;\n"
+    "} fs_in;\n"
+    "uniform vec3 u_diffuse;\n"
+    "uniform bool u_textured;\n"
+    "uniform sampler2D u_texture;\n"
+    "uniform bool u_wire;\n"
+    "uniform vec3 u_wire_color;\n"
+    "out vec4 frag_color;\n"
+    "#ifdef WIRE_OVERLAY\n"
+    "noperspective in vec3 g_edge;\n"
+    "uniform float u_wire_width;\n"
+    "#endif\n"
+    "void main() {\n"
+    "  if (u_wire) {\n"
+    "    frag_color = vec4(u_wire_color, 1.0);\n"
+    "    return;\n"
+    "  }\n"
+    "  vec3 c = fs_in.normal * 0.2 + u_diffuse * 0.8;\n"
+    "  if (dot(c, c) > 0.0) {\n"
+    "    c = normalize(c);\n"
+    "  }\n"
+    "  frag_color = vec4(c * 0.5 + 0.5, 1.0);\n"
+    "  if (u_textured) {\n"
+    "    frag_color *= texture(u_texture, fs_in.texcoord);\n"
+    "  }\n"
+    "#ifdef WIRE_OVERLAY\n"
+    "  float d = min(g_edge.x, min(g_edge.y, g_edge.z));\n"
+    "  float half_width = 0.5 * u_wire_width;\n"
+    "  float a = 1.0 - smoothstep(half_width - 0.5, half_width + 0.5, d);\n"
+    "  frag_color.rgb = mix(frag_color.rgb, u_wire_color, a);\n"
+    "#endif\n"
+    "}\n";
+
+struct Program {
+  GLuint id;
+  GLint projection;
+  GLint modelview;
+  GLint position_offset;
+  GLint position_scale;
+  GLint diffuse;
+  GLint textured;
+  GLint texture;
+  GLint wire;
+  GLint wire_color;
+  GLint wire_width;  // overlay only
+  GLint viewport;    // overlay only
+};
+Program program;
+Program wireProgram;  // fill with the wireframe blended in, 0 if missing
+
+GLuint compileShader(GLenum type, const char* define, const char* source) {
+  const char* sources[] = {kVersion, define, source};
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 3, sources, NULL);
+  glCompileShader(shader);
+  GLint ok = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (!ok) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    std::cerr << "Shader compile error: " << log << std::endl;
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+// Build `p` from the shaders, the geometry shader being optional.
+bool linkProgram(const char* define, const char* geometrySource,
+                 Program* p) {
+  GLuint vs = compileShader(GL_VERTEX_SHADER, define, kVertexShader);
+  GLuint gs = geometrySource
+                  ? compileShader(GL_GEOMETRY_SHADER, define, geometrySource)
+                  : 0;
+  GLuint fs = compileShader(GL_FRAGMENT_SHADER, define, kFragmentShader);
+  if (vs == 0 || fs == 0 || (geometrySource && gs == 0)) {
+    glDeleteShader(vs);
+    glDeleteShader(gs);
+    glDeleteShader(fs);
+    return false;
+  }
+  p->id = glCreateProgram();
+  glAttachShader(p->id, vs);
+  if (gs) {
+    glAttachShader(p->id, gs);
+  }
+  glAttachShader(p->id, fs);
+  glLinkProgram(p->id);
+  glDeleteShader(vs);
+  glDeleteShader(gs);
+  glDeleteShader(fs);
+  GLint ok = GL_FALSE;
+  glGetProgramiv(p->id, GL_LINK_STATUS, &ok);
+  if (!ok) {
+    char log[1024];
+    glGetProgramInfoLog(p->id, sizeof(log), NULL, log);
+    std::cerr << "Shader link error: " << log << std::endl;
+    glDeleteProgram(p->id);
+    p->id = 0;
+    return false;
+  }
+  p->projection = glGetUniformLocation(p->id, "u_projection");
+  p->modelview = glGetUniformLocation(p->id, "u_modelview");
+  p->position_offset = glGetUniformLocation(p->id, "u_position_offset");
+  p->position_scale = glGetUniformLocation(p->id, "u_position_scale");
+  p->diffuse = glGetUniformLocation(p->id, "u_diffuse");
+  p->textured = glGetUniformLocation(p->id, "u_textured");
+  p->texture = glGetUniformLocation(p->id, "u_texture");
+  p->wire = glGetUniformLocation(p->id, "u_wire");
+  p->wire_color = glGetUniformLocation(p->id, "u_wire_color");
+  p->wire_width = glGetUniformLocation(p->id, "u_wire_width");
+  p->viewport = glGetUniformLocation(p->id, "u_viewport");
+  return true;
+}
+
+void setAttrib(GLuint location, const VertexAttrib& a, GLsizei stride) {
+  glEnableVertexAttribArray(location);
+  glVertexAttribPointer(location, a.size, a.type, a.normalized, stride,
+                        (const void*)a.offset);
+}
+
+// Instanced objects draw every range of the batch once for all copies;
+// there is no multi-draw with instances short of indirect draws.
+void drawBatch(const DrawObject& o, const DrawBatch& b) {
+  if (o.instance_vb_id) {
+    GLsizei numInstances = InstanceCount(o);
+    for (size_t i = 0; i < b.counts.size(); i++) {
+      glDrawElementsInstancedBaseVertex(GL_TRIANGLES, b.counts[i],
+                                        o.index_type, b.offsets[i],
+                                        numInstances, b.base_vertices[i]);
+    }
+    return;
+  }
+  glMultiDrawElementsBaseVertex(GL_TRIANGLES, b.counts.data(), o.index_type,
+                                b.offsets.data(),
+                                static_cast<GLsizei>(b.counts.size()),
+                                const_cast<GLint*>(b.base_vertices.data()));
+}
+
+void bindObject(const Program& p, const DrawObject& o) {
+  glBindVertexArray(o.vao_id);
+  glUniform3fv(p.position_offset, 1, o.position_offset);
+  glUniform3fv(p.position_scale, 1, o.position_scale);
+  // Objects without an instance buffer read the identity as the current
+  // value of the instance attributes.
+  if (!o.instance_vb_id) {
+    for (int c = 0; c < 4; c++) {
+      glVertexAttrib4f(kInstanceLocation + c, c == 0, c == 1, c == 2, c == 3);
+    }
+    for (int c = 0; c < 3; c++) {
+      glVertexAttrib3f(kNormalMatrixLocation + c, c == 0, c == 1, c == 2);
+    }
+  }
+}
+
+// Make `p` current with the uniforms every pass shares.
+void useProgram(const Program& p, const float projection[16],
+                const float modelview[16]) {
+  glUseProgram(p.id);
+  glUniformMatrix4fv(p.projection, 1, GL_FALSE, projection);
+  glUniformMatrix4fv(p.modelview, 1, GL_FALSE, modelview);
+  glUniform1i(p.texture, 0);
+  glUniform1i(p.wire, GL_FALSE);
+  glUniform3fv(p.wire_color, 1, g_wire_color);
+}
+
+// Draw all batches without textures, for the wireframe and back-face passes.
+void drawUntextured(const Program& p,
+                    const std::vector<DrawObject>& drawObjects,
+                    const std::vector<DrawBatch>& batches) {
+  glUniform1i(p.textured, GL_FALSE);
+  size_t boundObject = drawObjects.size();
+  for (size_t i = 0; i < batches.size(); i++) {
+    const DrawBatch& b = batches[i];
+    if (b.counts.empty()) {
+      continue;  // culled
+    }
+    const DrawObject& o = drawObjects[b.object];
+    if (b.object != boundObject) {
+      bindObject(p, o);
+      boundObject = b.object;
+    }
+    glUniform3fv(p.diffuse, 1, b.diffuse);
+    drawBatch(o, b);
+    CHECK_GL_HOT("untextured pass batch", i);
+  }
+}
+}  // namespace
+
+bool InitCoreRenderer() {
+  if (!linkProgram("", NULL, &program)) {
+    return false;
+  }
+  if (!linkProgram(kWireOverlayDefine, kWireGeometryShader, &wireProgram)) {
+    std::cerr << "No single-pass wireframe, drawing it as lines."
+              << std::endl;
+    wireProgram.id = 0;
+    g_wire_mode = kWireLines;
+  }
+  CheckErrors("init core renderer");
+  return true;
+}
+
+void CreateVertexArray(DrawObject* o) {
+  const VertexLayout& l = GetVertexLayout(o->vertex_format);
+  GLsizei stride = static_cast<GLsizei>(l.stride);
+  glGenVertexArrays(1, &o->vao_id);
+  glBindVertexArray(o->vao_id);
+  glBindBuffer(GL_ARRAY_BUFFER, o->vb_id);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, o->ib_id);
+  setAttrib(kPositionLocation, l.position, stride);
+  setAttrib(kNormalLocation, l.normal, stride);
+  setAttrib(kTexcoordLocation, l.texcoord, stride);
+  if (o->instance_vb_id) {
+    glBindBuffer(GL_ARRAY_BUFFER, o->instance_vb_id);
+    GLsizei instanceStride = kInstanceBufferFloats * sizeof(float);
+    for (int c = 0; c < 4; c++) {
+      glEnableVertexAttribArray(kInstanceLocation + c);
+      glVertexAttribPointer(kInstanceLocation + c, 4, GL_FLOAT, GL_FALSE,
+                            instanceStride,
+                            (const void*)(4 * c * sizeof(float)));
+      glVertexAttribDivisor(kInstanceLocation + c, 1);
+    }
+    for (int c = 0; c < 3; c++) {
+      glEnableVertexAttribArray(kNormalMatrixLocation + c);
+      glVertexAttribPointer(kNormalMatrixLocation + c, 3, GL_FLOAT, GL_FALSE,
+                            instanceStride,
+                            (const void*)((16 + 3 * c) * sizeof(float)));
+      glVertexAttribDivisor(kNormalMatrixLocation + c, 1);
+    }
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CreateVertexArrays(std::vector<DrawObject>* drawObjects) {
+  for (size_t i = 0; i < drawObjects->size(); i++) {
+    DrawObject& o = (*drawObjects)[i];
+    if (o.vb_id < 1) {
+      continue;
+    }
+    CreateVertexArray(&o);
+  }
+  CheckErrors("create vertex arrays");
+}
+
+void DrawCore(const std::vector<DrawObject>& drawObjects,
+              const std::vector<DrawBatch>& batches,
+              const float projection[16], const float modelview[16]) {
+  // The overlay draws the wireframe during the fill pass instead of
+  // drawing everything again as lines.
+  bool overlay = g_show_wire && g_wire_mode == kWireOverlay;
+  const Program& fill = overlay ? wireProgram : program;
+  useProgram(fill, projection, modelview);
+  if (overlay) {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glUniform2f(fill.viewport, float(viewport[2]), float(viewport[3]));
+    glUniform1f(fill.wire_width, g_wire_width);
+  }
+  glActiveTexture(GL_TEXTURE0);
+
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(1.0, 1.0);
+  // Core profile has no separate back face polygon mode, so culling is
+  // done by filling front faces and outlining back faces in a second pass.
+  if (g_cull_face) {
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+  }
+
+  // Batches are sorted by texture and then by object.
+  glBindTexture(GL_TEXTURE_2D, 0);
+  {
+    PROFILE_ZONE("fill pass");
+    g_pass_timers.begin(kPassFill);
+    GLuint boundTexture = 0;
+    size_t boundObject = drawObjects.size();
+    for (size_t i = 0; i < batches.size(); i++) {
+      const DrawBatch& b = batches[i];
+      if (b.counts.empty()) {
+        continue;  // culled
+      }
+      const DrawObject& o = drawObjects[b.object];
+      if (b.object != boundObject) {
+        bindObject(fill, o);
+        boundObject = b.object;
+      }
+      if (b.texture != boundTexture) {
+        glBindTexture(GL_TEXTURE_2D, b.texture);
+        boundTexture = b.texture;
+      }
+      glUniform3fv(fill.diffuse, 1, b.diffuse);
+      glUniform1i(fill.textured, b.texture != 0);
+      drawBatch(o, b);
+      CHECK_GL_HOT("fill pass batch", i);
+    }
+    g_pass_timers.end(kPassFill);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  if (overlay) {
+    useProgram(program, projection, modelview);
+  }
+
+  if (g_cull_face) {
+    PROFILE_ZONE("back face pass");
+    g_pass_timers.begin(kPassBackFace);
+    glCullFace(GL_FRONT);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    drawUntextured(program, drawObjects, batches);
+    g_pass_timers.end(kPassBackFace);
+    glDisable(GL_CULL_FACE);
+  }
+
+  // draw wireframe
+  if (g_show_wire && !overlay) {
+    PROFILE_ZONE("wire pass");
+    g_pass_timers.begin(kPassWire);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    glUniform1i(program.wire, GL_TRUE);
+    drawUntextured(program, drawObjects, batches);
+    g_pass_timers.end(kPassWire);
+  }
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glBindVertexArray(0);
+  glUseProgram(0);
+}
@@ -0,0 +1,29 @@
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "drawbatch.h"
+#include "drawobject.h"
+
+#ifndef CORERENDERER_H
+#define CORERENDERER_H
+
+// Compile the shaders of the core-profile renderer. Needs a current OpenGL
+// 3.3 context.
+bool InitCoreRenderer();
+
+// Create the vertex array object of an uploaded DrawObject.
+void CreateVertexArray(DrawObject* o);
+
+// Same for every uploaded DrawObject.
+void CreateVertexArrays(std::vector<DrawObject>* drawObjects);
+
+// Core-profile counterpart of Draw. The normal/diffuse color blend the
+// legacy path reads from the vertex colors is done in the shader. Unless
+// g_wire_mode asks for lines, the wireframe is blended in during the fill
+// pass by a geometry shader instead of drawing everything a second time.
+void DrawCore(const std::vector<DrawObject>& drawObjects,
+              const std::vector<DrawBatch>& batches,
+              const float projection[16], const float modelview[16]);
+
+#endif
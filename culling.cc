@@ -0,0 +1,150 @@
+#include "culling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "camera.h"
+#include "profiler.h"
+
+void ExtractFrustum(const float projection[16], const float modelview[16],
+                    Frustum* frustum) {
+  float m[16];
+  MultiplyMatrix(projection, modelview, m);
+  // Rows of the clip matrix; plane i is row 3 +/- row i/2.
+  for (int i = 0; i < 6; i++) {
+    int row = i / 2;
+    float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+    float* p = frustum->planes[i];
+    for (int c = 0; c < 4; c++) {
+      p[c] = m[4 * c + 3] + sign * m[4 * c + row];
+    }
+    float len = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    if (len > 0.0f) {
+      for (int c = 0; c < 4; c++) {
+        p[c] /= len;
+      }
+    }
+  }
+}
+
+bool SphereVisible(const Frustum& frustum, const float center[3],
+                   float radius) {
+  for (int i = 0; i < 6; i++) {
+    const float* p = frustum.planes[i];
+    if (p[0] * center[0] + p[1] * center[1] + p[2] * center[2] + p[3] <
+        -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RangeVisible(const Frustum& frustum, const DrawRange& range) {
+  for (int i = 0; i < 6; i++) {
+    const float* p = frustum.planes[i];
+    float d = p[0] * range.center[0] + p[1] * range.center[1] +
+              p[2] * range.center[2] + p[3];
+    if (d < -range.radius) {
+      return false;
+    }
+    if (d >= range.radius) {
+      continue;
+    }
+    // The sphere straddles the plane; try the box corner furthest along
+    // the plane normal.
+    float x = p[0] >= 0.0f ? range.bmax[0] : range.bmin[0];
+    float y = p[1] >= 0.0f ? range.bmax[1] : range.bmin[1];
+    float z = p[2] >= 0.0f ? range.bmax[2] : range.bmin[2];
+    if (p[0] * x + p[1] * y + p[2] * z + p[3] < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+namespace  // Local utility functions
+{
+// True if the bounding sphere of `range` is in `frustum` for any copy of
+// the instanced object `o`.
+bool instanceVisible(const Frustum& frustum, const DrawObject& o,
+                     const DrawRange& range) {
+  for (size_t i = 0; i < o.instances.size(); i += 16) {
+    const float* m = &o.instances[i];
+    float center[3];
+    float scale2 = 0.0f;
+    for (int k = 0; k < 3; k++) {
+      center[k] = m[k] * range.center[0] + m[4 + k] * range.center[1] +
+                  m[8 + k] * range.center[2] + m[12 + k];
+      const float* axis = m + 4 * k;
+      scale2 = std::max(scale2, axis[0] * axis[0] + axis[1] * axis[1] +
+                                    axis[2] * axis[2]);
+    }
+    if (SphereVisible(frustum, center, range.radius * sqrtf(scale2))) {
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace
+
+void CullBatches(const std::vector<DrawObject>& drawObjects,
+                 const std::vector<DrawBatch>& batches,
+                 const Frustum* frustum, const OcclusionBuffer* occlusion,
+                 const LodParams* lod, std::vector<DrawBatch>* visible,
+                 CullStats* stats) {
+  PROFILE_ZONE("cull");
+  stats->visibleTriangles = stats->culledTriangles = 0;
+  stats->visibleClusters = stats->culledClusters = 0;
+  stats->occludedTriangles = stats->occludedClusters = 0;
+  visible->resize(batches.size());
+  for (size_t i = 0; i < batches.size(); i++) {
+    const DrawBatch& b = batches[i];
+    const DrawObject& o = drawObjects[b.object];
+    DrawBatch& v = (*visible)[i];
+    size_t indexBytes =
+        o.index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    bool instanced = !o.instances.empty();
+    int copies = InstanceCount(o);
+    v.object = b.object;
+    v.material_id = b.material_id;
+    v.texture = b.texture;
+    for (int k = 0; k < 3; k++) {
+      v.diffuse[k] = b.diffuse[k];
+    }
+    v.counts.clear();
+    v.offsets.clear();
+    v.base_vertices.clear();
+    v.ranges.clear();
+    for (size_t j = 0; j < b.ranges.size(); j++) {
+      const DrawRange& r = o.ranges[b.ranges[j]];
+      bool inFrustum =
+          o.vb_id != 0 &&
+          (!frustum || (instanced ? instanceVisible(*frustum, o, r)
+                                  : RangeVisible(*frustum, r)));
+      bool occluded = inFrustum && occlusion && !instanced &&
+                      !occlusion->boxVisible(r.bmin, r.bmax);
+      if (inFrustum && !occluded) {
+        int level = lod && !instanced ? SelectLod(*lod, r) : 0;
+        if (level == 0) {
+          v.counts.push_back(b.counts[j]);
+          v.offsets.push_back(b.offsets[j]);
+        } else {
+          const DrawLod& l = r.lods[level - 1];
+          v.counts.push_back(l.count);
+          v.offsets.push_back((const void*)(l.first * indexBytes));
+        }
+        v.base_vertices.push_back(b.base_vertices[j]);
+        v.ranges.push_back(b.ranges[j]);
+        stats->visibleTriangles += v.counts.back() / 3 * copies;
+        stats->visibleClusters++;
+      } else {
+        stats->culledTriangles += b.counts[j] / 3 * copies;
+        stats->culledClusters++;
+        if (occluded) {
+          stats->occludedTriangles += b.counts[j] / 3;
+          stats->occludedClusters++;
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#include <vector>
+
+#include "drawbatch.h"
+#include "drawobject.h"
+#include "lod.h"
+#include "occlusion.h"
+
+#ifndef CULLING_H
+#define CULLING_H
+
+// Clip planes ax + by + cz + d >= 0 of a view volume, in model space.
+typedef struct {
+  float planes[6][4];
+} Frustum;
+
+// Triangles and clusters drawn and skipped by the last CullBatches.
+typedef struct {
+  int visibleTriangles;
+  int culledTriangles;
+  int visibleClusters;
+  int culledClusters;
+  int occludedTriangles;  // of the culled ones, hidden by occluders
+  int occludedClusters;
+} CullStats;
+
+// Frustum of the column-major `projection` * `modelview`.
+void ExtractFrustum(const float projection[16], const float modelview[16],
+                    Frustum* frustum);
+
+// Conservative test of a bounding sphere.
+bool SphereVisible(const Frustum& frustum, const float center[3],
+                   float radius);
+
+// Conservative test of a range's bounding sphere and box.
+bool RangeVisible(const Frustum& frustum, const DrawRange& range);
+
+// Fill `visible` with the ranges of `batches` that intersect `frustum` and
+// are not hidden behind the occluders of `occlusion`, each at the level of
+// detail `lod` selects; any of them is skipped when NULL. Objects without
+// a vertex buffer, such as pages that are not resident, count as culled.
+// Ranges of instanced objects are drawn for all copies if any copy is in
+// the frustum, always at full detail and without the occlusion test, and
+// their triangles count once per copy.
+// `visible` keeps one entry per batch, with no draws if all were culled, so
+// its storage is reused from frame to frame.
+void CullBatches(const std::vector<DrawObject>& drawObjects,
+                 const std::vector<DrawBatch>& batches,
+                 const Frustum* frustum, const OcclusionBuffer* occlusion,
+                 const LodParams* lod, std::vector<DrawBatch>* visible,
+                 CullStats* stats);
+
+#endif
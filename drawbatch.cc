@@ -0,0 +1,176 @@
+#include "drawbatch.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace  // Local utility functions
+{
+size_t indexSize(GLenum index_type) {
+  return index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+bool batchOrder(const DrawBatch& a, const DrawBatch& b) {
+  if (a.texture != b.texture) {
+    return a.texture < b.texture;
+  }
+  if (a.object != b.object) {
+    return a.object < b.object;
+  }
+  return a.material_id < b.material_id;
+}
+
+// Append `sb`'s indices to `indices` as `index_type`, widening if needed.
+void appendIndices(const DrawObject& o, const ShapeBuffer& sb,
+                   GLenum index_type, std::vector<unsigned char>* indices) {
+  if (o.index_type == index_type) {
+    indices->insert(indices->end(), sb.indices.begin(), sb.indices.end());
+    return;
+  }
+  // Only 16 to 32 bit widening happens.
+  size_t count = sb.indices.size() / sizeof(GLushort);
+  size_t start = indices->size();
+  indices->resize(start + count * sizeof(GLuint));
+  for (size_t i = 0; i < count; i++) {
+    GLushort i16;
+    memcpy(&i16, &sb.indices[i * sizeof(GLushort)], sizeof(i16));
+    GLuint i32 = i16;
+    memcpy(&(*indices)[start + i * sizeof(GLuint)], &i32, sizeof(i32));
+  }
+}
+
+bool rangeOrder(const DrawRange& a, const DrawRange& b) {
+  if (a.material_id != b.material_id) {
+    return a.material_id < b.material_id;
+  }
+  return a.first < b.first;
+}
+}  // namespace
+
+void BuildDrawBatches(const std::vector<DrawObject>& drawObjects,
+                      const std::vector<tinyobj::material_t>& materials,
+                      const std::map<std::string, GLuint>& textures,
+                      std::vector<DrawBatch>* batches) {
+  batches->clear();
+  for (size_t i = 0; i < drawObjects.size(); i++) {
+    const DrawObject& o = drawObjects[i];
+    if (o.numTriangles == 0) {
+      continue;
+    }
+    // Ranges are sorted by material, so each run becomes one batch.
+    for (size_t r = 0; r < o.ranges.size(); r++) {
+      const DrawRange& range = o.ranges[r];
+      if (r == 0 || range.material_id != o.ranges[r - 1].material_id) {
+        DrawBatch b;
+        b.object = i;
+        b.material_id = range.material_id;
+        b.texture = 0;
+        b.diffuse[0] = b.diffuse[1] = b.diffuse[2] = 0.0f;
+        if (range.material_id < materials.size()) {
+          for (int k = 0; k < 3; k++) {
+            b.diffuse[k] = materials[range.material_id].diffuse[k];
+          }
+          std::map<std::string, GLuint>::const_iterator it =
+              textures.find(materials[range.material_id].diffuse_texname);
+          if (it != textures.end()) {
+            b.texture = it->second;
+          }
+        }
+        batches->push_back(b);
+      }
+      DrawBatch& b = batches->back();
+      b.counts.push_back(range.count);
+      b.offsets.push_back(
+          (const void*)(range.first * indexSize(o.index_type)));
+      b.base_vertices.push_back(range.base_vertex);
+      b.ranges.push_back(r);
+    }
+  }
+  std::sort(batches->begin(), batches->end(), batchOrder);
+}
+
+DrawStats CountDrawStats(const std::vector<DrawBatch>& batches) {
+  DrawStats stats = {0, 0, 0};
+  const DrawBatch* prev = NULL;
+  for (size_t i = 0; i < batches.size(); i++) {
+    const DrawBatch& b = batches[i];
+    if (b.counts.empty()) {
+      continue;  // culled
+    }
+    if (!prev || b.object != prev->object) {
+      stats.bufferBinds++;
+    }
+    if (b.texture != (prev ? prev->texture : 0)) {
+      stats.textureBinds++;
+    }
+    stats.drawCalls++;
+    prev = &b;
+  }
+  return stats;
+}
+
+void MergeDrawObjects(std::vector<DrawObject>* objects,
+                      std::vector<ShapeBuffer>* shapeBuffers) {
+  if (objects->empty()) {
+    return;
+  }
+
+  DrawObject merged = (*objects)[0];
+  merged.index_type = GL_UNSIGNED_SHORT;
+  merged.numVertices = 0;
+  merged.numTriangles = 0;
+  merged.ranges.clear();
+  merged.instances.clear();
+  merged.instance_vb_id = 0;
+  std::vector<DrawObject> instanced;
+  std::vector<ShapeBuffer> instancedBuffers;
+  size_t vertexBytes = 0, indexCount = 0;
+  for (size_t i = 0; i < objects->size(); i++) {
+    const DrawObject& o = (*objects)[i];
+    if (!o.instances.empty()) {
+      continue;
+    }
+    if (o.index_type != GL_UNSIGNED_SHORT) {
+      merged.index_type = GL_UNSIGNED_INT;
+    }
+    vertexBytes += (*shapeBuffers)[i].vertices.size();
+    indexCount += (*shapeBuffers)[i].indices.size() / indexSize(o.index_type);
+  }
+
+  ShapeBuffer sb;
+  sb.vertices.reserve(vertexBytes);
+  sb.indices.reserve(indexCount * indexSize(merged.index_type));
+  for (size_t i = 0; i < objects->size(); i++) {
+    const DrawObject& o = (*objects)[i];
+    const ShapeBuffer& shape = (*shapeBuffers)[i];
+    if (!o.instances.empty()) {
+      instanced.push_back(o);
+      instancedBuffers.push_back(shape);
+      continue;
+    }
+    if (o.numTriangles == 0) {
+      continue;
+    }
+    int firstIndex = sb.indices.size() / indexSize(merged.index_type);
+    for (size_t r = 0; r < o.ranges.size(); r++) {
+      DrawRange range = o.ranges[r];
+      range.first += firstIndex;
+      for (int l = 0; l < range.num_lods; l++) {
+        range.lods[l].first += firstIndex;
+      }
+      range.base_vertex += merged.numVertices;
+      merged.ranges.push_back(range);
+    }
+    sb.vertices.insert(sb.vertices.end(), shape.vertices.begin(),
+                       shape.vertices.end());
+    appendIndices(o, shape, merged.index_type, &sb.indices);
+    merged.numVertices += o.numVertices;
+    merged.numTriangles += o.numTriangles;
+  }
+  std::stable_sort(merged.ranges.begin(), merged.ranges.end(), rangeOrder);
+
+  objects->assign(1, merged);
+  shapeBuffers->assign(1, sb);
+  objects->insert(objects->end(), instanced.begin(), instanced.end());
+  shapeBuffers->insert(shapeBuffers->end(), instancedBuffers.begin(),
+                       instancedBuffers.end());
+}
@@ -0,0 +1,53 @@
+#include <GL/glew.h>
+
+#include <tiny_obj_loader.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "drawobject.h"
+
+#ifndef DRAWBATCH_H
+#define DRAWBATCH_H
+
+// The ranges of one DrawObject that share a material, issued with a single
+// glMultiDrawElementsBaseVertex call.
+typedef struct {
+  size_t object;  // index into the DrawObject list
+  size_t material_id;
+  GLuint texture;  // 0 if the material has no diffuse texture
+  float diffuse[3];
+  std::vector<GLsizei> counts;
+  std::vector<const void*> offsets;  // byte offsets into the index buffer
+  std::vector<GLint> base_vertices;
+  std::vector<size_t> ranges;  // index into DrawObject::ranges of each draw
+} DrawBatch;
+
+// GL work of one pass over a list of batches.
+typedef struct {
+  int drawCalls;
+  int bufferBinds;
+  int textureBinds;
+} DrawStats;
+
+// Group the ranges of `drawObjects` into batches, sorted by texture and then
+// by object so each texture is bound once per pass.
+void BuildDrawBatches(const std::vector<DrawObject>& drawObjects,
+                      const std::vector<tinyobj::material_t>& materials,
+                      const std::map<std::string, GLuint>& textures,
+                      std::vector<DrawBatch>* batches);
+
+// Count what drawing `batches` in order costs, the way Draw issues them.
+DrawStats CountDrawStats(const std::vector<DrawBatch>& batches);
+
+// Pack the geometry of all `objects` into one vertex and one index buffer.
+// Every range keeps its own base vertex, so indices are not rewritten, and
+// the ranges are sorted by material so each material becomes one batch.
+// All objects must share a vertex format and quantization. Objects drawn
+// with instances keep buffers of their own and follow the merged one. Runs
+// before the GL upload.
+void MergeDrawObjects(std::vector<DrawObject>* objects,
+                      std::vector<ShapeBuffer>* shapeBuffers);
+
+#endif
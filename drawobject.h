@@ -1,11 +1,69 @@
 
+#include <vector>
+
+#include "vertexformat.h"
+
 #ifndef DRAWOBJECT_H
 #define DRAWOBJECT_H
 
+// Coarser levels of detail kept per DrawRange.
+const int kMaxLods = 4;
+
+// Simplified version of a DrawRange's triangles, drawing from the same
+// vertices.
+typedef struct {
+  int first;
+  int count;
+  float error;  // largest distance to the full detail, in model units
+} DrawLod;
+
+// Run of indices [first, first + count) drawn with one material. The
+// indices are relative to `base_vertex`, which is 0 unless several shapes
+// were merged into one buffer. Large runs are split into spatial clusters,
+// each with its own bounds for culling.
 typedef struct {
-  GLuint vb_id;  // vertex buffer id
-  int numTriangles;
   size_t material_id;
+  int first;
+  int count;
+  int base_vertex;
+  float bmin[3];  // model space bounding box
+  float bmax[3];
+  float center[3];  // bounding sphere
+  float radius;
+  int num_lods;  // valid entries of `lods`, coarsest last
+  DrawLod lods[kMaxLods];
+} DrawRange;
+
+typedef struct {
+  GLuint vb_id;       // vertex buffer id
+  GLuint ib_id;       // index buffer id
+  GLuint vao_id;      // vertex array, core renderer only
+  GLenum index_type;  // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+  int numVertices;    // # of unique vertices in vb_id
+  int numTriangles;
+  std::vector<DrawRange> ranges;  // by material, covering all triangles
+  VertexFormat vertex_format;
+  float position_offset[3];  // compact positions are restored as
+  float position_scale[3];   // offset + scale * stored value
+  // Column-major model matrices, 16 floats each, of the copies drawn with
+  // instancing. Empty for objects drawn once, untransformed.
+  std::vector<float> instances;
+  GLuint instance_vb_id;  // `instances`, may be shared between objects
 } DrawObject;
 
-#endif
\ No newline at end of file
+// Floats per copy in an instance buffer: the model matrix followed by its
+// normal matrix (see NormalMatrix), so shaders need not invert it.
+const int kInstanceBufferFloats = 16 + 9;
+
+// # of copies of `o` that are drawn.
+inline int InstanceCount(const DrawObject& o) {
+  return o.instances.empty() ? 1 : static_cast<int>(o.instances.size() / 16);
+}
+
+// CPU-side geometry of a DrawObject before it is uploaded.
+typedef struct {
+  std::vector<unsigned char> vertices;  // in DrawObject::vertex_format
+  std::vector<unsigned char> indices;  // packed as DrawObject::index_type
+} ShapeBuffer;
+
+#endif
@@ -0,0 +1,471 @@
+#include "facebins.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+#include "objparser.h"
+#include "profiler.h"
+
+namespace  // Local utility functions
+{
+// Triangles a node collects before they are written to the bin file.
+const size_t kBlockTriangles = 256;
+
+// A face in the temporary face file, followed by its corners.
+typedef struct {
+  uint32_t numCorners;
+  int32_t material_id;
+  uint32_t smoothing_id;
+  uint32_t shape;
+} FaceRecord;
+
+bool seekTo(FILE* fp, uint64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(fp, offset, SEEK_SET) == 0;
+#else
+  return fseeko(fp, offset, SEEK_SET) == 0;
+#endif
+}
+
+bool contains(const Bounds& b, const tinyobj::real_t* p) {
+  for (int k = 0; k < 3; k++) {
+    if (p[k] < b.bmin[k] || p[k] > b.bmax[k]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Index into `out` of the attribute `i` of `size` components in `data`,
+// copied over the first time it is used.
+int localIndex(int i, const tinyobj::real_t* data, int size,
+               std::unordered_map<int, int>& map,
+               std::vector<tinyobj::real_t>* out) {
+  if (i < 0) {
+    return -1;
+  }
+  auto result = map.insert(std::make_pair(i, int(out->size() / size)));
+  if (result.second) {
+    out->insert(out->end(), data + size_t(size) * i,
+                data + size_t(size) * (i + 1));
+  }
+  return result.first->second;
+}
+}  // namespace
+
+FaceBins::~FaceBins() {
+  if (fp_) {
+    fclose(fp_);
+  }
+  positions_.close();
+  normals_.close();
+  texcoords_.close();
+  for (size_t i = 0; i < spillFiles_.size(); i++) {
+    remove(spillFiles_[i].c_str());
+  }
+}
+
+bool FaceBins::build(const char* filename, const char* mtl_basedir,
+                     const std::string& spill_filename, size_t maxTriangles,
+                     std::vector<tinyobj::material_t>* materials,
+                     std::string* warn, std::string* err) {
+  PROFILE_ZONE("bin faces");
+  // Positions, normals, texcoords and faces, then the bins.
+  const char* suffixes[5] = {".v.tmp", ".vn.tmp", ".vt.tmp", ".f.tmp",
+                             ".bins.tmp"};
+  for (int i = 0; i < 5; i++) {
+    spillFiles_.push_back(spill_filename + suffixes[i]);
+  }
+  FILE* out[4];
+  bool written = true;
+  for (int i = 0; i < 4; i++) {
+    out[i] = fopen(spillFiles_[i].c_str(), "wb");
+    written = written && out[i];
+  }
+  auto write = [&](FILE* fp, const void* data, size_t size, size_t count) {
+    written = written && fwrite(data, size, count, fp) == count;
+  };
+
+  numPositions_ = numNormals_ = numTexcoords_ = 0;
+  size_t numShapes = 0;
+  bool parsed =
+      written &&
+      StreamObjParallel(
+          filename, mtl_basedir,
+          [&](const ObjStream& s) {
+            write(out[0], s.vertices.data(), sizeof(tinyobj::real_t),
+                  s.vertices.size());
+            write(out[1], s.normals.data(), sizeof(tinyobj::real_t),
+                  s.normals.size());
+            write(out[2], s.texcoords.data(), sizeof(tinyobj::real_t),
+                  s.texcoords.size());
+            numPositions_ += s.vertices.size() / 3;
+            numNormals_ += s.normals.size() / 3;
+            numTexcoords_ += s.texcoords.size() / 2;
+            size_t corner = 0;
+            for (size_t f = 0; f < s.num_face_vertices.size(); f++) {
+              FaceRecord r = {s.num_face_vertices[f], s.material_ids[f],
+                              s.smoothing_group_ids[f], s.shape_ids[f]};
+              write(out[3], &r, sizeof(r), 1);
+              write(out[3], &s.indices[corner], sizeof(tinyobj::index_t),
+                    r.numCorners);
+              corner += r.numCorners;
+              if (r.smoothing_id > 0) {
+                if (smoothed_.size() <= r.shape) {
+                  smoothed_.resize(r.shape + 1, 0);
+                }
+                smoothed_[r.shape] = 1;
+              }
+            }
+            return written;
+          },
+          materials, &numShapes, warn, err);
+  for (int i = 0; i < 4; i++) {
+    if (out[i] && fclose(out[i]) != 0) {
+      written = false;
+    }
+  }
+  if (!written) {
+    if (err) {
+      (*err) += "Unable to write temporary file: " + spill_filename +
+                ".*.tmp\n";
+    }
+    return false;
+  }
+  if (!parsed) {
+    return false;
+  }
+
+  // Attributes are looked up by index from here on. Empty files cannot be
+  // mapped and are not needed.
+  hasNormals_ = numNormals_ > 0;
+  fp_ = fopen(spillFiles_[4].c_str(), "w+b");
+  ok_ = fp_ && (numPositions_ == 0 || positions_.open(spillFiles_[0])) &&
+        (numNormals_ == 0 || normals_.open(spillFiles_[1])) &&
+        (numTexcoords_ == 0 || texcoords_.open(spillFiles_[2]));
+  nodes_.assign(1, Node());
+  if (ok_ && !binFaces(spillFiles_[3], warn)) {
+    ok_ = false;
+  }
+  remove(spillFiles_[3].c_str());
+
+  // Split depth first, so only the children of one node are pending.
+  std::vector<size_t> stack(1, 0);
+  while (ok_ && !stack.empty()) {
+    size_t n = stack.back();
+    stack.pop_back();
+    if (nodes_[n].count > maxTriangles) {
+      split(n);
+      for (size_t c = nodes_[n].numChildren; c-- > 0;) {
+        stack.push_back(nodes_[n].firstChild + c);
+      }
+    } else if (nodes_[n].count > 0) {
+      bins_.push_back(n);
+    }
+  }
+  if (ok_) {
+    addHalos();
+  }
+  if (!ok_ && err) {
+    (*err) += "Unable to bin faces in temporary file: " + spillFiles_[4] +
+              "\n";
+  }
+  return ok_;
+}
+
+bool FaceBins::binFaces(const std::string& faces_filename,
+                        std::string* warn) {
+  FILE* fp = fopen(faces_filename.c_str(), "rb");
+  if (!fp) {
+    return false;
+  }
+  const tinyobj::real_t* v =
+      reinterpret_cast<const tinyobj::real_t*>(positions_.data());
+  FaceRecord r;
+  std::vector<tinyobj::index_t> corners, triangles;
+  size_t skipped = 0;
+  bool ok = true;
+  while (ok && fread(&r, sizeof(r), 1, fp) == 1) {
+    corners.resize(r.numCorners);
+    ok = fread(corners.data(), sizeof(tinyobj::index_t), r.numCorners, fp) ==
+         r.numCorners;
+    triangles.clear();
+    if (ok) {
+      TriangulateFace(corners.data(), r.numCorners, v, numPositions_,
+                      &triangles);
+    }
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+      BinTriangle t;
+      t.shape = r.shape;
+      t.material_id = r.material_id;
+      t.smoothing_id = r.smoothing_id;
+      bool valid = true;
+      for (int k = 0; k < 3; k++) {
+        tinyobj::index_t idx = triangles[i + k];
+        valid = valid && idx.vertex_index >= 0 &&
+                size_t(idx.vertex_index) < numPositions_;
+        if (idx.normal_index >= 0 && size_t(idx.normal_index) >= numNormals_) {
+          idx.normal_index = -1;
+        }
+        if (idx.texcoord_index >= 0 &&
+            size_t(idx.texcoord_index) >= numTexcoords_) {
+          idx.texcoord_index = -1;
+        }
+        t.corners[k] = idx;
+      }
+      if (valid) {
+        append(0, t, false);
+      } else {
+        skipped++;
+      }
+    }
+  }
+  ok = ok && !ferror(fp);
+  fclose(fp);
+  flush(nodes_[0], false);
+  if (skipped > 0 && warn) {
+    (*warn) += std::to_string(skipped) +
+               " triangle(s) with an invalid vertex index skipped.\n";
+  }
+  return ok && ok_;
+}
+
+const tinyobj::real_t* FaceBins::position(int v) const {
+  return reinterpret_cast<const tinyobj::real_t*>(positions_.data()) +
+         3 * size_t(v);
+}
+
+void FaceBins::centroid(const BinTriangle& t, float c[3]) const {
+  const tinyobj::real_t* p0 = position(t.corners[0].vertex_index);
+  const tinyobj::real_t* p1 = position(t.corners[1].vertex_index);
+  const tinyobj::real_t* p2 = position(t.corners[2].vertex_index);
+  for (int k = 0; k < 3; k++) {
+    c[k] = (p0[k] + p1[k] + p2[k]) / 3.0f;
+  }
+}
+
+void FaceBins::append(size_t n, const BinTriangle& t, bool halo) {
+  Node& node = nodes_[n];
+  if (halo) {
+    node.pendingHalo.push_back(t);
+    if (node.pendingHalo.size() == kBlockTriangles) {
+      flush(node, true);
+    }
+    return;
+  }
+
+  for (int k = 0; k < 3; k++) {
+    const tinyobj::real_t* p = position(t.corners[k].vertex_index);
+    for (int j = 0; j < 3; j++) {
+      node.vertices.bmin[j] = std::min(node.vertices.bmin[j], p[j]);
+      node.vertices.bmax[j] = std::max(node.vertices.bmax[j], p[j]);
+    }
+  }
+  float c[3];
+  centroid(t, c);
+  for (int j = 0; j < 3; j++) {
+    node.centroids.bmin[j] = std::min(node.centroids.bmin[j], c[j]);
+    node.centroids.bmax[j] = std::max(node.centroids.bmax[j], c[j]);
+  }
+  node.count++;
+  node.pending.push_back(t);
+  if (node.pending.size() == kBlockTriangles) {
+    flush(node, false);
+  }
+}
+
+void FaceBins::flush(Node& node, bool halo) {
+  std::vector<BinTriangle>& pending = halo ? node.pendingHalo : node.pending;
+  if (pending.empty()) {
+    return;
+  }
+  Block b = {end_, pending.size()};
+  ok_ = ok_ && seekTo(fp_, end_) &&
+        fwrite(pending.data(), sizeof(BinTriangle), pending.size(), fp_) ==
+            pending.size();
+  end_ += pending.size() * sizeof(BinTriangle);
+  (halo ? node.halo : node.blocks).push_back(b);
+  pending.clear();
+}
+
+bool FaceBins::readBlock(const Block& b, std::vector<BinTriangle>* triangles) {
+  size_t first = triangles->size();
+  triangles->resize(first + b.count);
+  ok_ = ok_ && seekTo(fp_, b.offset) &&
+        fread(&(*triangles)[first], sizeof(BinTriangle), b.count, fp_) ==
+            b.count;
+  return ok_;
+}
+
+void FaceBins::split(size_t n) {
+  // Children are appended to `nodes_`, so nodes are referred to by index.
+  // Halve the centroid bounds along the axes at least half as long as the
+  // longest one, so flat parts are not cut across their thickness. If all
+  // centroids are (about) the same point, halve the triangles in file order.
+  const Bounds& b = nodes_[n].centroids;
+  float longest = 0.0f;
+  for (int k = 0; k < 3; k++) {
+    longest = std::max(longest, b.bmax[k] - b.bmin[k]);
+  }
+  float center[3];
+  bool axes[3];
+  int numAxes = 0;
+  for (int k = 0; k < 3; k++) {
+    center[k] = 0.5f * (b.bmin[k] + b.bmax[k]);
+    axes[k] = b.bmax[k] - b.bmin[k] >= 0.5f * longest && b.bmin[k] < center[k];
+    numAxes += axes[k];
+  }
+  bool separable = numAxes > 0;
+  size_t numChildren = separable ? size_t(1) << numAxes : 2;
+  size_t half = nodes_[n].count / 2;
+  size_t first = nodes_.size();
+  nodes_.resize(first + numChildren);
+  nodes_[n].firstChild = first;
+  nodes_[n].numChildren = numChildren;
+
+  std::vector<Block> blocks;
+  blocks.swap(nodes_[n].blocks);
+  std::vector<BinTriangle> triangles;
+  size_t index = 0;
+  for (size_t i = 0; i < blocks.size(); i++) {
+    triangles.clear();
+    if (!readBlock(blocks[i], &triangles)) {
+      return;
+    }
+    for (size_t j = 0; j < triangles.size(); j++, index++) {
+      const BinTriangle& t = triangles[j];
+      size_t child = index < half ? 0 : 1;
+      if (separable) {
+        float c[3];
+        centroid(t, c);
+        child = 0;
+        for (int k = 0, bit = 0; k < 3; k++) {
+          if (axes[k]) {
+            child |= size_t(c[k] >= center[k]) << bit++;
+          }
+        }
+      }
+      append(first + child, t, false);
+    }
+  }
+  for (size_t c = 0; c < numChildren; c++) {
+    flush(nodes_[first + c], false);
+  }
+}
+
+void FaceBins::addHalos() {
+  PROFILE_ZONE("bin halos");
+  std::vector<BinTriangle> triangles;
+  std::vector<size_t> hits, stack;
+  for (size_t b = 0; b < bins_.size() && ok_; b++) {
+    size_t n = bins_[b];
+    for (size_t i = 0; i < nodes_[n].blocks.size(); i++) {
+      triangles.clear();
+      if (!readBlock(nodes_[n].blocks[i], &triangles)) {
+        return;
+      }
+      for (size_t j = 0; j < triangles.size(); j++) {
+        // Bins whose vertices any corner of the triangle may be shared with.
+        hits.clear();
+        for (int k = 0; k < 3; k++) {
+          const tinyobj::real_t* p =
+              position(triangles[j].corners[k].vertex_index);
+          stack.assign(1, 0);
+          while (!stack.empty()) {
+            const Node& node = nodes_[stack.back()];
+            size_t m = stack.back();
+            stack.pop_back();
+            if (!contains(node.vertices, p)) {
+              continue;
+            }
+            if (node.numChildren == 0) {
+              hits.push_back(m);
+            }
+            for (size_t c = 0; c < node.numChildren; c++) {
+              stack.push_back(node.firstChild + c);
+            }
+          }
+        }
+        std::sort(hits.begin(), hits.end());
+        hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+        for (size_t h = 0; h < hits.size(); h++) {
+          if (hits[h] != n) {
+            append(hits[h], triangles[j], true);
+          }
+        }
+      }
+    }
+  }
+  for (size_t b = 0; b < bins_.size(); b++) {
+    flush(nodes_[bins_[b]], true);
+  }
+}
+
+bool FaceBins::readBin(size_t i, tinyobj::attrib_t* attrib,
+                       std::vector<tinyobj::shape_t>* shapes,
+                       std::vector<unsigned int>* shapeIds,
+                       std::vector<size_t>* numOwned) {
+  PROFILE_ZONE("read bin");
+  const Node& node = nodes_[bins_[i]];
+  std::vector<BinTriangle> triangles;
+  triangles.reserve(node.count);
+  for (size_t b = 0; b < node.blocks.size(); b++) {
+    if (!readBlock(node.blocks[b], &triangles)) {
+      return false;
+    }
+  }
+  for (size_t b = 0; b < node.halo.size(); b++) {
+    if (!readBlock(node.halo[b], &triangles)) {
+      return false;
+    }
+  }
+
+  // One shape per model shape with triangles of the bin, in model order.
+  std::map<unsigned int, size_t> slots;
+  for (size_t t = 0; t < node.count; t++) {
+    slots.insert(std::make_pair(triangles[t].shape, 0));
+  }
+  shapeIds->clear();
+  for (auto it = slots.begin(); it != slots.end(); ++it) {
+    it->second = shapeIds->size();
+    shapeIds->push_back(it->first);
+  }
+  shapes->assign(slots.size(), tinyobj::shape_t());
+  numOwned->assign(slots.size(), 0);
+
+  *attrib = tinyobj::attrib_t();
+  std::unordered_map<int, int> vmap, vnmap, vtmap;
+  const tinyobj::real_t* v =
+      reinterpret_cast<const tinyobj::real_t*>(positions_.data());
+  const tinyobj::real_t* vn =
+      reinterpret_cast<const tinyobj::real_t*>(normals_.data());
+  const tinyobj::real_t* vt =
+      reinterpret_cast<const tinyobj::real_t*>(texcoords_.data());
+  for (size_t t = 0; t < triangles.size(); t++) {
+    // Halo triangles of shapes the bin has none of do not matter.
+    auto slot = slots.find(triangles[t].shape);
+    if (slot == slots.end()) {
+      continue;
+    }
+    tinyobj::mesh_t& mesh = (*shapes)[slot->second].mesh;
+    for (int k = 0; k < 3; k++) {
+      const tinyobj::index_t& in = triangles[t].corners[k];
+      tinyobj::index_t idx;
+      idx.vertex_index =
+          localIndex(in.vertex_index, v, 3, vmap, &attrib->vertices);
+      idx.normal_index =
+          localIndex(in.normal_index, vn, 3, vnmap, &attrib->normals);
+      idx.texcoord_index =
+          localIndex(in.texcoord_index, vt, 2, vtmap, &attrib->texcoords);
+      mesh.indices.push_back(idx);
+    }
+    mesh.num_face_vertices.push_back(3);
+    mesh.material_ids.push_back(triangles[t].material_id);
+    mesh.smoothing_group_ids.push_back(triangles[t].smoothing_id);
+    if (t < node.count) {
+      (*numOwned)[slot->second]++;
+    }
+  }
+  return true;
+}
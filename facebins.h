@@ -0,0 +1,114 @@
+#include <tiny_obj_loader.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+#include "objconvert.h"
+
+#ifndef FACEBINS_H
+#define FACEBINS_H
+
+// A triangle of a binned model with the state of the face it came from.
+// Indices are global to the model.
+typedef struct {
+  tinyobj::index_t corners[3];
+  unsigned int shape;
+  int material_id;
+  unsigned int smoothing_id;
+} BinTriangle;
+
+// Spatial bins of the triangles of an OBJ model that does not have to fit in
+// memory. The file is parsed a few chunks at a time and its attributes and
+// triangles are spilled to temporary files on disk. The triangles are then
+// binned by their centroid, halving the bins in space until none holds more
+// than a given # of them. Every bin also gets a halo: the triangles of other
+// bins that touch its vertices, so normals can be smoothed one bin at a time
+// as if the whole model were at hand.
+class FaceBins {
+ public:
+  FaceBins()
+      : fp_(NULL),
+        end_(0),
+        ok_(false),
+        numPositions_(0),
+        numNormals_(0),
+        numTexcoords_(0),
+        hasNormals_(false) {}
+  ~FaceBins();
+
+  // Bin `filename` into bins of at most `maxTriangles` triangles. The
+  // temporary files are named after `spill_filename` and removed again with
+  // the bins.
+  bool build(const char* filename, const char* mtl_basedir,
+             const std::string& spill_filename, size_t maxTriangles,
+             std::vector<tinyobj::material_t>* materials, std::string* warn,
+             std::string* err);
+
+  size_t numBins() const { return bins_.size(); }
+
+  // True if the model has any vertex normals.
+  bool hasNormals() const { return hasNormals_; }
+
+  // True if any face of shape `shape` of the model has a smoothing group.
+  bool hasSmoothingGroup(unsigned int shape) const {
+    return shape < smoothed_.size() && smoothed_[shape];
+  }
+
+  // Read bin `i` as tinyobj data with attributes of its own. There is one
+  // shape per shape of the model the bin has triangles of, `shapeIds` holds
+  // its ID in the model, and the first `numOwned` triangles of each are the
+  // bin's own; the rest are its halo.
+  bool readBin(size_t i, tinyobj::attrib_t* attrib,
+               std::vector<tinyobj::shape_t>* shapes,
+               std::vector<unsigned int>* shapeIds,
+               std::vector<size_t>* numOwned);
+
+ private:
+  FaceBins(const FaceBins&);
+  FaceBins& operator=(const FaceBins&);
+
+  // A run of triangles in the bin file.
+  typedef struct {
+    uint64_t offset;
+    uint64_t count;
+  } Block;
+
+  // A node of the bin tree. Its triangles are in the bin file until it is
+  // split.
+  struct Node {
+    Node() : count(0), firstChild(0), numChildren(0) {}
+
+    std::vector<Block> blocks, halo;
+    std::vector<BinTriangle> pending, pendingHalo;  // not yet written
+    size_t count;
+    Bounds centroids;  // of its triangles
+    Bounds vertices;   // of the vertices of its triangles
+    size_t firstChild;
+    size_t numChildren;
+  };
+
+  bool binFaces(const std::string& faces_filename, std::string* warn);
+  void append(size_t node, const BinTriangle& t, bool halo);
+  void flush(Node& node, bool halo);
+  bool readBlock(const Block& b, std::vector<BinTriangle>* triangles);
+  void split(size_t node);
+  void addHalos();
+  const tinyobj::real_t* position(int v) const;
+  void centroid(const BinTriangle& t, float c[3]) const;
+
+  FILE* fp_;
+  uint64_t end_;
+  bool ok_;
+  std::vector<std::string> spillFiles_;
+  MappedFile positions_, normals_, texcoords_;
+  size_t numPositions_, numNormals_, numTexcoords_;
+  bool hasNormals_;
+  std::vector<char> smoothed_;
+  std::vector<Node> nodes_;
+  std::vector<size_t> bins_;  // leaves with triangles, depth first
+};
+
+#endif
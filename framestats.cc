@@ -0,0 +1,65 @@
+#include "framestats.h"
+
+#include <algorithm>
+#include <string>
+
+#include "parallel.h"
+#include "profiler.h"
+
+namespace  // Local utility functions
+{
+// Nearest-rank percentile `p` of the ascending `sorted`.
+double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t rank = size_t(p / 100.0 * sorted.size() + 0.5);
+  return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+}  // namespace
+
+void FrameStats::addFrame(double seconds, int triangles, int drawCalls) {
+  seconds_.push_back(seconds);
+  triangles_ += triangles;
+  drawCalls_ += drawCalls;
+}
+
+void FrameStats::writeJson(FILE* fp, const char* model, const char* renderer,
+                           const char* device, const LoadTimes& load) const {
+  std::vector<double> sorted = seconds_;
+  std::sort(sorted.begin(), sorted.end());
+  double total = 0.0;
+  for (size_t i = 0; i < sorted.size(); i++) {
+    total += sorted[i];
+  }
+  size_t frames = sorted.size();
+  double perFrame = frames > 0 ? 1.0 / frames : 0.0;
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"model\": %s,\n", QuoteJson(model).c_str());
+  fprintf(fp, "  \"renderer\": %s,\n", QuoteJson(renderer).c_str());
+  fprintf(fp, "  \"device\": %s,\n", QuoteJson(device).c_str());
+  fprintf(fp, "  \"threads\": %u,\n", NumWorkerThreads());
+  fprintf(fp, "  \"load_ms\": {\n");
+  fprintf(fp, "    \"parse\": %.3f,\n", load.parse_ms);
+  fprintf(fp, "    \"convert\": %.3f,\n", load.convert_ms);
+  fprintf(fp, "    \"upload\": %.3f,\n", load.upload_ms);
+  fprintf(fp, "    \"textures\": %.3f,\n", load.texture_ms);
+  fprintf(fp, "    \"total\": %.3f,\n", load.total_ms);
+  fprintf(fp, "    \"cached\": %s\n", load.cached ? "true" : "false");
+  fprintf(fp, "  },\n");
+  fprintf(fp, "  \"frames\": %d,\n", (int)frames);
+  fprintf(fp, "  \"frame_ms\": {\n");
+  fprintf(fp, "    \"mean\": %.3f,\n", 1000.0 * total * perFrame);
+  fprintf(fp, "    \"min\": %.3f,\n", 1000.0 * percentile(sorted, 0.0));
+  fprintf(fp, "    \"p50\": %.3f,\n", 1000.0 * percentile(sorted, 50.0));
+  fprintf(fp, "    \"p95\": %.3f,\n", 1000.0 * percentile(sorted, 95.0));
+  fprintf(fp, "    \"p99\": %.3f,\n", 1000.0 * percentile(sorted, 99.0));
+  fprintf(fp, "    \"max\": %.3f\n", 1000.0 * percentile(sorted, 100.0));
+  fprintf(fp, "  },\n");
+  fprintf(fp, "  \"triangles_per_frame\": %.0f,\n", triangles_ * perFrame);
+  fprintf(fp, "  \"triangles_per_second\": %.0f,\n",
+          total > 0.0 ? triangles_ / total : 0.0);
+  fprintf(fp, "  \"draw_calls_per_frame\": %.1f\n", drawCalls_ * perFrame);
+  fprintf(fp, "}\n");
+}
@@ -0,0 +1,27 @@
+#include <cstdio>
+#include <vector>
+
+#include "global.h"
+
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+// Frame times and work of a --benchmark run.
+class FrameStats {
+ public:
+  FrameStats() : triangles_(0.0), drawCalls_(0.0) {}
+
+  void addFrame(double seconds, int triangles, int drawCalls);
+
+  // Write `load`, the frame time percentiles and the throughput as a JSON
+  // object to `fp`. `model`, `renderer` and `device` describe the run.
+  void writeJson(FILE* fp, const char* model, const char* renderer,
+                 const char* device, const LoadTimes& load) const;
+
+ private:
+  std::vector<double> seconds_;
+  double triangles_;
+  double drawCalls_;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "gldebug.h"
+
+#include <cstdio>
+
+namespace  // Local utility functions
+{
+// # of debug messages logged so far, and when CheckGLErrorAt last looked.
+int messageCount = 0;
+int checkedCount = 0;
+
+const char* sourceName(GLenum source) {
+  switch (source) {
+    case GL_DEBUG_SOURCE_API:
+      return "api";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+      return "window system";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER:
+      return "shader compiler";
+    case GL_DEBUG_SOURCE_THIRD_PARTY:
+      return "third party";
+    case GL_DEBUG_SOURCE_APPLICATION:
+      return "application";
+    default:
+      return "other";
+  }
+}
+
+const char* typeName(GLenum type) {
+  switch (type) {
+    case GL_DEBUG_TYPE_ERROR:
+      return "error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+      return "deprecated";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+      return "undefined behavior";
+    case GL_DEBUG_TYPE_PORTABILITY:
+      return "portability";
+    case GL_DEBUG_TYPE_PERFORMANCE:
+      return "performance";
+    default:
+      return "other";
+  }
+}
+
+const char* severityName(GLenum severity) {
+  switch (severity) {
+    case GL_DEBUG_SEVERITY_HIGH:
+      return "high";
+    case GL_DEBUG_SEVERITY_MEDIUM:
+      return "medium";
+    case GL_DEBUG_SEVERITY_LOW:
+      return "low";
+    default:
+      return "notification";
+  }
+}
+
+void GLAPIENTRY debugCallback(GLenum source, GLenum type, GLuint id,
+                              GLenum severity, GLsizei length,
+                              const GLchar* message, const void* userParam) {
+  (void)length;
+  (void)userParam;
+  messageCount++;
+  fprintf(stderr, "GL %s %s (%s, id %u): %s\n", sourceName(source),
+          typeName(type), severityName(severity), id, message);
+}
+}  // namespace
+
+bool InstallGLDebugOutput() {
+  if (!GLEW_KHR_debug) {
+    fprintf(stderr, "KHR_debug is not supported, no GL debug output.\n");
+    return false;
+  }
+  glEnable(GL_DEBUG_OUTPUT);
+  if (g_gl_validate) {
+    // Report from inside the offending call, so CheckGLErrorAt can tell
+    // which draw a message belongs to.
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  }
+  glDebugMessageCallback(debugCallback, NULL);
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE,
+                        GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE);
+  return true;
+}
+
+void LabelDrawObjects(const std::vector<DrawObject>& drawObjects) {
+  if (!GLEW_KHR_debug) {
+    return;
+  }
+  char label[64];
+  for (size_t i = 0; i < drawObjects.size(); i++) {
+    const DrawObject& o = drawObjects[i];
+    if (o.vb_id > 0) {
+      snprintf(label, sizeof(label), "object %d vertices", int(i));
+      glObjectLabel(GL_BUFFER, o.vb_id, -1, label);
+    }
+    if (o.ib_id > 0) {
+      snprintf(label, sizeof(label), "object %d indices", int(i));
+      glObjectLabel(GL_BUFFER, o.ib_id, -1, label);
+    }
+    if (o.vao_id > 0) {
+      snprintf(label, sizeof(label), "object %d", int(i));
+      glObjectLabel(GL_VERTEX_ARRAY, o.vao_id, -1, label);
+    }
+  }
+}
+
+void CheckGLErrorAt(const char* what, size_t index) {
+  GLenum e = glGetError();
+  if (e != GL_NO_ERROR) {
+    fprintf(stderr, "OpenGL error 0x%04x in \"%s\" #%d\n", e, what,
+            int(index));
+  }
+  if (messageCount != checkedCount) {
+    fprintf(stderr, "  ^ debug output from \"%s\" #%d\n", what, int(index));
+    checkedCount = messageCount;
+  }
+}
@@ -0,0 +1,38 @@
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "drawobject.h"
+#include "global.h"
+
+#ifndef GLDEBUG_H
+#define GLDEBUG_H
+
+// Install a glDebugMessageCallback that logs driver messages, if the
+// context supports KHR_debug. Messages arrive asynchronously unless
+// g_gl_validate is set, so logging does not stall the pipeline.
+bool InstallGLDebugOutput();
+
+// Name the buffers and vertex arrays of `drawObjects` so debug messages say
+// which object they are about.
+void LabelDrawObjects(const std::vector<DrawObject>& drawObjects);
+
+// Log any GL error, or debug message, raised since the last check and
+// attribute it to draw `index` of `what`. Does not exit.
+void CheckGLErrorAt(const char* what, size_t index);
+
+// Error check for per-draw code. Costs a branch unless --gl-validate is
+// given, and nothing in NDEBUG builds.
+#ifdef NDEBUG
+#define CHECK_GL_HOT(what, index) ((void)0)
+#else
+#define CHECK_GL_HOT(what, index)      \
+  do {                                 \
+    if (g_gl_validate) {               \
+      CheckGLErrorAt((what), (index)); \
+    }                                  \
+  } while (0)
+#endif
+
+#endif
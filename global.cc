@@ -1,6 +1,7 @@
 #include "global.h"
 
 std::vector<DrawObject> gDrawObjects;
+std::vector<DrawBatch> gDrawBatches;
 
 int width = 768;
 int height = 768;
@@ -13,6 +14,34 @@ float curr_quat[4];
 float prev_quat[4];
 float eye[3], lookat[3], up[3];
 bool g_show_wire = true;
+WireMode g_wire_mode = kWireOverlay;
+float g_wire_width = 1.0f;
+float g_wire_color[3] = {0.0f, 0.0f, 0.4f};
 bool g_cull_face = false;
+bool g_use_mesh_cache = true;
+bool g_compress_textures = false;
+
+ObjParser g_obj_parser = kParserTinyObj;
+bool g_verify_parser = false;
+int g_num_threads = 0;
+bool g_angle_weighted_normals = false;
+VertexFormat g_vertex_format = kVertexFormatFloat;
+bool g_merge_draws = true;
+bool g_instance_shapes = true;
+bool g_base_vertex = true;
+bool g_paged = false;
+int g_memory_budget_mb = 512;
+bool g_profile = false;
+Renderer g_renderer = kRendererLegacy;
+bool g_gl_debug = false;
+bool g_gl_validate = false;
+bool g_frustum_cull = true;
+bool g_occlusion_cull = false;
+bool g_lod = true;
+float g_lod_pixel_error = 1.0f;
+CullStats g_cull_stats = {0, 0, 0, 0, 0, 0};
+bool g_redraw = true;
+bool g_show_hud = false;
+LoadTimes g_load_times = {0.0, 0.0, 0.0, 0.0, 0.0, false};
 
 GLFWwindow* window;
@@ -10,11 +10,14 @@
 
 #include <vector>
 
+#include "culling.h"
+#include "drawbatch.h"
 #include "drawobject.h"
 
 #ifndef GLOBALS_H
 #define GLOBALS_H
 extern std::vector<DrawObject> gDrawObjects;
+extern std::vector<DrawBatch> gDrawBatches;
 
 extern int width;
 extern int height;
@@ -27,7 +30,50 @@ extern float curr_quat[4];
 extern float prev_quat[4];
 extern float eye[3], lookat[3], up[3];
 extern bool g_show_wire;
+enum WireMode { kWireLines, kWireOverlay };
+extern WireMode g_wire_mode;  // overlay needs the core renderer
+extern float g_wire_width;    // in pixels
+extern float g_wire_color[3];
 extern bool g_cull_face;
+extern bool g_use_mesh_cache;  // also covers the texture cache
+extern bool g_compress_textures;
+
+enum ObjParser { kParserTinyObj, kParserParallel };
+extern ObjParser g_obj_parser;
+extern bool g_verify_parser;
+extern int g_num_threads;  // 0: one per hardware thread
+extern bool g_angle_weighted_normals;
+extern VertexFormat g_vertex_format;
+extern bool g_merge_draws;
+extern bool g_instance_shapes;  // draw repeated shapes as instances
+extern bool g_base_vertex;  // glDrawElementsBaseVertex is available
+extern bool g_paged;  // stream the model from a page file
+extern int g_memory_budget_mb;  // for the resident pages
+extern bool g_profile;  // record zones for WriteChromeTrace
+
+enum Renderer { kRendererLegacy, kRendererCore };
+extern Renderer g_renderer;
+extern bool g_gl_debug;     // debug context with KHR_debug output
+extern bool g_gl_validate;  // check for GL errors after every draw
+extern bool g_frustum_cull;
+extern bool g_occlusion_cull;  // test clusters against a CPU depth buffer
+extern bool g_lod;
+extern float g_lod_pixel_error;  // screen space error allowed by LOD
+extern CullStats g_cull_stats;  // of the last frame
+extern bool g_redraw;  // the view changed since the last frame
+extern bool g_show_hud;  // frame statistics overlay, also enables timing
+
+// Time spent in each phase of loading the model. Phases that were skipped,
+// such as parsing when the mesh cache was used, stay at 0.
+typedef struct {
+  double parse_ms;
+  double convert_ms;
+  double upload_ms;
+  double texture_ms;  // waiting for the texture decoders
+  double total_ms;
+  bool cached;  // restored from the mesh cache or page file
+} LoadTimes;
+extern LoadTimes g_load_times;
 
 extern GLFWwindow* window;
 #endif
\ No newline at end of file
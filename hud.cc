@@ -0,0 +1,190 @@
+#include "hud.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <set>
+
+namespace  // Local utility functions
+{
+// 5x7 glyphs of ' ' to 'Z', one byte per row, the left column in bit 4.
+const unsigned char kFont[][7] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // space
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // !
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // "
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // #
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // $
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03},  // %
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // &
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // '
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02},  // (
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08},  // )
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // *
+    {0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00},  // +
+    {0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08},  // ,
+    {0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00},  // -
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c},  // .
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00},  // /
+    {0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e},  // 0
+    {0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e},  // 1
+    {0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f},  // 2
+    {0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e},  // 3
+    {0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02},  // 4
+    {0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e},  // 5
+    {0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e},  // 6
+    {0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},  // 7
+    {0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e},  // 8
+    {0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c},  // 9
+    {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00},  // :
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // ;
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // <
+    {0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00},  // =
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // >
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // ?
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // @
+    {0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11},  // A
+    {0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e},  // B
+    {0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e},  // C
+    {0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c},  // D
+    {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f},  // E
+    {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10},  // F
+    {0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f},  // G
+    {0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11},  // H
+    {0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e},  // I
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c},  // J
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11},  // K
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f},  // L
+    {0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11},  // M
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11},  // N
+    {0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e},  // O
+    {0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10},  // P
+    {0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d},  // Q
+    {0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11},  // R
+    {0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e},  // S
+    {0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},  // T
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e},  // U
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04},  // V
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a},  // W
+    {0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11},  // X
+    {0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04},  // Y
+    {0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f},  // Z
+
+};
+const char kFirstGlyph = ' ';
+const char kLastGlyph = 'Z';
+
+// Glyphs are drawn in cells with a pixel of spacing, and scaled up when
+// blitted.
+const int kCellWidth = 6;
+const int kCellHeight = 9;
+const int kMargin = 4;
+const int kScale = 2;
+
+const unsigned char kBackground[4] = {16, 16, 16, 255};
+const unsigned char kForeground[4] = {224, 224, 224, 255};
+}  // namespace
+
+bool Hud::init() {
+  if (!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object) {
+    return false;
+  }
+  glGenTextures(1, &texture_);
+  glGenFramebuffers(1, &framebuffer_);
+  return true;
+}
+
+void Hud::release() {
+  if (framebuffer_) {
+    glDeleteFramebuffers(1, &framebuffer_);
+    glDeleteTextures(1, &texture_);
+    framebuffer_ = texture_ = 0;
+  }
+}
+
+void Hud::setText(const std::string& text) {
+  if (!framebuffer_) {
+    return;
+  }
+  std::vector<std::string> lines(1);
+  size_t columns = 0;
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '\n') {
+      lines.push_back(std::string());
+    } else {
+      lines.back() += toupper((unsigned char)text[i]);
+      columns = std::max(columns, lines.back().size());
+    }
+  }
+  width_ = 2 * kMargin + int(columns) * kCellWidth;
+  height_ = 2 * kMargin + int(lines.size()) * kCellHeight;
+
+  // Rows run bottom up, as GL expects them.
+  std::vector<unsigned char> pixels(4 * width_ * height_);
+  for (size_t i = 0; i < pixels.size(); i += 4) {
+    memcpy(&pixels[i], kBackground, 4);
+  }
+  for (size_t l = 0; l < lines.size(); l++) {
+    for (size_t c = 0; c < lines[l].size(); c++) {
+      char ch = lines[l][c];
+      if (ch < kFirstGlyph || ch > kLastGlyph) {
+        continue;
+      }
+      const unsigned char* glyph = kFont[ch - kFirstGlyph];
+      for (int y = 0; y < 7; y++) {
+        int row = height_ - 1 - (kMargin + int(l) * kCellHeight + y);
+        for (int x = 0; x < 5; x++) {
+          if (glyph[y] & (0x10 >> x)) {
+            int col = kMargin + int(c) * kCellWidth + x;
+            memcpy(&pixels[4 * (row * width_ + col)], kForeground, 4);
+          }
+        }
+      }
+    }
+  }
+
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width_, height_, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, pixels.data());
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+  glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                         GL_TEXTURE_2D, texture_, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void Hud::draw(int windowHeight) const {
+  if (!framebuffer_ || width_ == 0) {
+    return;
+  }
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBlitFramebuffer(0, 0, width_, height_, 0, windowHeight - kScale * height_,
+                    kScale * width_, windowHeight, GL_COLOR_BUFFER_BIT,
+                    GL_NEAREST);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+size_t BufferBytes(const std::vector<DrawObject>& drawObjects) {
+  std::set<GLuint> buffers;
+  for (size_t i = 0; i < drawObjects.size(); i++) {
+    buffers.insert(drawObjects[i].vb_id);
+    buffers.insert(drawObjects[i].ib_id);
+  }
+  buffers.erase(0);
+  // Any buffer can be bound to GL_ARRAY_BUFFER, which unlike
+  // GL_ELEMENT_ARRAY_BUFFER is not vertex array state.
+  size_t bytes = 0;
+  for (std::set<GLuint>::const_iterator it = buffers.begin();
+       it != buffers.end(); ++it) {
+    GLint size = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, *it);
+    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+    bytes += size;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return bytes;
+}
@@ -0,0 +1,44 @@
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+#include "drawobject.h"
+
+#ifndef HUD_H
+#define HUD_H
+
+// Text overlay in the top left corner of the window. The text is drawn
+// into a texture on the CPU and blitted onto the frame, so it needs no
+// shaders and works with both renderers, given framebuffer objects.
+// Letters are shown in upper case; characters without a glyph are blank.
+class Hud {
+ public:
+  Hud() : texture_(0), framebuffer_(0), width_(0), height_(0) {}
+
+  // False without framebuffer objects.
+  bool init();
+  void release();
+
+  // Lines are separated by '\n'. Uploads the new image.
+  void setText(const std::string& text);
+
+  // Blit the text onto the default framebuffer of a window `windowHeight`
+  // pixels high.
+  void draw(int windowHeight) const;
+
+ private:
+  Hud(const Hud&);
+  Hud& operator=(const Hud&);
+
+  GLuint texture_;
+  GLuint framebuffer_;
+  int width_;  // of the image
+  int height_;
+};
+
+// Bytes of the vertex and index buffers of `drawObjects`, counting buffers
+// shared between objects once. Asks GL for the sizes.
+size_t BufferBytes(const std::vector<DrawObject>& drawObjects);
+
+#endif
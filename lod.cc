@@ -0,0 +1,408 @@
+#include "lod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "parallel.h"
+
+namespace  // Local utility functions
+{
+// Ranges with fewer triangles are always drawn in full.
+const size_t kMinLodTriangles = 64;
+
+// A level that keeps more than this share of the previous level's
+// triangles is not worth storing; the rest of the range is locked.
+const float kMinLodReduction = 0.85f;
+
+// Cosine of the largest turn a collapse may give a triangle's normal.
+const double kMinNormalDot = 0.2;
+
+// Symmetric 4x4 matrix summing the squared distances to a set of planes,
+// each weighted by the area of its triangle.
+struct Quadric {
+  double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+  double weight;
+
+  Quadric() : xx(0), xy(0), xz(0), xw(0), yy(0), yz(0), yw(0), zz(0), zw(0),
+              ww(0), weight(0) {}
+
+  void addPlane(const double n[3], double d, double w) {
+    xx += w * n[0] * n[0];
+    xy += w * n[0] * n[1];
+    xz += w * n[0] * n[2];
+    xw += w * n[0] * d;
+    yy += w * n[1] * n[1];
+    yz += w * n[1] * n[2];
+    yw += w * n[1] * d;
+    zz += w * n[2] * n[2];
+    zw += w * n[2] * d;
+    ww += w * d * d;
+    weight += w;
+  }
+  void add(const Quadric& q) {
+    xx += q.xx;
+    xy += q.xy;
+    xz += q.xz;
+    xw += q.xw;
+    yy += q.yy;
+    yz += q.yz;
+    yw += q.yw;
+    zz += q.zz;
+    zw += q.zw;
+    ww += q.ww;
+    weight += q.weight;
+  }
+  double eval(const float p[3]) const {
+    double x = p[0], y = p[1], z = p[2];
+    return xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x +
+           yy * y * y + 2 * yz * y * z + 2 * yw * y + zz * z * z +
+           2 * zw * z + ww;
+  }
+};
+
+struct Collapse {
+  float cost;   // weighted squared distance
+  float error;  // RMS distance to the planes of the collapsed triangles
+  unsigned int src;  // moves onto dst
+  unsigned int dst;
+
+  bool operator<(const Collapse& c) const { return cost < c.cost; }
+};
+
+void normal(const float* a, const float* b, const float* c, double n[3]) {
+  double e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  double e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+  n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+  n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+  n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Quadric error edge collapse restricted to the existing vertices, so the
+// simplified triangles index the same vertex buffer as the full mesh. Runs
+// in passes of independent collapses, cheapest first.
+class Simplifier {
+ public:
+  Simplifier(const float* vertices, size_t stride,
+             const unsigned int* indices, size_t numIndices)
+      : maxError_(0.0f) {
+    // Work on local vertex ids.
+    vertexIds_.assign(indices, indices + numIndices);
+    std::sort(vertexIds_.begin(), vertexIds_.end());
+    vertexIds_.erase(std::unique(vertexIds_.begin(), vertexIds_.end()),
+                     vertexIds_.end());
+    size_t n = vertexIds_.size();
+    triangles_.resize(numIndices);
+    for (size_t i = 0; i < numIndices; i++) {
+      triangles_[i] = std::lower_bound(vertexIds_.begin(), vertexIds_.end(),
+                                       indices[i]) -
+                      vertexIds_.begin();
+    }
+    positions_.resize(3 * n);
+    for (size_t v = 0; v < n; v++) {
+      for (int k = 0; k < 3; k++) {
+        positions_[3 * v + k] = vertices[vertexIds_[v] * stride + k];
+      }
+    }
+    lockBordersAndSeams();
+
+    quadrics_.resize(n);
+    for (size_t t = 0; t < numIndices; t += 3) {
+      const unsigned int* tri = &triangles_[t];
+      double nrm[3];
+      normal(position(tri[0]), position(tri[1]), position(tri[2]), nrm);
+      double len = sqrt(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]);
+      if (len == 0.0) {
+        continue;
+      }
+      for (int k = 0; k < 3; k++) {
+        nrm[k] /= len;
+      }
+      const float* p = position(tri[0]);
+      double d = -(nrm[0] * p[0] + nrm[1] * p[1] + nrm[2] * p[2]);
+      for (int v = 0; v < 3; v++) {
+        quadrics_[tri[v]].addPlane(nrm, d, 0.5 * len);
+      }
+    }
+  }
+
+  // Collapse edges until at most `targetIndices` indices are left or no
+  // edge can go without flipping a triangle.
+  void collapseTo(size_t targetIndices) {
+    size_t n = vertexIds_.size();
+    std::vector<unsigned int> adjacencyStart(n + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> remap(n);
+    std::vector<char> touched(n);
+    while (triangles_.size() > targetIndices) {
+      // Triangles around each vertex.
+      std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+      for (size_t i = 0; i < triangles_.size(); i++) {
+        adjacencyStart[triangles_[i] + 1]++;
+      }
+      for (size_t v = 0; v < n; v++) {
+        adjacencyStart[v + 1] += adjacencyStart[v];
+      }
+      adjacency.resize(triangles_.size());
+      std::vector<unsigned int> fill(adjacencyStart.begin(),
+                                     adjacencyStart.end() - 1);
+      for (size_t i = 0; i < triangles_.size(); i++) {
+        adjacency[fill[triangles_[i]]++] = i / 3;
+      }
+
+      // The cheapest collapse of each free vertex.
+      collapses.clear();
+      for (size_t v = 0; v < n; v++) {
+        if (locked_[v]) {
+          continue;
+        }
+        Collapse best = {0.0f, 0.0f, 0, 0};
+        bool found = false;
+        for (unsigned int j = adjacencyStart[v]; j < adjacencyStart[v + 1];
+             j++) {
+          const unsigned int* tri = &triangles_[3 * adjacency[j]];
+          for (int k = 0; k < 3; k++) {
+            if (tri[k] == v) {
+              continue;
+            }
+            Quadric q = quadrics_[v];
+            q.add(quadrics_[tri[k]]);
+            double cost = std::max(q.eval(position(tri[k])), 0.0);
+            if (!found || cost < best.cost) {
+              best.cost = float(cost);
+              best.error =
+                  float(q.weight > 0.0 ? sqrt(cost / q.weight) : 0.0);
+              best.src = v;
+              best.dst = tri[k];
+              found = true;
+            }
+          }
+        }
+        if (found) {
+          collapses.push_back(best);
+        }
+      }
+      std::sort(collapses.begin(), collapses.end());
+
+      for (size_t v = 0; v < n; v++) {
+        remap[v] = v;
+      }
+      std::fill(touched.begin(), touched.end(), 0);
+      size_t remaining = triangles_.size();
+      bool collapsed = false;
+      for (size_t i = 0; i < collapses.size() && remaining > targetIndices;
+           i++) {
+        const Collapse& c = collapses[i];
+        if (touched[c.src] || touched[c.dst]) {
+          continue;
+        }
+        int removed = 0;
+        if (!collapseValid(c, adjacencyStart, adjacency, &removed)) {
+          continue;
+        }
+        remap[c.src] = c.dst;
+        quadrics_[c.dst].add(quadrics_[c.src]);
+        maxError_ = std::max(maxError_, c.error);
+        remaining -= 3 * removed;
+        collapsed = true;
+        for (unsigned int j = adjacencyStart[c.src];
+             j < adjacencyStart[c.src + 1]; j++) {
+          const unsigned int* tri = &triangles_[3 * adjacency[j]];
+          touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+        }
+      }
+      if (!collapsed) {
+        break;
+      }
+
+      // Drop the triangles that became degenerate.
+      size_t out = 0;
+      for (size_t t = 0; t < triangles_.size(); t += 3) {
+        unsigned int a = remap[triangles_[t]];
+        unsigned int b = remap[triangles_[t + 1]];
+        unsigned int c = remap[triangles_[t + 2]];
+        if (a != b && b != c && c != a) {
+          triangles_[out++] = a;
+          triangles_[out++] = b;
+          triangles_[out++] = c;
+        }
+      }
+      triangles_.resize(out);
+    }
+  }
+
+  size_t indexCount() const { return triangles_.size(); }
+
+  // Largest collapse error so far, in model units.
+  float error() const { return maxError_; }
+
+  void output(std::vector<unsigned int>* indices) const {
+    indices->resize(triangles_.size());
+    for (size_t i = 0; i < triangles_.size(); i++) {
+      (*indices)[i] = vertexIds_[triangles_[i]];
+    }
+  }
+
+ private:
+  Simplifier(const Simplifier&);
+
+  const float* position(unsigned int v) const { return &positions_[3 * v]; }
+
+  // Edges used by one triangle only are borders, either of the range or
+  // where welding split vertices with different normals or texture
+  // coordinates. Vertices sharing a position are locked as well.
+  void lockBordersAndSeams() {
+    size_t n = vertexIds_.size();
+    locked_.assign(n, 0);
+    std::vector<uint64_t> edges;
+    edges.reserve(triangles_.size());
+    for (size_t i = 0; i < triangles_.size(); i++) {
+      uint64_t a = triangles_[i];
+      uint64_t b = triangles_[i - i % 3 + (i + 1) % 3];
+      edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();) {
+      size_t j = i;
+      while (j < edges.size() && edges[j] == edges[i]) {
+        j++;
+      }
+      if (j - i != 2) {
+        locked_[edges[i] >> 32] = 1;
+        locked_[edges[i] & 0xffffffffu] = 1;
+      }
+      i = j;
+    }
+
+    std::vector<unsigned int> order(n);
+    for (size_t v = 0; v < n; v++) {
+      order[v] = v;
+    }
+    std::sort(order.begin(), order.end(),
+              [&](unsigned int a, unsigned int b) {
+                return std::lexicographical_compare(
+                    position(a), position(a) + 3, position(b),
+                    position(b) + 3);
+              });
+    for (size_t i = 1; i < n; i++) {
+      if (std::equal(position(order[i]), position(order[i]) + 3,
+                     position(order[i - 1]))) {
+        locked_[order[i]] = locked_[order[i - 1]] = 1;
+      }
+    }
+  }
+
+  // False if moving c.src onto c.dst flips a triangle around c.src or
+  // turns it by more than about 80 degrees.
+  // Counts the triangles the collapse removes in `removed`.
+  bool collapseValid(const Collapse& c,
+                     const std::vector<unsigned int>& adjacencyStart,
+                     const std::vector<unsigned int>& adjacency,
+                     int* removed) const {
+    for (unsigned int j = adjacencyStart[c.src];
+         j < adjacencyStart[c.src + 1]; j++) {
+      const unsigned int* tri = &triangles_[3 * adjacency[j]];
+      if (tri[0] == c.dst || tri[1] == c.dst || tri[2] == c.dst) {
+        (*removed)++;
+        continue;
+      }
+      const float* p[3];
+      const float* q[3];
+      for (int k = 0; k < 3; k++) {
+        p[k] = position(tri[k]);
+        q[k] = tri[k] == c.src ? position(c.dst) : p[k];
+      }
+      double before[3], after[3];
+      normal(p[0], p[1], p[2], before);
+      normal(q[0], q[1], q[2], after);
+      double dot = before[0] * after[0] + before[1] * after[1] +
+                   before[2] * after[2];
+      double lengths =
+          sqrt((before[0] * before[0] + before[1] * before[1] +
+                before[2] * before[2]) *
+               (after[0] * after[0] + after[1] * after[1] +
+                after[2] * after[2]));
+      if (dot <= kMinNormalDot * lengths) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::vector<unsigned int> vertexIds_;  // local to vertex buffer index
+  std::vector<unsigned int> triangles_;  // local ids
+  std::vector<float> positions_;
+  std::vector<char> locked_;
+  std::vector<Quadric> quadrics_;
+  float maxError_;
+};
+}  // namespace
+
+void BuildLods(const std::vector<float>& vertices, size_t stride,
+               std::vector<unsigned int>* indices,
+               std::vector<DrawRange>* ranges) {
+  // levels[r][l]: indices of level l + 1 of range r.
+  std::vector<std::vector<std::vector<unsigned int> > > levels(
+      ranges->size());
+  ParallelFor(0, ranges->size(), 4, [&](size_t begin, size_t end) {
+    for (size_t r = begin; r < end; r++) {
+      DrawRange& range = (*ranges)[r];
+      range.num_lods = 0;
+      if (size_t(range.count) < 3 * kMinLodTriangles) {
+        continue;
+      }
+      Simplifier simplifier(vertices.data(), stride,
+                            &(*indices)[range.first], range.count);
+      size_t previous = range.count;
+      levels[r].resize(kMaxLods);
+      for (int l = 0; l < kMaxLods; l++) {
+        simplifier.collapseTo(previous / 6 * 3);
+        if (simplifier.indexCount() > kMinLodReduction * previous) {
+          break;
+        }
+        simplifier.output(&levels[r][l]);
+        range.lods[l].error = simplifier.error();
+        previous = simplifier.indexCount();
+        range.num_lods++;
+      }
+    }
+  });
+
+  for (int l = 0; l < kMaxLods; l++) {
+    for (size_t r = 0; r < ranges->size(); r++) {
+      DrawRange& range = (*ranges)[r];
+      if (l < range.num_lods) {
+        range.lods[l].first = indices->size();
+        range.lods[l].count = levels[r][l].size();
+        indices->insert(indices->end(), levels[r][l].begin(),
+                        levels[r][l].end());
+      }
+    }
+  }
+}
+
+int SelectLod(const LodParams& params, const DrawRange& range) {
+  if (range.num_lods == 0) {
+    return 0;
+  }
+  const float* m = params.modelview;
+  const float* c = range.center;
+  float eye[3];
+  for (int k = 0; k < 3; k++) {
+    eye[k] = m[k] * c[0] + m[4 + k] * c[1] + m[8 + k] * c[2] + m[12 + k];
+  }
+  float distance = sqrtf(eye[0] * eye[0] + eye[1] * eye[1] + eye[2] * eye[2]) -
+                   range.radius * params.scale;
+  if (distance <= 0.0f) {
+    return 0;
+  }
+  // Pixels covered by one model space unit at the range's nearest point.
+  float pixels = params.scale * params.pixelsPerUnit / distance;
+  int level = 0;
+  while (level < range.num_lods &&
+         range.lods[level].error * pixels <= params.maxPixelError) {
+    level++;
+  }
+  return level;
+}
@@ -0,0 +1,29 @@
+#include <vector>
+
+#include "drawobject.h"
+
+#ifndef LOD_H
+#define LOD_H
+
+// How far a DrawRange may be simplified this frame.
+typedef struct {
+  float modelview[16];  // column-major
+  float scale;          // eye space units per model unit, 1 / maxExtent
+  float pixelsPerUnit;  // pixels per eye space unit at distance 1
+  float maxPixelError;  // coarsest level whose error stays below this
+} LodParams;
+
+// Simplify every range of `ranges` into up to kMaxLods coarser levels with
+// about half the triangles each, and append their indices to `indices`
+// level by level. `vertices` holds `stride` floats per welded vertex, the
+// position first. Vertices on range borders and on normal or texture
+// coordinate seams never move, so neighbouring ranges stay watertight at
+// any mix of levels.
+void BuildLods(const std::vector<float>& vertices, size_t stride,
+               std::vector<unsigned int>* indices,
+               std::vector<DrawRange>* ranges);
+
+// Level of `range` to draw: 0 for the full detail, l for lods[l - 1].
+int SelectLod(const LodParams& params, const DrawRange& range);
+
+#endif
@@ -0,0 +1,76 @@
+#include "mappedfile.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::string& filename) {
+  close();
+#if defined(__unix__) || defined(__APPLE__)
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+  void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // The mapping stays valid after the descriptor is closed.
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  data_ = static_cast<unsigned char*>(p);
+  size_ = st.st_size;
+  mapped_ = true;
+  return true;
+#else
+  FILE* fp = fopen(filename.c_str(), "rb");
+  if (!fp) {
+    return false;
+  }
+  fseek(fp, 0, SEEK_END);
+  long len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if (len <= 0) {
+    fclose(fp);
+    return false;
+  }
+  data_ = static_cast<unsigned char*>(malloc(len));
+  if (fread(data_, 1, len, fp) != size_t(len)) {
+    free(data_);
+    data_ = NULL;
+    fclose(fp);
+    return false;
+  }
+  fclose(fp);
+  size_ = len;
+  mapped_ = false;
+  return true;
+#endif
+}
+
+void MappedFile::close() {
+  if (!data_) {
+    return;
+  }
+#if defined(__unix__) || defined(__APPLE__)
+  if (mapped_) {
+    munmap(data_, size_);
+  } else {
+    free(data_);
+  }
+#else
+  free(data_);
+#endif
+  data_ = NULL;
+  size_ = 0;
+  mapped_ = false;
+}
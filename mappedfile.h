@@ -0,0 +1,31 @@
+
+#include <cstddef>
+#include <string>
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+// Read-only view of a whole file. Uses mmap where available and falls back to
+// reading the file into memory elsewhere, so callers only see data()/size().
+class MappedFile {
+ public:
+  MappedFile() : data_(NULL), size_(0), mapped_(false) {}
+  ~MappedFile() { close(); }
+
+  bool open(const std::string& filename);
+  void close();
+
+  const unsigned char* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool isOpen() const { return data_ != NULL; }
+
+ private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  unsigned char* data_;
+  size_t size_;
+  bool mapped_;
+};
+
+#endif
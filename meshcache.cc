@@ -0,0 +1,601 @@
+#include "meshcache.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "profiler.h"
+
+namespace  // Local utility functions
+{
+const char kMagic[8] = {'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E'};
+const char kPageMagic[8] = {'O', 'B', 'J', 'P', 'A', 'G', 'E', 'S'};
+
+// Blobs are aligned so the mapped data can be used without copying.
+const size_t kBlobAlignment = 16;
+
+bool sourceStat(const std::string& filename, uint64_t* size, int64_t* mtime) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) {
+    return false;
+  }
+  *size = static_cast<uint64_t>(st.st_size);
+  *mtime = static_cast<int64_t>(st.st_mtime);
+  return true;
+}
+
+size_t alignUp(size_t n) {
+  return (n + kBlobAlignment - 1) & ~(kBlobAlignment - 1);
+}
+
+// Appends plain values to a byte vector.
+struct Writer {
+  std::vector<unsigned char> bytes;
+
+  void write(const void* p, size_t n) {
+    const unsigned char* c = static_cast<const unsigned char*>(p);
+    bytes.insert(bytes.end(), c, c + n);
+  }
+  template <typename T>
+  void put(const T& v) {
+    write(&v, sizeof(T));
+  }
+  void putString(const std::string& str) {
+    put(static_cast<uint32_t>(str.size()));
+    write(str.data(), str.size());
+  }
+};
+
+// Reads plain values back, failing instead of reading past the end.
+struct Reader {
+  const unsigned char* p;
+  const unsigned char* end;
+  bool ok;
+
+  bool read(void* dst, size_t n) {
+    if (!ok || size_t(end - p) < n) {
+      ok = false;
+      return false;
+    }
+    memcpy(dst, p, n);
+    p += n;
+    return true;
+  }
+  template <typename T>
+  T get() {
+    T v = T();
+    read(&v, sizeof(T));
+    return v;
+  }
+  std::string getString() {
+    uint32_t len = get<uint32_t>();
+    if (!ok || size_t(end - p) < len) {
+      ok = false;
+      return std::string();
+    }
+    std::string str(reinterpret_cast<const char*>(p), len);
+    p += len;
+    return str;
+  }
+};
+
+void writeMaterial(Writer& w, const tinyobj::material_t& m) {
+  w.putString(m.name);
+  w.write(m.ambient, sizeof(m.ambient));
+  w.write(m.diffuse, sizeof(m.diffuse));
+  w.write(m.specular, sizeof(m.specular));
+  w.write(m.transmittance, sizeof(m.transmittance));
+  w.write(m.emission, sizeof(m.emission));
+  w.put(m.shininess);
+  w.put(m.ior);
+  w.put(m.dissolve);
+  w.put(static_cast<int32_t>(m.illum));
+  w.putString(m.ambient_texname);
+  w.putString(m.diffuse_texname);
+  w.putString(m.specular_texname);
+  w.putString(m.specular_highlight_texname);
+  w.putString(m.bump_texname);
+  w.putString(m.displacement_texname);
+  w.putString(m.alpha_texname);
+}
+
+void readMaterial(Reader& r, tinyobj::material_t& m) {
+  m.name = r.getString();
+  r.read(m.ambient, sizeof(m.ambient));
+  r.read(m.diffuse, sizeof(m.diffuse));
+  r.read(m.specular, sizeof(m.specular));
+  r.read(m.transmittance, sizeof(m.transmittance));
+  r.read(m.emission, sizeof(m.emission));
+  m.shininess = r.get<tinyobj::real_t>();
+  m.ior = r.get<tinyobj::real_t>();
+  m.dissolve = r.get<tinyobj::real_t>();
+  m.illum = r.get<int32_t>();
+  m.ambient_texname = r.getString();
+  m.diffuse_texname = r.getString();
+  m.specular_texname = r.getString();
+  m.specular_highlight_texname = r.getString();
+  m.bump_texname = r.getString();
+  m.displacement_texname = r.getString();
+  m.alpha_texname = r.getString();
+}
+
+// Bytes writeMaterial() writes for a material with empty names.
+const size_t kMinMaterialBytes = 8 * sizeof(uint32_t) +
+                                 18 * sizeof(tinyobj::real_t) +
+                                 sizeof(int32_t);
+
+// Read the material list, checking its count against the bytes left before
+// allocating, so a corrupt count fails instead of exhausting memory.
+bool readMaterials(Reader& r, std::vector<tinyobj::material_t>* materials) {
+  uint32_t numMaterials = r.get<uint32_t>();
+  if (!r.ok || size_t(r.end - r.p) / kMinMaterialBytes < numMaterials) {
+    return false;
+  }
+  materials->resize(numMaterials);
+  for (size_t i = 0; r.ok && i < materials->size(); i++) {
+    readMaterial(r, (*materials)[i]);
+  }
+  return r.ok;
+}
+
+// Draw metadata of one DrawObject, without its GL names.
+void writeObject(Writer& w, const DrawObject& o) {
+  w.put(static_cast<uint32_t>(o.ranges.size()));
+  for (size_t j = 0; j < o.ranges.size(); j++) {
+    w.put(static_cast<uint64_t>(o.ranges[j].material_id));
+    w.put(static_cast<int32_t>(o.ranges[j].first));
+    w.put(static_cast<int32_t>(o.ranges[j].count));
+    w.put(static_cast<int32_t>(o.ranges[j].base_vertex));
+    w.write(o.ranges[j].bmin, 3 * sizeof(float));
+    w.write(o.ranges[j].bmax, 3 * sizeof(float));
+    w.write(o.ranges[j].center, 3 * sizeof(float));
+    w.put(o.ranges[j].radius);
+    w.put(static_cast<int32_t>(o.ranges[j].num_lods));
+    for (int l = 0; l < o.ranges[j].num_lods; l++) {
+      w.put(static_cast<int32_t>(o.ranges[j].lods[l].first));
+      w.put(static_cast<int32_t>(o.ranges[j].lods[l].count));
+      w.put(o.ranges[j].lods[l].error);
+    }
+  }
+  w.put(static_cast<uint32_t>(o.index_type));
+  w.put(static_cast<uint32_t>(o.vertex_format));
+  w.write(o.position_offset, 3 * sizeof(float));
+  w.write(o.position_scale, 3 * sizeof(float));
+  w.put(static_cast<int32_t>(o.numVertices));
+  w.put(static_cast<int32_t>(o.numTriangles));
+}
+
+bool readObject(Reader& r, DrawObject* o) {
+  o->vb_id = 0;
+  o->ib_id = 0;
+  o->vao_id = 0;
+  o->instance_vb_id = 0;
+  o->instances.clear();
+  o->ranges.clear();
+  uint32_t numRanges = r.get<uint32_t>();
+  for (uint32_t j = 0; r.ok && j < numRanges; j++) {
+    DrawRange range;
+    range.material_id = r.get<uint64_t>();
+    range.first = r.get<int32_t>();
+    range.count = r.get<int32_t>();
+    range.base_vertex = r.get<int32_t>();
+    r.read(range.bmin, 3 * sizeof(float));
+    r.read(range.bmax, 3 * sizeof(float));
+    r.read(range.center, 3 * sizeof(float));
+    range.radius = r.get<float>();
+    range.num_lods = r.get<int32_t>();
+    if (range.num_lods < 0 || range.num_lods > kMaxLods) {
+      return false;
+    }
+    for (int l = 0; l < range.num_lods; l++) {
+      range.lods[l].first = r.get<int32_t>();
+      range.lods[l].count = r.get<int32_t>();
+      range.lods[l].error = r.get<float>();
+    }
+    o->ranges.push_back(range);
+  }
+  o->index_type = r.get<uint32_t>();
+  o->vertex_format = static_cast<VertexFormat>(r.get<uint32_t>());
+  r.read(o->position_offset, 3 * sizeof(float));
+  r.read(o->position_scale, 3 * sizeof(float));
+  o->numVertices = r.get<int32_t>();
+  o->numTriangles = r.get<int32_t>();
+  return r.ok;
+}
+
+// Serialize everything but the vertex and index blobs. The header has the
+// same size for any offsets, so it is built once to measure and once for
+// real.
+void writeHeader(Writer& w, const std::string& source_filename,
+                 uint64_t source_size, int64_t source_mtime, bool merged,
+                 bool instanced, bool angleWeighted, bool baseVertex,
+                 const float bmin[3], const float bmax[3],
+                 const std::vector<float>& occluders,
+                 const std::vector<tinyobj::material_t>& materials,
+                 const std::vector<DrawObject>& drawObjects,
+                 const std::vector<ShapeBuffer>& shapeBuffers,
+                 size_t blobStart) {
+  w.write(kMagic, sizeof(kMagic));
+  w.put(static_cast<uint32_t>(kMeshCacheVersion));
+  w.putString(source_filename);
+  w.put(source_size);
+  w.put(source_mtime);
+  w.put(static_cast<uint32_t>(merged));
+  w.put(static_cast<uint32_t>(instanced));
+  w.put(static_cast<uint32_t>(angleWeighted));
+  w.put(static_cast<uint32_t>(baseVertex));
+  w.write(bmin, 3 * sizeof(float));
+  w.write(bmax, 3 * sizeof(float));
+  w.put(static_cast<uint32_t>(occluders.size()));
+  w.write(occluders.data(), occluders.size() * sizeof(float));
+
+  w.put(static_cast<uint32_t>(materials.size()));
+  for (size_t i = 0; i < materials.size(); i++) {
+    writeMaterial(w, materials[i]);
+  }
+
+  size_t offset = blobStart;
+  w.put(static_cast<uint32_t>(drawObjects.size()));
+  for (size_t i = 0; i < drawObjects.size(); i++) {
+    const DrawObject& o = drawObjects[i];
+    const ShapeBuffer& sb = shapeBuffers[i];
+    uint64_t vertexBytes = sb.vertices.size();
+    uint64_t indexBytes = sb.indices.size();
+    writeObject(w, o);
+    w.put(static_cast<uint32_t>(o.instances.size()));
+    w.write(o.instances.data(), o.instances.size() * sizeof(float));
+    w.put(static_cast<uint64_t>(offset));
+    w.put(vertexBytes);
+    offset = alignUp(offset + vertexBytes);
+    w.put(static_cast<uint64_t>(offset));
+    w.put(indexBytes);
+    offset = alignUp(offset + indexBytes);
+  }
+}
+
+}  // namespace
+
+std::string MeshCacheFilename(const std::string& filename) {
+  return filename + ".meshcache";
+}
+
+bool WriteMeshCache(const std::string& cache_filename,
+                    const std::string& source_filename, bool merged,
+                    bool instanced, bool angleWeighted, bool baseVertex,
+                    const float bmin[3], const float bmax[3],
+                    const std::vector<float>& occluders,
+                    const std::vector<tinyobj::material_t>& materials,
+                    const std::vector<DrawObject>& drawObjects,
+                    const std::vector<ShapeBuffer>& shapeBuffers) {
+  PROFILE_ZONE("write mesh cache");
+  uint64_t source_size;
+  int64_t source_mtime;
+  if (!sourceStat(source_filename, &source_size, &source_mtime)) {
+    return false;
+  }
+
+  Writer measure;
+  writeHeader(measure, source_filename, source_size, source_mtime, merged,
+              instanced, angleWeighted, baseVertex, bmin, bmax, occluders,
+              materials, drawObjects, shapeBuffers, 0);
+  size_t blobStart = alignUp(measure.bytes.size());
+  Writer header;
+  writeHeader(header, source_filename, source_size, source_mtime, merged,
+              instanced, angleWeighted, baseVertex, bmin, bmax, occluders,
+              materials, drawObjects, shapeBuffers, blobStart);
+
+  // Write to a temporary file first so an interrupted run never leaves a
+  // truncated cache behind.
+  std::string tmp_filename = cache_filename + ".tmp";
+  FILE* fp = fopen(tmp_filename.c_str(), "wb");
+  if (!fp) {
+    return false;
+  }
+  static const unsigned char zeros[kBlobAlignment] = {0};
+  bool ok = fwrite(header.bytes.data(), 1, header.bytes.size(), fp) ==
+            header.bytes.size();
+  size_t offset = header.bytes.size();
+  for (size_t i = 0; ok && i <= shapeBuffers.size(); i++) {
+    // Pad up to the next blob.
+    size_t pad = alignUp(offset) - offset;
+    ok = fwrite(zeros, 1, pad, fp) == pad;
+    offset += pad;
+    if (i == shapeBuffers.size()) {
+      break;
+    }
+    const ShapeBuffer& sb = shapeBuffers[i];
+    size_t vertexBytes = sb.vertices.size();
+    ok = ok && fwrite(sb.vertices.data(), 1, vertexBytes, fp) == vertexBytes;
+    offset += vertexBytes;
+    pad = alignUp(offset) - offset;
+    ok = ok && fwrite(zeros, 1, pad, fp) == pad;
+    offset += pad;
+    ok = ok && fwrite(sb.indices.data(), 1, sb.indices.size(), fp) ==
+                   sb.indices.size();
+    offset += sb.indices.size();
+  }
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok || rename(tmp_filename.c_str(), cache_filename.c_str()) != 0) {
+    remove(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ReadMeshCache(const MappedFile& cache, const std::string& source_filename,
+                   VertexFormat format, bool merged, bool instanced,
+                   bool angleWeighted, bool baseVertex, float bmin[3],
+                   float bmax[3], std::vector<float>* occluders,
+                   std::vector<DrawObject>* drawObjects,
+                   std::vector<tinyobj::material_t>& materials,
+                   std::vector<CachedShape>* shapes) {
+  PROFILE_ZONE("read mesh cache");
+  uint64_t source_size;
+  int64_t source_mtime;
+  if (!cache.isOpen() ||
+      !sourceStat(source_filename, &source_size, &source_mtime)) {
+    return false;
+  }
+
+  Reader r = {cache.data(), cache.data() + cache.size(), true};
+  char magic[sizeof(kMagic)];
+  if (!r.read(magic, sizeof(magic)) ||
+      memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      r.get<uint32_t>() != kMeshCacheVersion) {
+    return false;
+  }
+  // The cache is stale if the model was moved, edited or replaced.
+  if (r.getString() != source_filename || r.get<uint64_t>() != source_size ||
+      r.get<int64_t>() != source_mtime ||
+      r.get<uint32_t>() != static_cast<uint32_t>(merged) ||
+      r.get<uint32_t>() != static_cast<uint32_t>(instanced) ||
+      r.get<uint32_t>() != static_cast<uint32_t>(angleWeighted) ||
+      r.get<uint32_t>() != static_cast<uint32_t>(baseVertex) || !r.ok) {
+    return false;
+  }
+  r.read(bmin, 3 * sizeof(float));
+  r.read(bmax, 3 * sizeof(float));
+  uint32_t numOccluderFloats = r.get<uint32_t>();
+  if (!r.ok || size_t(r.end - r.p) < numOccluderFloats * sizeof(float)) {
+    return false;
+  }
+  std::vector<float> cachedOccluders(numOccluderFloats);
+  r.read(cachedOccluders.data(), numOccluderFloats * sizeof(float));
+
+  std::vector<tinyobj::material_t> cachedMaterials;
+  if (!readMaterials(r, &cachedMaterials)) {
+    return false;
+  }
+
+  std::vector<DrawObject> cachedObjects;
+  std::vector<CachedShape> cachedShapes;
+  uint32_t numShapes = r.get<uint32_t>();
+  for (uint32_t i = 0; r.ok && i < numShapes; i++) {
+    DrawObject o;
+    if (!readObject(r, &o)) {
+      return false;
+    }
+    uint32_t numInstanceFloats = r.get<uint32_t>();
+    if (!r.ok || numInstanceFloats % 16 != 0 ||
+        size_t(r.end - r.p) < numInstanceFloats * sizeof(float)) {
+      return false;
+    }
+    o.instances.resize(numInstanceFloats);
+    r.read(o.instances.data(), numInstanceFloats * sizeof(float));
+    uint64_t vertexOffset = r.get<uint64_t>();
+    uint64_t vertexBytes = r.get<uint64_t>();
+    uint64_t indexOffset = r.get<uint64_t>();
+    uint64_t indexBytes = r.get<uint64_t>();
+    // A cache written for another vertex format counts as stale.
+    if (o.vertex_format != format) {
+      return false;
+    }
+    if (vertexOffset + vertexBytes > cache.size() ||
+        indexOffset + indexBytes > cache.size()) {
+      return false;
+    }
+    CachedShape cs;
+    cs.vertices = cache.data() + vertexOffset;
+    cs.vertexBytes = vertexBytes;
+    cs.indices = cache.data() + indexOffset;
+    cs.indexBytes = indexBytes;
+    cachedObjects.push_back(o);
+    cachedShapes.push_back(cs);
+  }
+  if (!r.ok) {
+    return false;
+  }
+
+  occluders->swap(cachedOccluders);
+  materials.swap(cachedMaterials);
+  drawObjects->insert(drawObjects->end(), cachedObjects.begin(),
+                      cachedObjects.end());
+  shapes->swap(cachedShapes);
+  return true;
+}
+
+std::string PageFileFilename(const std::string& filename) {
+  return filename + ".pages";
+}
+
+PageFileWriter::~PageFileWriter() {
+  if (fp_) {
+    fclose(fp_);
+    remove((filename_ + ".tmp").c_str());
+  }
+}
+
+bool PageFileWriter::open(const std::string& filename) {
+  filename_ = filename;
+  fp_ = fopen((filename_ + ".tmp").c_str(), "wb");
+  if (!fp_) {
+    return false;
+  }
+  // The directory offset is filled in by finish().
+  Writer w;
+  w.write(kPageMagic, sizeof(kPageMagic));
+  w.put(static_cast<uint32_t>(kPageFileVersion));
+  w.put(static_cast<uint64_t>(0));
+  ok_ = fwrite(w.bytes.data(), 1, w.bytes.size(), fp_) == w.bytes.size();
+  offset_ = w.bytes.size();
+  return ok_;
+}
+
+bool PageFileWriter::writeBlob(const std::vector<unsigned char>& bytes) {
+  static const unsigned char zeros[kBlobAlignment] = {0};
+  size_t pad = alignUp(offset_) - offset_;
+  ok_ = ok_ && fwrite(zeros, 1, pad, fp_) == pad;
+  offset_ += pad;
+  blobs_.push_back(offset_);
+  blobs_.push_back(bytes.size());
+  ok_ = ok_ && fwrite(bytes.data(), 1, bytes.size(), fp_) == bytes.size();
+  offset_ += bytes.size();
+  return ok_;
+}
+
+bool PageFileWriter::addPage(const DrawObject& object,
+                             const ShapeBuffer& buffer) {
+  if (!fp_) {
+    return false;
+  }
+  objects_.push_back(object);
+  return writeBlob(buffer.vertices) && writeBlob(buffer.indices);
+}
+
+bool PageFileWriter::finish(const std::string& source_filename,
+                            bool angleWeighted, const float bmin[3],
+                            const float bmax[3],
+                            const std::vector<float>& occluders,
+                            const std::vector<tinyobj::material_t>& materials) {
+  uint64_t source_size;
+  int64_t source_mtime;
+  if (!fp_ || !ok_ ||
+      !sourceStat(source_filename, &source_size, &source_mtime)) {
+    return false;
+  }
+  Writer w;
+  w.putString(source_filename);
+  w.put(source_size);
+  w.put(source_mtime);
+  w.put(static_cast<uint32_t>(angleWeighted));
+  w.write(bmin, 3 * sizeof(float));
+  w.write(bmax, 3 * sizeof(float));
+  w.put(static_cast<uint32_t>(occluders.size()));
+  w.write(occluders.data(), occluders.size() * sizeof(float));
+  w.put(static_cast<uint32_t>(materials.size()));
+  for (size_t i = 0; i < materials.size(); i++) {
+    writeMaterial(w, materials[i]);
+  }
+  w.put(static_cast<uint32_t>(objects_.size()));
+  for (size_t i = 0; i < objects_.size(); i++) {
+    writeObject(w, objects_[i]);
+    w.write(&blobs_[4 * i], 4 * sizeof(uint64_t));
+  }
+
+  uint64_t directory = offset_;
+  bool ok = fwrite(w.bytes.data(), 1, w.bytes.size(), fp_) == w.bytes.size();
+  ok = ok && fseek(fp_, sizeof(kPageMagic) + sizeof(uint32_t), SEEK_SET) == 0;
+  ok = ok && fwrite(&directory, sizeof(directory), 1, fp_) == 1;
+  ok = (fclose(fp_) == 0) && ok;
+  fp_ = NULL;
+  std::string tmp_filename = filename_ + ".tmp";
+  if (!ok || rename(tmp_filename.c_str(), filename_.c_str()) != 0) {
+    remove(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ReadPageFile(const MappedFile& file, const std::string& source_filename,
+                  VertexFormat format, bool angleWeighted, float bmin[3],
+                  float bmax[3],
+                  std::vector<float>* occluders,
+                  std::vector<tinyobj::material_t>& materials,
+                  std::vector<Page>* pages) {
+  uint64_t source_size;
+  int64_t source_mtime;
+  if (!file.isOpen() ||
+      !sourceStat(source_filename, &source_size, &source_mtime)) {
+    return false;
+  }
+
+  Reader r = {file.data(), file.data() + file.size(), true};
+  char magic[sizeof(kPageMagic)];
+  if (!r.read(magic, sizeof(magic)) ||
+      memcmp(magic, kPageMagic, sizeof(kPageMagic)) != 0 ||
+      r.get<uint32_t>() != kPageFileVersion) {
+    return false;
+  }
+  uint64_t directory = r.get<uint64_t>();
+  if (!r.ok || directory >= file.size()) {
+    return false;
+  }
+  r.p = file.data() + directory;
+  if (r.getString() != source_filename || r.get<uint64_t>() != source_size ||
+      r.get<int64_t>() != source_mtime ||
+      r.get<uint32_t>() != static_cast<uint32_t>(angleWeighted) || !r.ok) {
+    return false;
+  }
+  r.read(bmin, 3 * sizeof(float));
+  r.read(bmax, 3 * sizeof(float));
+  uint32_t numOccluderFloats = r.get<uint32_t>();
+  if (!r.ok || size_t(r.end - r.p) < numOccluderFloats * sizeof(float)) {
+    return false;
+  }
+  std::vector<float> fileOccluders(numOccluderFloats);
+  r.read(fileOccluders.data(), numOccluderFloats * sizeof(float));
+
+  std::vector<tinyobj::material_t> fileMaterials;
+  if (!readMaterials(r, &fileMaterials)) {
+    return false;
+  }
+
+  std::vector<Page> filePages;
+  uint32_t numPages = r.get<uint32_t>();
+  for (uint32_t i = 0; r.ok && i < numPages; i++) {
+    Page page;
+    if (!readObject(r, &page.object) || page.object.vertex_format != format) {
+      return false;
+    }
+    uint64_t vertexOffset = r.get<uint64_t>();
+    uint64_t vertexBytes = r.get<uint64_t>();
+    uint64_t indexOffset = r.get<uint64_t>();
+    uint64_t indexBytes = r.get<uint64_t>();
+    if (vertexOffset + vertexBytes > file.size() ||
+        indexOffset + indexBytes > file.size()) {
+      return false;
+    }
+    page.data.vertices = file.data() + vertexOffset;
+    page.data.vertexBytes = vertexBytes;
+    page.data.indices = file.data() + indexOffset;
+    page.data.indexBytes = indexBytes;
+
+    // Bounding sphere around the boxes of the page's ranges.
+    float lo[3] = {1e30f, 1e30f, 1e30f}, hi[3] = {-1e30f, -1e30f, -1e30f};
+    for (size_t j = 0; j < page.object.ranges.size(); j++) {
+      for (int k = 0; k < 3; k++) {
+        lo[k] = std::min(lo[k], page.object.ranges[j].bmin[k]);
+        hi[k] = std::max(hi[k], page.object.ranges[j].bmax[k]);
+      }
+    }
+    float radius2 = 0.0f;
+    for (int k = 0; k < 3; k++) {
+      page.center[k] = 0.5f * (lo[k] + hi[k]);
+      radius2 += 0.25f * (hi[k] - lo[k]) * (hi[k] - lo[k]);
+    }
+    page.radius = sqrtf(radius2);
+    filePages.push_back(page);
+  }
+  if (!r.ok) {
+    return false;
+  }
+
+  occluders->swap(fileOccluders);
+  materials.swap(fileMaterials);
+  pages->swap(filePages);
+  return true;
+}
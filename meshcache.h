@@ -0,0 +1,120 @@
+#include <GL/glew.h>
+
+#include <tiny_obj_loader.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "drawobject.h"
+#include "mappedfile.h"
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+// Bump whenever the layout of the cache file or of the vertex data changes.
+const unsigned int kMeshCacheVersion = 11;
+
+// Same for the page files of paged models.
+const unsigned int kPageFileVersion = 2;
+
+// Geometry of one cached DrawObject. The pointers refer into the mapped cache
+// file and can be handed to glBufferData as is.
+typedef struct {
+  const void* vertices;
+  size_t vertexBytes;
+  const void* indices;
+  size_t indexBytes;
+} CachedShape;
+
+// Cache file that belongs to the model `filename`.
+std::string MeshCacheFilename(const std::string& filename);
+
+// Store the converted model next to `source_filename`. The cache is keyed by
+// the source path, size and modification time, and by the options that
+// change the converted data.
+bool WriteMeshCache(const std::string& cache_filename,
+                    const std::string& source_filename, bool merged,
+                    bool instanced, bool angleWeighted, bool baseVertex,
+                    const float bmin[3], const float bmax[3],
+                    const std::vector<float>& occluders,
+                    const std::vector<tinyobj::material_t>& materials,
+                    const std::vector<DrawObject>& drawObjects,
+                    const std::vector<ShapeBuffer>& shapeBuffers);
+
+// Restore a model from a mapped cache file. Fails if the cache is from a
+// different version, holds vertices in another `format`, was not `merged`
+// or `instanced` the same way, has normals weighted another way (see
+// g_angle_weighted_normals), was converted for a driver with or without
+// `baseVertex` support (see g_base_vertex) or no longer matches
+// `source_filename`. The restored objects are appended to `drawObjects`
+// without GL buffers; `shapes` points into `cache`, which has to stay open
+// until the data is uploaded.
+bool ReadMeshCache(const MappedFile& cache, const std::string& source_filename,
+                   VertexFormat format, bool merged, bool instanced,
+                   bool angleWeighted, bool baseVertex, float bmin[3],
+                   float bmax[3], std::vector<float>* occluders,
+                   std::vector<DrawObject>* drawObjects,
+                   std::vector<tinyobj::material_t>& materials,
+                   std::vector<CachedShape>* shapes);
+
+// A spatial page of a paged model: neighbouring ranges of one spatial bin
+// with their own vertices and 16-bit indices.
+typedef struct {
+  DrawObject object;  // without GL buffers until the page is resident
+  CachedShape data;   // points into the mapped page file
+  float center[3];    // bounding sphere, model space
+  float radius;
+} Page;
+
+// Page file that belongs to the model `filename`.
+std::string PageFileFilename(const std::string& filename);
+
+// Writes a page file one page at a time, so the converted model never has
+// to be in memory as a whole. The directory follows the pages.
+class PageFileWriter {
+ public:
+  PageFileWriter() : fp_(NULL), offset_(0), ok_(false) {}
+  ~PageFileWriter();
+
+  bool open(const std::string& filename);
+
+  // Append the geometry of one page. Its ranges index `buffer` with base
+  // vertex 0.
+  bool addPage(const DrawObject& object, const ShapeBuffer& buffer);
+
+  // Write the directory and move the file in place. Without a successful
+  // finish() the file is removed again.
+  bool finish(const std::string& source_filename, bool angleWeighted,
+              const float bmin[3], const float bmax[3],
+              const std::vector<float>& occluders,
+              const std::vector<tinyobj::material_t>& materials);
+
+  size_t numPages() const { return objects_.size(); }
+
+ private:
+  PageFileWriter(const PageFileWriter&);
+  PageFileWriter& operator=(const PageFileWriter&);
+
+  bool writeBlob(const std::vector<unsigned char>& bytes);
+
+  FILE* fp_;
+  std::string filename_;
+  uint64_t offset_;
+  bool ok_;
+  std::vector<DrawObject> objects_;
+  std::vector<uint64_t> blobs_;  // offset and size of each blob
+};
+
+// Read the directory of a mapped page file. Fails like ReadMeshCache if the
+// file is stale, holds another vertex `format` or normals not
+// `angleWeighted` the same way.
+bool ReadPageFile(const MappedFile& file, const std::string& source_filename,
+                  VertexFormat format, bool angleWeighted, float bmin[3],
+                  float bmax[3],
+                  std::vector<float>* occluders,
+                  std::vector<tinyobj::material_t>& materials,
+                  std::vector<Page>* pages);
+
+#endif
@@ -0,0 +1,199 @@
+#include "normals.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "parallel.h"
+
+namespace  // Local utility functions
+{
+// Faces per SoA block. Small enough for the block to stay in L1.
+const size_t kBlockSize = 256;
+const size_t kFaceGrain = 16 * kBlockSize;
+const size_t kVertexGrain = 16384;
+
+// Weighted face normal of every triangle corner, in SoA form.
+void computeCornerNormals(const std::vector<tinyobj::real_t>& positions,
+                          const std::vector<tinyobj::index_t>& indices,
+                          size_t begin, size_t end, NormalWeighting weighting,
+                          float* cx, float* cy, float* cz) {
+  float px[3][kBlockSize], py[3][kBlockSize], pz[3][kBlockSize];
+  float nx[kBlockSize], ny[kBlockSize], nz[kBlockSize];
+  float w[3][kBlockSize];
+
+  for (size_t f0 = begin; f0 < end; f0 += kBlockSize) {
+    size_t n = std::min(kBlockSize, end - f0);
+
+    // Gather the corner positions of the block.
+    for (size_t i = 0; i < n; i++) {
+      for (int k = 0; k < 3; k++) {
+        const tinyobj::real_t* p =
+            &positions[3 * indices[3 * (f0 + i) + k].vertex_index];
+        px[k][i] = p[0];
+        py[k][i] = p[1];
+        pz[k][i] = p[2];
+      }
+    }
+
+    // cross(p1 - p0, p2 - p0). Plain loops over the SoA arrays so the
+    // compiler vectorizes them.
+    for (size_t i = 0; i < n; i++) {
+      float e1x = px[1][i] - px[0][i], e1y = py[1][i] - py[0][i],
+            e1z = pz[1][i] - pz[0][i];
+      float e2x = px[2][i] - px[0][i], e2y = py[2][i] - py[0][i],
+            e2z = pz[2][i] - pz[0][i];
+      nx[i] = e1y * e2z - e1z * e2y;
+      ny[i] = e1z * e2x - e1x * e2z;
+      nz[i] = e1x * e2y - e1y * e2x;
+    }
+
+    if (weighting == kWeightArea) {
+      for (int k = 0; k < 3; k++) {
+        for (size_t i = 0; i < n; i++) {
+          w[k][i] = 1.0f;
+        }
+      }
+    } else {
+      // Unit face normals; the angle weights are applied on top.
+      for (size_t i = 0; i < n; i++) {
+        float len2 = nx[i] * nx[i] + ny[i] * ny[i] + nz[i] * nz[i];
+        float inv = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+        nx[i] *= inv;
+        ny[i] *= inv;
+        nz[i] *= inv;
+      }
+      for (int k = 0; k < 3; k++) {
+        int a = (k + 1) % 3, b = (k + 2) % 3;
+        for (size_t i = 0; i < n; i++) {
+          if (weighting == kWeightUniform) {
+            w[k][i] = 1.0f;
+            continue;
+          }
+          float ax = px[a][i] - px[k][i], ay = py[a][i] - py[k][i],
+                az = pz[a][i] - pz[k][i];
+          float bx = px[b][i] - px[k][i], by = py[b][i] - py[k][i],
+                bz = pz[b][i] - pz[k][i];
+          float la = ax * ax + ay * ay + az * az;
+          float lb = bx * bx + by * by + bz * bz;
+          float d = la > 0.0f && lb > 0.0f
+                        ? (ax * bx + ay * by + az * bz) / sqrtf(la * lb)
+                        : 1.0f;
+          w[k][i] = acosf(std::max(-1.0f, std::min(1.0f, d)));
+        }
+      }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      for (int k = 0; k < 3; k++) {
+        size_t c = 3 * (f0 + i) + k;
+        cx[c] = nx[i] * w[k][i];
+        cy[c] = ny[i] * w[k][i];
+        cz[c] = nz[i] * w[k][i];
+      }
+    }
+  }
+}
+
+// Group corners by their key. `order` lists the corners sorted by key and
+// `runs` the start of each distinct key within `order`.
+void groupCorners(const std::vector<int>& keys, std::vector<uint32_t>& order,
+                  std::vector<uint32_t>& runs) {
+  size_t n = keys.size();
+  int lo = *std::min_element(keys.begin(), keys.end());
+  int hi = *std::max_element(keys.begin(), keys.end());
+  size_t range = size_t(hi - lo) + 1;
+  order.resize(n);
+  runs.clear();
+
+  if (range <= 2 * n) {
+    // Dense keys: counting sort.
+    std::vector<uint32_t> start(range + 1, 0);
+    for (size_t c = 0; c < n; c++) {
+      start[keys[c] - lo + 1]++;
+    }
+    for (size_t k = 0; k < range; k++) {
+      if (start[k + 1] > 0) {
+        runs.push_back(start[k]);
+      }
+      start[k + 1] += start[k];
+    }
+    for (size_t c = 0; c < n; c++) {
+      order[start[keys[c] - lo]++] = static_cast<uint32_t>(c);
+    }
+    return;
+  }
+
+  // Sparse keys: sort (key, corner) pairs.
+  std::vector<uint64_t> pairs(n);
+  for (size_t c = 0; c < n; c++) {
+    pairs[c] = (uint64_t(uint32_t(keys[c] - lo)) << 32) | c;
+  }
+  std::sort(pairs.begin(), pairs.end());
+  for (size_t i = 0; i < n; i++) {
+    order[i] = static_cast<uint32_t>(pairs[i]);
+    if (i == 0 || (pairs[i] >> 32) != (pairs[i - 1] >> 32)) {
+      runs.push_back(static_cast<uint32_t>(i));
+    }
+  }
+}
+
+}  // namespace
+
+void ComputeVertexNormals(const std::vector<tinyobj::real_t>& positions,
+                          const std::vector<tinyobj::index_t>& indices,
+                          bool byNormalIndex, NormalWeighting weighting,
+                          VertexNormals* out) {
+  size_t numFaces = indices.size() / 3;
+  size_t numCorners = 3 * numFaces;
+  out->corner.assign(numCorners, -1);
+  out->target.clear();
+  out->x.clear();
+  out->y.clear();
+  out->z.clear();
+  if (numFaces == 0) {
+    return;
+  }
+
+  std::vector<float> cx(numCorners), cy(numCorners), cz(numCorners);
+  ParallelFor(0, numFaces, kFaceGrain, [&](size_t b, size_t e) {
+    computeCornerNormals(positions, indices, b, e, weighting, cx.data(),
+                         cy.data(), cz.data());
+  });
+
+  std::vector<int> keys(numCorners);
+  for (size_t c = 0; c < numCorners; c++) {
+    keys[c] = byNormalIndex ? indices[c].normal_index
+                            : indices[c].vertex_index;
+  }
+  std::vector<uint32_t> order, runs;
+  groupCorners(keys, order, runs);
+
+  // Each entry owns a contiguous run of corners, so entries can be summed
+  // and normalized in parallel without any synchronization.
+  size_t numEntries = runs.size();
+  out->target.resize(numEntries);
+  out->x.resize(numEntries);
+  out->y.resize(numEntries);
+  out->z.resize(numEntries);
+  ParallelFor(0, numEntries, kVertexGrain, [&](size_t b, size_t e) {
+    for (size_t v = b; v < e; v++) {
+      size_t r0 = runs[v];
+      size_t r1 = (v + 1 < numEntries) ? runs[v + 1] : numCorners;
+      float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+      for (size_t r = r0; r < r1; r++) {
+        uint32_t c = order[r];
+        sx += cx[c];
+        sy += cy[c];
+        sz += cz[c];
+        out->corner[c] = static_cast<int>(v);
+      }
+      float len2 = sx * sx + sy * sy + sz * sz;
+      float inv = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+      out->target[v] = keys[order[r0]];
+      out->x[v] = sx * inv;
+      out->y[v] = sy * inv;
+      out->z[v] = sz * inv;
+    }
+  });
+}
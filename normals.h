@@ -0,0 +1,34 @@
+#include <tiny_obj_loader.h>
+
+#include <vector>
+
+#ifndef NORMALS_H
+#define NORMALS_H
+
+// How face normals are weighted when they are summed into a vertex normal.
+enum NormalWeighting {
+  kWeightUniform,  // every face counts the same
+  kWeightArea,     // faces count with their area
+  kWeightAngle     // faces count with their corner angle at the vertex
+};
+
+// Smooth normals of a set of triangles, stored as flat SoA arrays. Every
+// distinct vertex the triangles accumulate into has one entry, and every
+// triangle corner knows its entry, so no lookups are needed afterwards.
+typedef struct {
+  std::vector<int> corner;  // entry of each triangle corner
+  std::vector<int> target;  // vertex (or normal) index of each entry
+  std::vector<float> x, y, z;
+} VertexNormals;
+
+// Sum the face normals of the triangles in `indices` per vertex and
+// normalize them. Positions come from `vertex_index`; normals accumulate per
+// `normal_index` if `byNormalIndex` is set and per `vertex_index` otherwise.
+// Face normals are computed on blocks of faces in SoA form, and both the
+// face and the per-vertex passes run on the worker pool without atomics.
+void ComputeVertexNormals(const std::vector<tinyobj::real_t>& positions,
+                          const std::vector<tinyobj::index_t>& indices,
+                          bool byNormalIndex, NormalWeighting weighting,
+                          VertexNormals* out);
+
+#endif
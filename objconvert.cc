@@ -0,0 +1,453 @@
+#include "objconvert.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+
+#include "global.h"
+#include "parallel.h"
+#include "profiler.h"
+
+namespace  // Local utility functions
+{
+// Append a shape made of the faces [idbegin, idend) of `sortedids`, which
+// share one smoothing group, to `outshapes`.
+void computeSmoothingShape(
+    tinyobj::attrib_t& inattrib, tinyobj::shape_t& inshape,
+    std::vector<std::pair<unsigned int, unsigned int> >& sortedids,
+    unsigned int idbegin, unsigned int idend,
+    std::vector<tinyobj::shape_t>& outshapes, tinyobj::attrib_t& outattrib) {
+  unsigned int sgroupid = sortedids[idbegin].first;
+  bool hasmaterials = inshape.mesh.material_ids.size();
+  // Make a new shape from the set of faces in the range [idbegin, idend).
+  outshapes.emplace_back();
+  tinyobj::shape_t& outshape = outshapes.back();
+  outshape.name = inshape.name;
+  // Skip lines and points.
+
+  std::unordered_map<unsigned int, unsigned int> remap;
+  for (unsigned int id = idbegin; id < idend; ++id) {
+    unsigned int face = sortedids[id].second;
+
+    outshape.mesh.num_face_vertices.push_back(3);  // always triangles
+    if (hasmaterials)
+      outshape.mesh.material_ids.push_back(inshape.mesh.material_ids[face]);
+    outshape.mesh.smoothing_group_ids.push_back(sgroupid);
+    // Skip tags.
+
+    for (unsigned int v = 0; v < 3; ++v) {
+      tinyobj::index_t inidx = inshape.mesh.indices[3 * face + v], outidx;
+      assert(inidx.vertex_index != -1);
+      auto iter = remap.find(inidx.vertex_index);
+      // Smooth group 0 disables smoothing so no shared vertices in that case.
+      if (sgroupid && iter != remap.end()) {
+        outidx.vertex_index = (*iter).second;
+        outidx.normal_index = outidx.vertex_index;
+        outidx.texcoord_index =
+            (inidx.texcoord_index == -1) ? -1 : outidx.vertex_index;
+      } else {
+        assert(outattrib.vertices.size() % 3 == 0);
+        unsigned int offset =
+            static_cast<unsigned int>(outattrib.vertices.size() / 3);
+        outidx.vertex_index = outidx.normal_index = offset;
+        outidx.texcoord_index = (inidx.texcoord_index == -1) ? -1 : offset;
+        outattrib.vertices.push_back(inattrib.vertices[3 * inidx.vertex_index]);
+        outattrib.vertices.push_back(
+            inattrib.vertices[3 * inidx.vertex_index + 1]);
+        outattrib.vertices.push_back(
+            inattrib.vertices[3 * inidx.vertex_index + 2]);
+        outattrib.normals.push_back(0.0f);
+        outattrib.normals.push_back(0.0f);
+        outattrib.normals.push_back(0.0f);
+        if (inidx.texcoord_index != -1) {
+          outattrib.texcoords.push_back(
+              inattrib.texcoords[2 * inidx.texcoord_index]);
+          outattrib.texcoords.push_back(
+              inattrib.texcoords[2 * inidx.texcoord_index + 1]);
+        }
+        remap[inidx.vertex_index] = offset;
+      }
+      outshape.mesh.indices.push_back(outidx);
+    }
+  }
+}
+}  // namespace
+
+void CalcNormal(float N[3], float v0[3], float v1[3], float v2[3]) {
+  float v10[3];
+  v10[0] = v1[0] - v0[0];
+  v10[1] = v1[1] - v0[1];
+  v10[2] = v1[2] - v0[2];
+
+  float v20[3];
+  v20[0] = v2[0] - v0[0];
+  v20[1] = v2[1] - v0[1];
+  v20[2] = v2[2] - v0[2];
+
+  N[0] = v10[1] * v20[2] - v10[2] * v20[1];
+  N[1] = v10[2] * v20[0] - v10[0] * v20[2];
+  N[2] = v10[0] * v20[1] - v10[1] * v20[0];
+
+  float len2 = N[0] * N[0] + N[1] * N[1] + N[2] * N[2];
+  if (len2 > 0.0f) {
+    float len = sqrtf(len2);
+
+    N[0] /= len;
+    N[1] /= len;
+    N[2] /= len;
+  }
+}
+
+bool HasSmoothingGroup(const tinyobj::shape_t& shape) {
+  for (size_t i = 0; i < shape.mesh.smoothing_group_ids.size(); i++) {
+    if (shape.mesh.smoothing_group_ids[i] > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ComputeSmoothingNormals(const tinyobj::attrib_t& attrib,
+                             const tinyobj::shape_t& shape,
+                             VertexNormals& smoothNormals) {
+  PROFILE_ZONE("smoothing normals");
+  ComputeVertexNormals(attrib.vertices, shape.mesh.indices, false,
+                       g_angle_weighted_normals ? kWeightAngle
+                                                : kWeightUniform,
+                       &smoothNormals);
+}  // ComputeSmoothingNormals
+
+void ComputeAllSmoothingNormals(tinyobj::attrib_t& attrib,
+                                std::vector<tinyobj::shape_t>& shapes) {
+  // ComputeSmoothingShapes gives every shape its own vertices and normals,
+  // so the shapes can be processed in parallel.
+  ParallelFor(0, shapes.size(), 1, [&](size_t begin, size_t end) {
+    PROFILE_ZONE("smoothing normals");
+    VertexNormals vn;
+    for (size_t s = begin; s < end; ++s) {
+      const tinyobj::shape_t& shape(shapes[s]);
+      assert(shape.mesh.smoothing_group_ids.size());
+      ComputeVertexNormals(attrib.vertices, shape.mesh.indices, true,
+                           g_angle_weighted_normals ? kWeightAngle
+                                                    : kWeightArea,
+                           &vn);
+      for (size_t i = 0; i < vn.target.size(); ++i) {
+        attrib.normals[3 * vn.target[i]] = vn.x[i];
+        attrib.normals[3 * vn.target[i] + 1] = vn.y[i];
+        attrib.normals[3 * vn.target[i] + 2] = vn.z[i];
+      }
+    }
+  });
+}
+
+void ComputeSmoothingShapes(tinyobj::attrib_t& inattrib,
+                            std::vector<tinyobj::shape_t>& inshapes,
+                            std::vector<tinyobj::shape_t>& outshapes,
+                            tinyobj::attrib_t& outattrib) {
+  PROFILE_ZONE("smoothing shapes");
+  for (size_t s = 0, slen = inshapes.size(); s < slen; ++s) {
+    tinyobj::shape_t& inshape = inshapes[s];
+
+    unsigned int numfaces =
+        static_cast<unsigned int>(inshape.mesh.smoothing_group_ids.size());
+    assert(numfaces);
+    std::vector<std::pair<unsigned int, unsigned int> > sortedids(numfaces);
+    for (unsigned int i = 0; i < numfaces; ++i)
+      sortedids[i] = std::make_pair(inshape.mesh.smoothing_group_ids[i], i);
+    sort(sortedids.begin(), sortedids.end());
+
+    unsigned int activeid = sortedids[0].first;
+    unsigned int id = activeid, idbegin = 0, idend = 0;
+    // Faces are now bundled by smoothing group id, create shapes from these.
+    while (idbegin < numfaces) {
+      while (activeid == id && ++idend < numfaces) id = sortedids[idend].first;
+      computeSmoothingShape(inattrib, inshape, sortedids, idbegin, idend,
+                            outshapes, outattrib);
+      activeid = id;
+      idbegin = idend;
+    }
+  }
+}
+
+void BakeSmoothingNormals(tinyobj::attrib_t& attrib, tinyobj::shape_t& shape,
+                          bool regenerate) {
+  PROFILE_ZONE("smoothing normals");
+  std::vector<tinyobj::index_t>& indices = shape.mesh.indices;
+  size_t numFaces = indices.size() / 3;
+  int base = static_cast<int>(attrib.normals.size() / 3);
+  VertexNormals vn;
+  if (!regenerate) {
+    ComputeSmoothingNormals(attrib, shape, vn);
+    for (size_t e = 0; e < vn.target.size(); e++) {
+      attrib.normals.push_back(vn.x[e]);
+      attrib.normals.push_back(vn.y[e]);
+      attrib.normals.push_back(vn.z[e]);
+    }
+    for (size_t f = 0; f < numFaces; f++) {
+      tinyobj::index_t* idx = &indices[3 * f];
+      if (idx[0].normal_index < 0 || idx[1].normal_index < 0 ||
+          idx[2].normal_index < 0) {
+        for (int k = 0; k < 3; k++) {
+          idx[k].normal_index = base + vn.corner[3 * f + k];
+        }
+      }
+    }
+    return;
+  }
+
+  // One normal per vertex and smoothing group. Faces without a group share
+  // none of theirs.
+  std::vector<tinyobj::index_t> keyed(indices);
+  std::unordered_map<uint64_t, int> keys;
+  int numKeys = 0;
+  for (size_t f = 0; f < numFaces; f++) {
+    uint64_t sgroupid = shape.mesh.smoothing_group_ids[f];
+    for (int k = 0; k < 3; k++) {
+      tinyobj::index_t& idx = keyed[3 * f + k];
+      if (sgroupid == 0) {
+        idx.normal_index = numKeys++;
+        continue;
+      }
+      uint64_t key = (sgroupid << 32) | uint32_t(idx.vertex_index);
+      auto result = keys.insert(std::make_pair(key, numKeys));
+      if (result.second) {
+        numKeys++;
+      }
+      idx.normal_index = result.first->second;
+    }
+  }
+  ComputeVertexNormals(attrib.vertices, keyed, true,
+                       g_angle_weighted_normals ? kWeightAngle : kWeightArea,
+                       &vn);
+  attrib.normals.resize(3 * (base + numKeys));
+  for (size_t e = 0; e < vn.target.size(); e++) {
+    attrib.normals[3 * (base + vn.target[e])] = vn.x[e];
+    attrib.normals[3 * (base + vn.target[e]) + 1] = vn.y[e];
+    attrib.normals[3 * (base + vn.target[e]) + 2] = vn.z[e];
+  }
+  for (size_t c = 0; c < indices.size(); c++) {
+    indices[c].normal_index = base + keyed[c].normal_index;
+  }
+}
+
+int FaceMaterial(const tinyobj::shape_t& shape, size_t f,
+                 size_t numMaterials) {
+  int current_material_id =
+      f < shape.mesh.material_ids.size() ? shape.mesh.material_ids[f] : -1;
+
+  if ((current_material_id < 0) ||
+      (current_material_id >= static_cast<int>(numMaterials))) {
+    // Invaid material ID. Use default material.
+    current_material_id =
+        numMaterials -
+        1;  // Default material is added to the last item in `materials`.
+  }
+  return current_material_id;
+}
+
+void SortFacesByMaterial(const tinyobj::shape_t& shape, size_t numMaterials,
+                         std::vector<unsigned int>* faceOrder,
+                         std::vector<DrawRange>* ranges) {
+  size_t numFaces = shape.mesh.indices.size() / 3;
+  std::vector<int> faceMaterials(numFaces);
+  std::vector<size_t> start(numMaterials + 1, 0);
+  for (size_t f = 0; f < numFaces; f++) {
+    faceMaterials[f] = FaceMaterial(shape, f, numMaterials);
+    start[faceMaterials[f] + 1]++;
+  }
+  ranges->clear();
+  for (size_t m = 0; m < numMaterials; m++) {
+    if (start[m + 1] > 0) {
+      DrawRange r;
+      r.material_id = m;
+      r.first = 3 * start[m];
+      r.count = 3 * start[m + 1];
+      r.base_vertex = 0;
+      r.num_lods = 0;
+      ranges->push_back(r);
+    }
+    start[m + 1] += start[m];
+  }
+  faceOrder->resize(numFaces);
+  for (size_t f = 0; f < numFaces; f++) {
+    (*faceOrder)[start[faceMaterials[f]]++] = f;
+  }
+}
+
+void RangeBounds(const std::vector<float>& buffer, DrawRange* r) {
+  Bounds b;
+  const float* begin = &buffer[r->first * kVertexStride];
+  const float* end = begin + r->count * kVertexStride;
+  for (const float* v = begin; v < end; v += kVertexStride) {
+    for (int k = 0; k < 3; k++) {
+      b.bmin[k] = std::min(b.bmin[k], v[k]);
+      b.bmax[k] = std::max(b.bmax[k], v[k]);
+    }
+  }
+  float radius2 = 0.0f;
+  for (int k = 0; k < 3; k++) {
+    r->bmin[k] = b.bmin[k];
+    r->bmax[k] = b.bmax[k];
+    r->center[k] = 0.5f * (b.bmin[k] + b.bmax[k]);
+  }
+  for (const float* v = begin; v < end; v += kVertexStride) {
+    float d[3] = {v[0] - r->center[0], v[1] - r->center[1],
+                  v[2] - r->center[2]};
+    radius2 = std::max(radius2, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+  }
+  r->radius = sqrtf(radius2);
+}
+
+void ConvertFaces(const tinyobj::attrib_t& attrib,
+                  const tinyobj::shape_t& shape,
+                  const std::vector<tinyobj::material_t>& materials,
+                  const VertexNormals& smoothNormals,
+                  const std::vector<unsigned int>& faceOrder, size_t begin,
+                  size_t end, float* buffer, Bounds* bounds) {
+  PROFILE_ZONE("assemble buffer");
+  float* out = buffer + begin * 3 * kVertexStride;
+  for (size_t p = begin; p < end; p++) {
+    size_t f = faceOrder[p];
+    tinyobj::index_t idx0 = shape.mesh.indices[3 * f + 0];
+    tinyobj::index_t idx1 = shape.mesh.indices[3 * f + 1];
+    tinyobj::index_t idx2 = shape.mesh.indices[3 * f + 2];
+
+    int current_material_id = FaceMaterial(shape, f, materials.size());
+    float diffuse[3];
+    for (size_t i = 0; i < 3; i++) {
+      diffuse[i] = materials[current_material_id].diffuse[i];
+    }
+    float tc[3][2];
+    if (attrib.texcoords.size() > 0) {
+      if ((idx0.texcoord_index < 0) || (idx1.texcoord_index < 0) ||
+          (idx2.texcoord_index < 0)) {
+        // face does not contain valid uv index.
+        tc[0][0] = 0.0f;
+        tc[0][1] = 0.0f;
+        tc[1][0] = 0.0f;
+        tc[1][1] = 0.0f;
+        tc[2][0] = 0.0f;
+        tc[2][1] = 0.0f;
+      } else {
+        assert(attrib.texcoords.size() > size_t(2 * idx0.texcoord_index + 1));
+        assert(attrib.texcoords.size() > size_t(2 * idx1.texcoord_index + 1));
+        assert(attrib.texcoords.size() > size_t(2 * idx2.texcoord_index + 1));
+
+        // Flip Y coord.
+        tc[0][0] = attrib.texcoords[2 * idx0.texcoord_index];
+        tc[0][1] = 1.0f - attrib.texcoords[2 * idx0.texcoord_index + 1];
+        tc[1][0] = attrib.texcoords[2 * idx1.texcoord_index];
+        tc[1][1] = 1.0f - attrib.texcoords[2 * idx1.texcoord_index + 1];
+        tc[2][0] = attrib.texcoords[2 * idx2.texcoord_index];
+        tc[2][1] = 1.0f - attrib.texcoords[2 * idx2.texcoord_index + 1];
+      }
+    } else {
+      tc[0][0] = 0.0f;
+      tc[0][1] = 0.0f;
+      tc[1][0] = 0.0f;
+      tc[1][1] = 0.0f;
+      tc[2][0] = 0.0f;
+      tc[2][1] = 0.0f;
+    }
+
+    float v[3][3];
+    for (int k = 0; k < 3; k++) {
+      int f0 = idx0.vertex_index;
+      int f1 = idx1.vertex_index;
+      int f2 = idx2.vertex_index;
+      assert(f0 >= 0);
+      assert(f1 >= 0);
+      assert(f2 >= 0);
+
+      v[0][k] = attrib.vertices[3 * f0 + k];
+      v[1][k] = attrib.vertices[3 * f1 + k];
+      v[2][k] = attrib.vertices[3 * f2 + k];
+      bounds->bmin[k] = std::min(v[0][k], bounds->bmin[k]);
+      bounds->bmin[k] = std::min(v[1][k], bounds->bmin[k]);
+      bounds->bmin[k] = std::min(v[2][k], bounds->bmin[k]);
+      bounds->bmax[k] = std::max(v[0][k], bounds->bmax[k]);
+      bounds->bmax[k] = std::max(v[1][k], bounds->bmax[k]);
+      bounds->bmax[k] = std::max(v[2][k], bounds->bmax[k]);
+    }
+
+    float n[3][3];
+    {
+      bool invalid_normal_index = false;
+      if (attrib.normals.size() > 0) {
+        int nf0 = idx0.normal_index;
+        int nf1 = idx1.normal_index;
+        int nf2 = idx2.normal_index;
+
+        if ((nf0 < 0) || (nf1 < 0) || (nf2 < 0)) {
+          // normal index is missing from this face.
+          invalid_normal_index = true;
+        } else {
+          for (int k = 0; k < 3; k++) {
+            assert(size_t(3 * nf0 + k) < attrib.normals.size());
+            assert(size_t(3 * nf1 + k) < attrib.normals.size());
+            assert(size_t(3 * nf2 + k) < attrib.normals.size());
+            n[0][k] = attrib.normals[3 * nf0 + k];
+            n[1][k] = attrib.normals[3 * nf1 + k];
+            n[2][k] = attrib.normals[3 * nf2 + k];
+          }
+        }
+      } else {
+        invalid_normal_index = true;
+      }
+
+      if (invalid_normal_index && !smoothNormals.corner.empty()) {
+        // Use smoothing normals
+        for (int k = 0; k < 3; k++) {
+          int e = smoothNormals.corner[3 * f + k];
+          n[k][0] = smoothNormals.x[e];
+          n[k][1] = smoothNormals.y[e];
+          n[k][2] = smoothNormals.z[e];
+        }
+        invalid_normal_index = false;
+      }
+
+      if (invalid_normal_index) {
+        // compute geometric normal
+        CalcNormal(n[0], v[0], v[1], v[2]);
+        n[1][0] = n[0][0];
+        n[1][1] = n[0][1];
+        n[1][2] = n[0][2];
+        n[2][0] = n[0][0];
+        n[2][1] = n[0][1];
+        n[2][2] = n[0][2];
+      }
+    }
+
+    for (int k = 0; k < 3; k++) {
+      *out++ = v[k][0];
+      *out++ = v[k][1];
+      *out++ = v[k][2];
+      *out++ = n[k][0];
+      *out++ = n[k][1];
+      *out++ = n[k][2];
+      // Combine normal and diffuse to get color.
+      float normal_factor = 0.2;
+      float diffuse_factor = 1 - normal_factor;
+      float c[3] = {n[k][0] * normal_factor + diffuse[0] * diffuse_factor,
+                    n[k][1] * normal_factor + diffuse[1] * diffuse_factor,
+                    n[k][2] * normal_factor + diffuse[2] * diffuse_factor};
+      float len2 = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+      if (len2 > 0.0f) {
+        float len = sqrtf(len2);
+
+        c[0] /= len;
+        c[1] /= len;
+        c[2] /= len;
+      }
+      *out++ = c[0] * 0.5 + 0.5;
+      *out++ = c[1] * 0.5 + 0.5;
+      *out++ = c[2] * 0.5 + 0.5;
+
+      *out++ = tc[k][0];
+      *out++ = tc[k][1];
+    }
+  }
+}
@@ -0,0 +1,121 @@
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "drawobject.h"
+#include "normals.h"
+
+#ifndef OBJCONVERT_H
+#define OBJCONVERT_H
+
+// The stages of LoadObjAndConvert that turn parsed OBJ data into
+// interleaved vertices. None of them touches OpenGL, so they can be timed
+// and tested on their own.
+
+/*
+  There are 2 approaches here to automatically generating vertex normals. The
+  old approach (ComputeSmoothingNormals) doesn't handle multiple smoothing
+  groups properly, as it effectively merges all smoothing groups present in the
+  OBJ file into a single group. However, it can be useful when the OBJ file
+  contains vertex normals which you want to use, but is missing some, as it
+  will attempt to fill in the missing normals without generating new shapes.
+
+  The new approach (ComputeSmoothingShapes, ComputeAllSmoothingNormals) handles
+  multiple smoothing groups but is a bit more complicated, as handling this
+  correctly requires potentially generating new vertices (and hence shapes).
+  In general, the new approach is most useful if your OBJ file is missing
+  vertex normals entirely, and instead relies on smoothing groups to correctly
+  generate them as a pre-process. That said, it can be used to reliably
+  generate vertex normals in the general case. If you want to always generate
+  normals in this way, simply force set regen_all_normals to true in
+  LoadObjAndConvert. By default, it's only true when there are no vertex
+  normals present. One other thing to keep in mind is that the statistics
+  printed apply to the model *prior* to shape regeneration, so you'd need to
+  print them again if you want to see the new statistics.
+
+  TODO(syoyo): import ComputeSmoothingShapes and ComputeAllSmoothingNormals to
+  tinyobjloader as utility functions.
+*/
+
+// Faces per task when a large shape is split across the worker pool.
+const size_t kFacesPerTask = 16384;
+
+// Axis aligned box, merged across tasks.
+struct Bounds {
+  float bmin[3];
+  float bmax[3];
+
+  Bounds() {
+    bmin[0] = bmin[1] = bmin[2] = std::numeric_limits<float>::max();
+    bmax[0] = bmax[1] = bmax[2] = -std::numeric_limits<float>::max();
+  }
+
+  void merge(const Bounds& b) {
+    for (int k = 0; k < 3; k++) {
+      bmin[k] = std::min(bmin[k], b.bmin[k]);
+      bmax[k] = std::max(bmax[k], b.bmax[k]);
+    }
+  }
+};
+
+// Normalized face normal of the triangle v0, v1, v2.
+void CalcNormal(float N[3], float v0[3], float v1[3], float v2[3]);
+
+// Check if `mesh_t` contains smoothing group id.
+bool HasSmoothingGroup(const tinyobj::shape_t& shape);
+
+// Smoothing normals of the vertices of one shape. `smoothNormals.corner`
+// gives the entry of each face corner.
+void ComputeSmoothingNormals(const tinyobj::attrib_t& attrib,
+                             const tinyobj::shape_t& shape,
+                             VertexNormals& smoothNormals);
+
+// Split every shape of `inshapes` into one shape per smoothing group, each
+// with vertices of its own in `outattrib`, so normals can be smoothed per
+// group.
+void ComputeSmoothingShapes(tinyobj::attrib_t& inattrib,
+                            std::vector<tinyobj::shape_t>& inshapes,
+                            std::vector<tinyobj::shape_t>& outshapes,
+                            tinyobj::attrib_t& outattrib);
+
+// Fill the normals of shapes made by ComputeSmoothingShapes.
+void ComputeAllSmoothingNormals(tinyobj::attrib_t& attrib,
+                                std::vector<tinyobj::shape_t>& shapes);
+
+// Smooth normals for `shape` the way LoadObjAndConvert does and store them
+// in `attrib`, with the face corners pointing at them, so the shape converts
+// without smoothing afterwards. With `regenerate`, every face gets normals
+// smoothed per smoothing group, as ComputeSmoothingShapes and
+// ComputeAllSmoothingNormals give them; otherwise only faces without
+// normals get them, smoothed across the shape as ComputeSmoothingNormals
+// does. Faces dropped from the shape afterwards still count towards the
+// normals of the others.
+void BakeSmoothingNormals(tinyobj::attrib_t& attrib, tinyobj::shape_t& shape,
+                          bool regenerate);
+
+// Material of face `f`, with invalid IDs mapped to the default material.
+int FaceMaterial(const tinyobj::shape_t& shape, size_t f,
+                 size_t numMaterials);
+
+// Order the faces of `shape` by material, keeping the file order within a
+// material, and describe each material's run of faces as a DrawRange.
+void SortFacesByMaterial(const tinyobj::shape_t& shape, size_t numMaterials,
+                         std::vector<unsigned int>* faceOrder,
+                         std::vector<DrawRange>* ranges);
+
+// Bounding box and sphere of the vertices of `r` in the unindexed `buffer`.
+void RangeBounds(const std::vector<float>& buffer, DrawRange* r);
+
+// Write the interleaved, unindexed vertices of the faces at positions
+// [begin, end) of `faceOrder` to the same positions of `buffer`, which holds
+// 3 * kVertexStride floats per face of the shape, and grow `bounds` by them.
+void ConvertFaces(const tinyobj::attrib_t& attrib,
+                  const tinyobj::shape_t& shape,
+                  const std::vector<tinyobj::material_t>& materials,
+                  const VertexNormals& smoothNormals,
+                  const std::vector<unsigned int>& faceOrder, size_t begin,
+                  size_t end, float* buffer, Bounds* bounds);
+
+#endif
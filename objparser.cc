@@ -0,0 +1,929 @@
+#include "objparser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+#include "mappedfile.h"
+#include "parallel.h"
+#include "profiler.h"
+
+namespace  // Local utility functions
+{
+// Chunks are made smaller than size / threads so uneven lines balance out.
+const size_t kMinChunkSize = 1 << 20;
+const size_t kChunksPerThread = 4;
+
+// Flags of a RawCorner. Indices written relative to the end of the attribute
+// arrays ("-1") are stored relative to the chunk and fixed up after merging.
+enum {
+  kRelativeV = 1,
+  kRelativeVt = 2,
+  kRelativeVn = 4,
+  kMissingVt = 8,
+  kMissingVn = 16
+};
+
+struct RawCorner {
+  int v, vt, vn;
+  unsigned char flags;
+};
+
+// Statements that change the state faces are added with. They are replayed
+// in file order after all chunks are parsed.
+struct Command {
+  enum Type { kUseMtl, kGroup, kObject, kSmooth, kMtlLib } type;
+  size_t face;      // # of faces of the chunk before this command
+  size_t triangle;  // # of triangles of the chunk before this command
+  std::string arg;
+  unsigned int smoothing_id;
+};
+
+struct Chunk {
+  const char* begin;
+  const char* end;
+
+  std::vector<tinyobj::real_t> v, vn, vt, vc;
+  std::vector<RawCorner> corners;
+  std::vector<unsigned int> faceSizes;
+  std::vector<unsigned int> faceSmoothingIds;
+  std::vector<Command> commands;
+
+  // First global index of this chunk's attributes.
+  size_t vBase, vnBase, vtBase;
+
+  // Triangulated faces with global indices, and the smoothing group of each.
+  std::vector<tinyobj::index_t> indices;
+  std::vector<unsigned int> smoothingIds;
+
+  std::string warn;
+  std::string err;
+};
+
+bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+bool isNewLine(char c) { return c == '\r' || c == '\n' || c == '\0'; }
+
+// Same number parser as tinyobjloader's tryParseDouble, so both parsers
+// produce bit-identical attributes.
+bool tryParseDouble(const char* s, const char* s_end, double* result) {
+  if (s >= s_end) {
+    return false;
+  }
+  double mantissa = 0.0;
+  int exponent = 0;
+  char sign = '+';
+  char exp_sign = '+';
+  const char* curr = s;
+  int read = 0;
+  bool end_not_reached = false;
+  bool leading_decimal_dots = false;
+
+  if (*curr == '+' || *curr == '-') {
+    sign = *curr;
+    curr++;
+    if ((curr != s_end) && (*curr == '.')) {
+      leading_decimal_dots = true;
+    }
+  } else if (isdigit(static_cast<unsigned char>(*curr))) {
+    // Pass through.
+  } else if (*curr == '.') {
+    leading_decimal_dots = true;
+  } else {
+    return false;
+  }
+
+  // Integer part.
+  end_not_reached = (curr != s_end);
+  if (!leading_decimal_dots) {
+    while (end_not_reached && isdigit(static_cast<unsigned char>(*curr))) {
+      mantissa *= 10;
+      mantissa += static_cast<int>(*curr - 0x30);
+      curr++;
+      read++;
+      end_not_reached = (curr != s_end);
+    }
+    if (read == 0) {
+      return false;
+    }
+  }
+  if (!end_not_reached) {
+    goto assemble;
+  }
+
+  // Decimal part.
+  if (*curr == '.') {
+    curr++;
+    read = 1;
+    end_not_reached = (curr != s_end);
+    while (end_not_reached && isdigit(static_cast<unsigned char>(*curr))) {
+      static const double pow_lut[] = {
+          1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001,
+      };
+      const int lut_entries = sizeof pow_lut / sizeof pow_lut[0];
+      mantissa += static_cast<int>(*curr - 0x30) *
+                  (read < lut_entries ? pow_lut[read] : std::pow(10.0, -read));
+      read++;
+      curr++;
+      end_not_reached = (curr != s_end);
+    }
+  } else if (*curr == 'e' || *curr == 'E') {
+  } else {
+    goto assemble;
+  }
+  if (!end_not_reached) {
+    goto assemble;
+  }
+
+  // Exponent part.
+  if (*curr == 'e' || *curr == 'E') {
+    curr++;
+    end_not_reached = (curr != s_end);
+    if (end_not_reached && (*curr == '+' || *curr == '-')) {
+      exp_sign = *curr;
+      curr++;
+    } else if (isdigit(static_cast<unsigned char>(*curr))) {
+      // Pass through.
+    } else {
+      return false;  // Empty E is not allowed.
+    }
+    read = 0;
+    end_not_reached = (curr != s_end);
+    while (end_not_reached && isdigit(static_cast<unsigned char>(*curr))) {
+      if (exponent > (2147483647 / 10)) {
+        return false;  // Integer overflow.
+      }
+      exponent *= 10;
+      exponent += static_cast<int>(*curr - 0x30);
+      curr++;
+      read++;
+      end_not_reached = (curr != s_end);
+    }
+    exponent *= (exp_sign == '+' ? 1 : -1);
+    if (read == 0) {
+      return false;
+    }
+  }
+
+assemble:
+  *result = (sign == '+' ? 1 : -1) *
+            (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent)
+                      : mantissa);
+  return true;
+}
+
+// `token` points into a NUL-terminated line.
+bool parseReal(const char** token, tinyobj::real_t* out) {
+  (*token) += strspn((*token), " \t");
+  const char* end = (*token) + strcspn((*token), " \t\r");
+  double val;
+  bool ret = tryParseDouble((*token), end, &val);
+  if (ret) {
+    *out = static_cast<tinyobj::real_t>(val);
+  }
+  (*token) = end;
+  return ret;
+}
+
+tinyobj::real_t parseReal(const char** token, double default_value = 0.0) {
+  (*token) += strspn((*token), " \t");
+  const char* end = (*token) + strcspn((*token), " \t\r");
+  double val = default_value;
+  tryParseDouble((*token), end, &val);
+  (*token) = end;
+  return static_cast<tinyobj::real_t>(val);
+}
+
+std::string parseString(const char** token) {
+  (*token) += strspn((*token), " \t");
+  size_t e = strcspn((*token), " \t\r");
+  std::string s((*token), e);
+  (*token) += e;
+  return s;
+}
+
+// Convert one index of a face. Positive indices are absolute, negative ones
+// are relative to `count`, the # of elements the chunk has read so far.
+bool fixIndex(int idx, size_t count, int* ret, unsigned char* flags,
+              unsigned char relativeFlag) {
+  if (idx > 0) {
+    *ret = idx - 1;
+    return true;
+  }
+  if (idx == 0) {
+    return false;
+  }
+  *ret = static_cast<int>(count) + idx;
+  *flags |= relativeFlag;
+  return true;
+}
+
+bool parseCorner(const char** token, const Chunk& c, RawCorner* corner) {
+  corner->vt = corner->vn = -1;
+  corner->flags = kMissingVt | kMissingVn;
+  if (!fixIndex(atoi(*token), c.v.size() / 3, &corner->v, &corner->flags,
+                kRelativeV)) {
+    return false;
+  }
+  (*token) += strcspn((*token), "/ \t\r");
+  if ((*token)[0] != '/') {
+    return true;
+  }
+  (*token)++;
+
+  // i//k
+  if ((*token)[0] == '/') {
+    (*token)++;
+    corner->flags &= ~kMissingVn;
+    if (!fixIndex(atoi(*token), c.vn.size() / 3, &corner->vn, &corner->flags,
+                  kRelativeVn)) {
+      return false;
+    }
+    (*token) += strcspn((*token), "/ \t\r");
+    return true;
+  }
+
+  // i/j/k or i/j
+  corner->flags &= ~kMissingVt;
+  if (!fixIndex(atoi(*token), c.vt.size() / 2, &corner->vt, &corner->flags,
+                kRelativeVt)) {
+    return false;
+  }
+  (*token) += strcspn((*token), "/ \t\r");
+  if ((*token)[0] != '/') {
+    return true;
+  }
+  (*token)++;
+  corner->flags &= ~kMissingVn;
+  if (!fixIndex(atoi(*token), c.vn.size() / 3, &corner->vn, &corner->flags,
+                kRelativeVn)) {
+    return false;
+  }
+  (*token) += strcspn((*token), "/ \t\r");
+  return true;
+}
+
+void addCommand(Chunk& c, Command::Type type, const std::string& arg,
+                unsigned int smoothing_id) {
+  Command cmd;
+  cmd.type = type;
+  cmd.face = c.faceSizes.size();
+  cmd.triangle = 0;
+  cmd.arg = arg;
+  cmd.smoothing_id = smoothing_id;
+  c.commands.push_back(cmd);
+}
+
+// Parse one line, already stripped of its line break and NUL-terminated.
+// `smoothing_id` carries the current `s` state within the chunk; faces before
+// the chunk's first `s` get fixed up when the chunks are merged.
+bool parseLine(Chunk& c, const char* token, unsigned int& smoothing_id,
+               bool& smoothing_known) {
+  token += strspn(token, " \t");
+  if (token[0] == '\0' || token[0] == '#') {
+    return true;
+  }
+
+  if (token[0] == 'v' && isSpace(token[1])) {
+    token += 2;
+    tinyobj::real_t x = parseReal(&token);
+    tinyobj::real_t y = parseReal(&token);
+    tinyobj::real_t z = parseReal(&token);
+    tinyobj::real_t r, g, b;
+    bool found_color =
+        parseReal(&token, &r) && parseReal(&token, &g) && parseReal(&token, &b);
+    if (!found_color) {
+      r = g = b = 1.0f;
+    }
+    c.v.push_back(x);
+    c.v.push_back(y);
+    c.v.push_back(z);
+    c.vc.push_back(r);
+    c.vc.push_back(g);
+    c.vc.push_back(b);
+    return true;
+  }
+
+  if (token[0] == 'v' && token[1] == 'n' && isSpace(token[2])) {
+    token += 3;
+    c.vn.push_back(parseReal(&token));
+    c.vn.push_back(parseReal(&token));
+    c.vn.push_back(parseReal(&token));
+    return true;
+  }
+
+  if (token[0] == 'v' && token[1] == 't' && isSpace(token[2])) {
+    token += 3;
+    c.vt.push_back(parseReal(&token));
+    c.vt.push_back(parseReal(&token));
+    return true;
+  }
+
+  if (token[0] == 'f' && isSpace(token[1])) {
+    token += 2;
+    token += strspn(token, " \t");
+    unsigned int n = 0;
+    while (!isNewLine(token[0])) {
+      RawCorner corner;
+      if (!parseCorner(&token, c, &corner)) {
+        c.err += "Failed parse `f' line (e.g. zero value for face index).\n";
+        return false;
+      }
+      c.corners.push_back(corner);
+      n++;
+      token += strspn(token, " \t\r");
+    }
+    c.faceSizes.push_back(n);
+    // A placeholder of 0 marks faces whose group is set in an earlier chunk.
+    c.faceSmoothingIds.push_back(smoothing_known ? smoothing_id : 0);
+    return true;
+  }
+
+  if (0 == strncmp(token, "usemtl", 6)) {
+    token += 6;
+    addCommand(c, Command::kUseMtl, parseString(&token), 0);
+    return true;
+  }
+
+  if (0 == strncmp(token, "mtllib", 6) && isSpace(token[6])) {
+    addCommand(c, Command::kMtlLib, std::string(token + 7), 0);
+    return true;
+  }
+
+  if (token[0] == 'g' && isSpace(token[1])) {
+    token += 2;
+    std::vector<std::string> names;
+    while (!isNewLine(token[0])) {
+      std::string str = parseString(&token);
+      names.push_back(str);
+      token += strspn(token, " \t\r");
+    }
+    std::string name;
+    if (names.empty()) {
+      c.warn += "Empty group name.\n";
+    } else {
+      std::stringstream ss;
+      ss << names[0];
+      for (size_t i = 1; i < names.size(); i++) {
+        ss << " " << names[i];
+      }
+      name = ss.str();
+    }
+    addCommand(c, Command::kGroup, name, 0);
+    return true;
+  }
+
+  if (token[0] == 'o' && isSpace(token[1])) {
+    addCommand(c, Command::kObject, std::string(token + 2), 0);
+    return true;
+  }
+
+  if (token[0] == 's' && isSpace(token[1])) {
+    token += 2;
+    token += strspn(token, " \t");
+    if (token[0] == '\0' || token[0] == '\r' || token[0] == '\n') {
+      return true;
+    }
+    if (strlen(token) >= 3 && token[0] == 'o' && token[1] == 'f' &&
+        token[2] == 'f') {
+      smoothing_id = 0;
+    } else {
+      int id = atoi(token);
+      smoothing_id = id < 0 ? 0 : static_cast<unsigned int>(id);
+    }
+    smoothing_known = true;
+    addCommand(c, Command::kSmooth, std::string(), smoothing_id);
+    return true;
+  }
+
+  // Lines, points, tags and other statements are ignored.
+  return true;
+}
+
+bool parseChunk(Chunk& c) {
+  std::string line;
+  unsigned int smoothing_id = 0;
+  bool smoothing_known = false;
+  const char* p = c.begin;
+  while (p < c.end) {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', c.end - p));
+    if (!eol) {
+      eol = c.end;
+    }
+    const char* last = eol;
+    if (last > p && last[-1] == '\r') {
+      last--;
+    }
+    line.assign(p, last);
+    if (!parseLine(c, line.c_str(), smoothing_id, smoothing_known)) {
+      return false;
+    }
+    p = eol + 1;
+  }
+  return true;
+}
+
+tinyobj::index_t resolveCorner(const RawCorner& rc, const Chunk& c) {
+  tinyobj::index_t idx;
+  idx.vertex_index = rc.v + static_cast<int>((rc.flags & kRelativeV) ? c.vBase
+                                                                     : 0);
+  idx.texcoord_index =
+      (rc.flags & kMissingVt)
+          ? -1
+          : rc.vt + static_cast<int>((rc.flags & kRelativeVt) ? c.vtBase : 0);
+  idx.normal_index =
+      (rc.flags & kMissingVn)
+          ? -1
+          : rc.vn + static_cast<int>((rc.flags & kRelativeVn) ? c.vnBase : 0);
+  return idx;
+}
+
+// Triangulate the faces of a chunk with TriangulateFace().
+void triangulateChunk(Chunk& c, const std::vector<tinyobj::real_t>& v) {
+  c.indices.reserve(c.corners.size());
+  c.smoothingIds.reserve(c.faceSizes.size());
+  size_t corner = 0;
+  size_t cmd = 0;
+  size_t numPolygons = 0;
+  std::vector<tinyobj::index_t> face;
+  for (size_t f = 0; f <= c.faceSizes.size(); f++) {
+    while (cmd < c.commands.size() && c.commands[cmd].face == f) {
+      c.commands[cmd++].triangle = c.smoothingIds.size();
+    }
+    if (f == c.faceSizes.size()) {
+      break;
+    }
+
+    unsigned int n = c.faceSizes[f];
+    const RawCorner* rc = &c.corners[corner];
+    corner += n;
+    if (n < 3) {
+      c.warn += "Degenerated face found.\n";
+      continue;
+    }
+    if (n > 4) {
+      numPolygons++;
+    }
+    face.resize(n);
+    for (unsigned int k = 0; k < n; k++) {
+      face[k] = resolveCorner(rc[k], c);
+    }
+    size_t triangles =
+        TriangulateFace(face.data(), n, v.data(), v.size() / 3, &c.indices);
+    c.smoothingIds.insert(c.smoothingIds.end(), triangles,
+                          c.faceSmoothingIds[f]);
+  }
+  if (numPolygons > 0) {
+    std::stringstream ss;
+    ss << numPolygons
+       << " polygon(s) with more than 4 vertices were fan-triangulated.\n";
+    c.warn += ss.str();
+  }
+}
+
+template <typename T>
+void appendRange(std::vector<T>& dst, const std::vector<T>& src, size_t begin,
+                 size_t end) {
+  dst.insert(dst.end(), src.begin() + begin, src.begin() + end);
+}
+
+// Split [data, data_end) into chunks of about `chunkSize` bytes that end at
+// line boundaries.
+void splitChunks(const char* data, const char* data_end, size_t chunkSize,
+                 std::vector<Chunk>* chunks) {
+  for (const char* p = data; p < data_end;) {
+    const char* e = p + std::min<size_t>(chunkSize, data_end - p);
+    if (e < data_end) {
+      const char* nl = static_cast<const char*>(memchr(e, '\n', data_end - e));
+      e = nl ? nl + 1 : data_end;
+    }
+    chunks->emplace_back();
+    chunks->back().begin = p;
+    chunks->back().end = e;
+    p = e;
+  }
+}
+
+// Place a parsed chunk after the attributes counted so far, and give the
+// faces before its first `s` the smoothing group the earlier chunks left
+// in `smoothing_id`, which is then updated to the one this chunk leaves.
+void placeChunk(Chunk& c, size_t* numV, size_t* numVn, size_t* numVt,
+                unsigned int* smoothing_id) {
+  c.vBase = *numV;
+  c.vnBase = *numVn;
+  c.vtBase = *numVt;
+  *numV += c.v.size() / 3;
+  *numVn += c.vn.size() / 3;
+  *numVt += c.vt.size() / 2;
+
+  size_t firstSmooth = c.faceSizes.size();
+  for (size_t k = 0; k < c.commands.size(); k++) {
+    if (c.commands[k].type == Command::kSmooth) {
+      firstSmooth = c.commands[k].face;
+      break;
+    }
+  }
+  for (size_t f = 0; f < firstSmooth; f++) {
+    c.faceSmoothingIds[f] = *smoothing_id;
+  }
+  for (size_t k = 0; k < c.commands.size(); k++) {
+    if (c.commands[k].type == Command::kSmooth) {
+      *smoothing_id = c.commands[k].smoothing_id;
+    }
+  }
+}
+
+// Materials known to the replayed statements and the one in use.
+struct MaterialState {
+  explicit MaterialState(const char* mtl_basedir)
+      : reader(mtl_basedir ? mtl_basedir : ""), material(-1) {}
+
+  tinyobj::MaterialFileReader reader;
+  std::map<std::string, int> material_map;
+  int material;
+};
+
+// Replay a `usemtl` or `mtllib` statement.
+void applyMaterialCommand(const Command& cmd, MaterialState& state,
+                          std::vector<tinyobj::material_t>* materials,
+                          std::string* warn, std::string* err) {
+  if (cmd.type == Command::kUseMtl) {
+    std::map<std::string, int>::const_iterator it =
+        state.material_map.find(cmd.arg);
+    if (it != state.material_map.end()) {
+      state.material = it->second;
+    } else {
+      state.material = -1;
+      if (warn) {
+        (*warn) += "material [ '" + cmd.arg + "' ] not found in .mtl\n";
+      }
+    }
+    return;
+  }
+
+  std::vector<std::string> filenames;
+  const char* token = cmd.arg.c_str();
+  while (!isNewLine(token[0])) {
+    std::string f = parseString(&token);
+    if (!f.empty()) {
+      filenames.push_back(f);
+    }
+    token += strspn(token, " \t\r");
+  }
+  bool found = false;
+  for (size_t m = 0; m < filenames.size() && !found; m++) {
+    std::string warn_mtl, err_mtl;
+    found = state.reader(filenames[m].c_str(), materials, &state.material_map,
+                         &warn_mtl, &err_mtl);
+    if (warn) {
+      (*warn) += warn_mtl;
+    }
+    if (err) {
+      (*err) += err_mtl;
+    }
+  }
+  if (!found && warn) {
+    (*warn) += "Failed to load material file(s). Use default material.\n";
+  }
+}
+
+// Parse `chunks` on the worker pool and collect their messages. Fails with
+// the error of the first chunk that could not be parsed.
+bool parseChunks(std::vector<Chunk>& chunks, std::string* warn,
+                 std::string* err) {
+  std::vector<char> ok(chunks.size(), 0);
+  ParallelFor(0, chunks.size(), 1, [&](size_t b, size_t e) {
+    PROFILE_ZONE("parse chunks");
+    for (size_t i = b; i < e; i++) {
+      ok[i] = parseChunk(chunks[i]);
+    }
+  });
+  for (size_t i = 0; i < chunks.size(); i++) {
+    if (warn) {
+      (*warn) += chunks[i].warn;
+    }
+    if (!ok[i]) {
+      if (err) {
+        (*err) += chunks[i].err;
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+size_t TriangulateFace(const tinyobj::index_t* corners, unsigned int n,
+                       const tinyobj::real_t* positions, size_t numPositions,
+                       std::vector<tinyobj::index_t>* triangles) {
+  if (n < 3) {
+    return 0;
+  }
+  if (n == 3) {
+    triangles->insert(triangles->end(), corners, corners + 3);
+    return 1;
+  }
+
+  if (n == 4) {
+    for (int k = 0; k < 4; k++) {
+      if (corners[k].vertex_index < 0 ||
+          size_t(corners[k].vertex_index) >= numPositions) {
+        return 0;  // Invalid quad, like tinyobjloader skip it.
+      }
+    }
+    const tinyobj::real_t* p[4];
+    for (int k = 0; k < 4; k++) {
+      p[k] = &positions[3 * corners[k].vertex_index];
+    }
+    tinyobj::real_t e02x = p[2][0] - p[0][0];
+    tinyobj::real_t e02y = p[2][1] - p[0][1];
+    tinyobj::real_t e02z = p[2][2] - p[0][2];
+    tinyobj::real_t e13x = p[3][0] - p[1][0];
+    tinyobj::real_t e13y = p[3][1] - p[1][1];
+    tinyobj::real_t e13z = p[3][2] - p[1][2];
+    tinyobj::real_t sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+    tinyobj::real_t sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+    static const int split02[6] = {0, 1, 2, 0, 2, 3};
+    static const int split13[6] = {0, 1, 3, 1, 2, 3};
+    const int* order = (sqr02 < sqr13) ? split02 : split13;
+    for (int k = 0; k < 6; k++) {
+      triangles->push_back(corners[order[k]]);
+    }
+    return 2;
+  }
+
+  for (unsigned int k = 1; k + 1 < n; k++) {
+    triangles->push_back(corners[0]);
+    triangles->push_back(corners[k]);
+    triangles->push_back(corners[k + 1]);
+  }
+  return n - 2;
+}
+
+bool LoadObjParallel(tinyobj::attrib_t* attrib,
+                     std::vector<tinyobj::shape_t>* shapes,
+                     std::vector<tinyobj::material_t>* materials,
+                     std::string* warn, std::string* err, const char* filename,
+                     const char* mtl_basedir) {
+  attrib->vertices.clear();
+  attrib->normals.clear();
+  attrib->texcoords.clear();
+  attrib->colors.clear();
+  shapes->clear();
+
+  MappedFile file;
+  if (!file.open(filename)) {
+    if (err) {
+      (*err) += "Cannot open file [" + std::string(filename) + "]\n";
+    }
+    return false;
+  }
+
+  const char* data = reinterpret_cast<const char*>(file.data());
+  size_t chunkSize = std::max(
+      kMinChunkSize, file.size() / (NumWorkerThreads() * kChunksPerThread));
+  std::vector<Chunk> chunks;
+  splitChunks(data, data + file.size(), chunkSize, &chunks);
+  if (!parseChunks(chunks, warn, err)) {
+    return false;
+  }
+
+  // Global offsets of each chunk, and the smoothing group each chunk starts
+  // with, which is the last one set by any earlier chunk.
+  size_t numV = 0, numVn = 0, numVt = 0;
+  unsigned int smoothing_id = 0;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    placeChunk(chunks[i], &numV, &numVn, &numVt, &smoothing_id);
+  }
+
+  attrib->vertices.resize(3 * numV);
+  attrib->colors.resize(3 * numV);
+  attrib->normals.resize(3 * numVn);
+  attrib->texcoords.resize(2 * numVt);
+  ParallelFor(0, chunks.size(), 1, [&](size_t b, size_t e) {
+    for (size_t i = b; i < e; i++) {
+      const Chunk& c = chunks[i];
+      std::copy(c.v.begin(), c.v.end(), attrib->vertices.begin() + 3 * c.vBase);
+      std::copy(c.vc.begin(), c.vc.end(), attrib->colors.begin() + 3 * c.vBase);
+      std::copy(c.vn.begin(), c.vn.end(),
+                attrib->normals.begin() + 3 * c.vnBase);
+      std::copy(c.vt.begin(), c.vt.end(),
+                attrib->texcoords.begin() + 2 * c.vtBase);
+    }
+  });
+
+  ParallelFor(0, chunks.size(), 1, [&](size_t b, size_t e) {
+    PROFILE_ZONE("triangulate chunks");
+    for (size_t i = b; i < e; i++) {
+      triangulateChunk(chunks[i], attrib->vertices);
+    }
+  });
+
+  // Replay the state changing statements in file order to cut the triangles
+  // into shapes. This only appends whole runs of triangles.
+  materials->clear();
+  MaterialState state(mtl_basedir);
+  tinyobj::shape_t shape;
+  std::string name;
+  auto flush = [&]() {
+    if (!shape.mesh.indices.empty()) {
+      shape.name = name;
+      shapes->push_back(tinyobj::shape_t());
+      std::swap(shapes->back(), shape);
+    }
+    shape = tinyobj::shape_t();
+  };
+  for (size_t i = 0; i < chunks.size(); i++) {
+    Chunk& c = chunks[i];
+    size_t numTriangles = c.smoothingIds.size();
+    size_t t = 0;
+    for (size_t k = 0; k <= c.commands.size(); k++) {
+      size_t next = (k < c.commands.size()) ? c.commands[k].triangle
+                                            : numTriangles;
+      if (next > t) {
+        tinyobj::mesh_t& mesh = shape.mesh;
+        appendRange(mesh.indices, c.indices, 3 * t, 3 * next);
+        mesh.num_face_vertices.insert(mesh.num_face_vertices.end(), next - t,
+                                      3);
+        mesh.material_ids.insert(mesh.material_ids.end(), next - t,
+                                 state.material);
+        appendRange(mesh.smoothing_group_ids, c.smoothingIds, t, next);
+        t = next;
+      }
+      if (k == c.commands.size()) {
+        break;
+      }
+
+      const Command& cmd = c.commands[k];
+      if (cmd.type == Command::kUseMtl || cmd.type == Command::kMtlLib) {
+        applyMaterialCommand(cmd, state, materials, warn, err);
+      } else if (cmd.type == Command::kGroup ||
+                 cmd.type == Command::kObject) {
+        flush();
+        name = cmd.arg;
+      }
+    }
+    // Release the chunk's memory as soon as it has been merged.
+    c = Chunk();
+  }
+  flush();
+  return true;
+}
+
+bool StreamObjParallel(const char* filename, const char* mtl_basedir,
+                       const std::function<bool(const ObjStream&)>& fn,
+                       std::vector<tinyobj::material_t>* materials,
+                       size_t* numShapes, std::string* warn,
+                       std::string* err) {
+  MappedFile file;
+  if (!file.open(filename)) {
+    if (err) {
+      (*err) += "Cannot open file [" + std::string(filename) + "]\n";
+    }
+    return false;
+  }
+
+  // Only the chunks of one batch are parsed and in memory at a time.
+  const char* data = reinterpret_cast<const char*>(file.data());
+  const char* data_end = data + file.size();
+  size_t batchSize = kMinChunkSize * NumWorkerThreads();
+  size_t numV = 0, numVn = 0, numVt = 0;
+  unsigned int smoothing_id = 0;
+  materials->clear();
+  MaterialState state(mtl_basedir);
+  size_t shape = 0;
+  bool shapeUsed = false;
+  ObjStream out;
+  for (const char* p = data; p < data_end;) {
+    const char* e = p + std::min(batchSize, size_t(data_end - p));
+    if (e < data_end) {
+      const char* nl = static_cast<const char*>(memchr(e, '\n', data_end - e));
+      e = nl ? nl + 1 : data_end;
+    }
+    std::vector<Chunk> chunks;
+    splitChunks(p, e, kMinChunkSize, &chunks);
+    p = e;
+    if (!parseChunks(chunks, warn, err)) {
+      return false;
+    }
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+      Chunk& c = chunks[i];
+      placeChunk(c, &numV, &numVn, &numVt, &smoothing_id);
+      out.vertices.swap(c.v);
+      out.normals.swap(c.vn);
+      out.texcoords.swap(c.vt);
+      out.num_face_vertices.clear();
+      out.indices.clear();
+      out.material_ids.clear();
+      out.smoothing_group_ids.clear();
+      out.shape_ids.clear();
+
+      // Replay the state changing statements in file order, as
+      // LoadObjParallel() does, to give every face its material and shape.
+      size_t corner = 0;
+      size_t cmd = 0;
+      for (size_t f = 0; f <= c.faceSizes.size(); f++) {
+        for (; cmd < c.commands.size() && c.commands[cmd].face == f; cmd++) {
+          const Command& command = c.commands[cmd];
+          if (command.type == Command::kUseMtl ||
+              command.type == Command::kMtlLib) {
+            applyMaterialCommand(command, state, materials, warn, err);
+          } else if ((command.type == Command::kGroup ||
+                      command.type == Command::kObject) &&
+                     shapeUsed) {
+            shape++;
+            shapeUsed = false;
+          }
+        }
+        if (f == c.faceSizes.size()) {
+          break;
+        }
+
+        unsigned int n = c.faceSizes[f];
+        const RawCorner* rc = &c.corners[corner];
+        corner += n;
+        if (n < 3) {
+          if (warn) {
+            (*warn) += "Degenerated face found.\n";
+          }
+          continue;
+        }
+        for (unsigned int k = 0; k < n; k++) {
+          out.indices.push_back(resolveCorner(rc[k], c));
+        }
+        out.num_face_vertices.push_back(n);
+        out.material_ids.push_back(state.material);
+        out.smoothing_group_ids.push_back(c.faceSmoothingIds[f]);
+        out.shape_ids.push_back(static_cast<unsigned int>(shape));
+        shapeUsed = true;
+      }
+      c = Chunk();
+      if (!fn(out)) {
+        return false;
+      }
+    }
+  }
+  *numShapes = shapeUsed ? shape + 1 : shape;
+  return true;
+}
+
+bool CompareObjData(const tinyobj::attrib_t& attribA,
+                    const std::vector<tinyobj::shape_t>& shapesA,
+                    const std::vector<tinyobj::material_t>& materialsA,
+                    const tinyobj::attrib_t& attribB,
+                    const std::vector<tinyobj::shape_t>& shapesB,
+                    const std::vector<tinyobj::material_t>& materialsB,
+                    std::string* diff) {
+  std::stringstream ss;
+  if (attribA.vertices != attribB.vertices) {
+    ss << "vertices differ";
+  } else if (attribA.normals != attribB.normals) {
+    ss << "normals differ";
+  } else if (attribA.texcoords != attribB.texcoords) {
+    ss << "texcoords differ";
+  } else if (attribA.colors != attribB.colors) {
+    ss << "vertex colors differ";
+  } else if (materialsA.size() != materialsB.size()) {
+    ss << "# of materials differ: " << materialsA.size() << " vs "
+       << materialsB.size();
+  } else if (shapesA.size() != shapesB.size()) {
+    ss << "# of shapes differ: " << shapesA.size() << " vs " << shapesB.size();
+  }
+  for (size_t m = 0; ss.str().empty() && m < materialsA.size(); m++) {
+    if (materialsA[m].name != materialsB[m].name ||
+        materialsA[m].diffuse_texname != materialsB[m].diffuse_texname) {
+      ss << "material[" << m << "] differs";
+    }
+  }
+  for (size_t s = 0; ss.str().empty() && s < shapesA.size(); s++) {
+    const tinyobj::mesh_t& a = shapesA[s].mesh;
+    const tinyobj::mesh_t& b = shapesB[s].mesh;
+    bool sameIndices = a.indices.size() == b.indices.size();
+    for (size_t i = 0; sameIndices && i < a.indices.size(); i++) {
+      sameIndices = a.indices[i].vertex_index == b.indices[i].vertex_index &&
+                    a.indices[i].normal_index == b.indices[i].normal_index &&
+                    a.indices[i].texcoord_index == b.indices[i].texcoord_index;
+    }
+    if (shapesA[s].name != shapesB[s].name) {
+      ss << "shape[" << s << "] name differs: '" << shapesA[s].name
+         << "' vs '" << shapesB[s].name << "'";
+    } else if (!sameIndices) {
+      ss << "shape[" << s << "] indices differ";
+    } else if (a.num_face_vertices != b.num_face_vertices) {
+      ss << "shape[" << s << "] face sizes differ";
+    } else if (a.material_ids != b.material_ids) {
+      ss << "shape[" << s << "] material ids differ";
+    } else if (a.smoothing_group_ids != b.smoothing_group_ids) {
+      ss << "shape[" << s << "] smoothing group ids differ";
+    }
+  }
+  if (diff) {
+    *diff = ss.str();
+  }
+  return ss.str().empty();
+}
@@ -0,0 +1,63 @@
+#include <tiny_obj_loader.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef OBJPARSER_H
+#define OBJPARSER_H
+
+// Drop-in replacement for tinyobj::LoadObj (with triangulation) that maps the
+// file, parses chunks of it on all worker threads and merges the results in
+// file order. Lines, points, tags and vertex weights are not read since the
+// viewer does not use them.
+bool LoadObjParallel(tinyobj::attrib_t* attrib,
+                     std::vector<tinyobj::shape_t>* shapes,
+                     std::vector<tinyobj::material_t>* materials,
+                     std::string* warn, std::string* err, const char* filename,
+                     const char* mtl_basedir);
+
+// Attributes and faces of a run of lines of an OBJ file, as handed out by
+// StreamObjParallel(). Indices are global to the file. Faces are not
+// triangulated, since a quad is split by its positions and absolute indices
+// may refer to vertices later in the file.
+typedef struct {
+  std::vector<tinyobj::real_t> vertices;  // appended to those of earlier runs
+  std::vector<tinyobj::real_t> normals;
+  std::vector<tinyobj::real_t> texcoords;
+  std::vector<unsigned int> num_face_vertices;
+  std::vector<tinyobj::index_t> indices;
+  std::vector<int> material_ids;
+  std::vector<unsigned int> smoothing_group_ids;
+  std::vector<unsigned int> shape_ids;  // shapes LoadObjParallel would make
+} ObjStream;
+
+// Parse `filename` like LoadObjParallel(), but only a few chunks at a time,
+// and hand each run to `fn` in file order before the next chunks are
+// parsed, so the file does not have to fit in memory. Stops and fails if
+// `fn` does. `numShapes` receives the # of shape IDs used.
+bool StreamObjParallel(const char* filename, const char* mtl_basedir,
+                       const std::function<bool(const ObjStream&)>& fn,
+                       std::vector<tinyobj::material_t>* materials,
+                       size_t* numShapes, std::string* warn, std::string* err);
+
+// Split the polygon of `n` `corners` into triangles appended to
+// `triangles`, the way LoadObjParallel() does: triangles are kept, quads are
+// split along their shorter diagonal and larger polygons are fanned from
+// their first corner. Returns the # of triangles; quads with a corner
+// outside the `numPositions` positions are skipped like tinyobjloader does.
+size_t TriangulateFace(const tinyobj::index_t* corners, unsigned int n,
+                       const tinyobj::real_t* positions, size_t numPositions,
+                       std::vector<tinyobj::index_t>* triangles);
+
+// Check that two parse results hold the same data LoadObjAndConvert uses.
+// Describes the first difference in `diff` otherwise.
+bool CompareObjData(const tinyobj::attrib_t& attribA,
+                    const std::vector<tinyobj::shape_t>& shapesA,
+                    const std::vector<tinyobj::material_t>& materialsA,
+                    const tinyobj::attrib_t& attribB,
+                    const std::vector<tinyobj::shape_t>& shapesB,
+                    const std::vector<tinyobj::material_t>& materialsB,
+                    std::string* diff);
+
+#endif
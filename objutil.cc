@@ -12,305 +12,880 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <map>
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "camera.h"
+#include "drawbatch.h"
 #include "drawobject.h"
+#include "facebins.h"
+#include "global.h"
+#include "lod.h"
+#include "mappedfile.h"
+#include "meshcache.h"
+#include "normals.h"
+#include "objconvert.h"
+#include "objparser.h"
 #include "objutil.h"
-#include "timerutil.h"
+#include "occlusion.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "texcache.h"
+#include "texutil.h"
 #include "util.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
+#include "vertexcache.h"
 
-void CalcNormal(float N[3], float v0[3], float v1[3], float v2[3]) {
-  float v10[3];
-  v10[0] = v1[0] - v0[0];
-  v10[1] = v1[1] - v0[1];
-  v10[2] = v1[2] - v0[2];
+namespace  // Local utility functions
+{
+// Hashes and compares interleaved vertices stored in `vertices` by their
+// index, so the weld table below only has to hold one int per vertex.
+struct VertexHash {
+  const std::vector<float>* vertices;
+  size_t stride;
+  size_t operator()(unsigned int i) const {
+    // FNV-1a over the raw bytes of the vertex.
+    const unsigned char* p =
+        reinterpret_cast<const unsigned char*>(&(*vertices)[i * stride]);
+    size_t h = 14695981039346656037ULL;
+    for (size_t b = 0; b < stride * sizeof(float); b++) {
+      h = (h ^ p[b]) * 1099511628211ULL;
+    }
+    return h;
+  }
+};
 
-  float v20[3];
-  v20[0] = v2[0] - v0[0];
-  v20[1] = v2[1] - v0[1];
-  v20[2] = v2[2] - v0[2];
+struct VertexEqual {
+  const std::vector<float>* vertices;
+  size_t stride;
+  bool operator()(unsigned int a, unsigned int b) const {
+    return memcmp(&(*vertices)[a * stride], &(*vertices)[b * stride],
+                  stride * sizeof(float)) == 0;
+  }
+};
 
-  N[0] = v10[1] * v20[2] - v10[2] * v20[1];
-  N[1] = v10[2] * v20[0] - v10[0] * v20[2];
-  N[2] = v10[0] * v20[1] - v10[1] * v20[0];
+// Weld the unindexed triangle list in `buffer` into unique `vertices` and
+// `indices`. Vertices are compared bitwise, so only exact duplicates of the
+// whole (position, normal, color, texcoord) tuple are merged and seams are
+// left intact.
+void weldVertices(const std::vector<float>& buffer, size_t stride,
+                  std::vector<float>& vertices,
+                  std::vector<unsigned int>& indices) {
+  size_t numCorners = buffer.size() / stride;
+  vertices.clear();
+  indices.clear();
+  vertices.reserve(buffer.size());
+  indices.reserve(numCorners);
+
+  std::unordered_set<unsigned int, VertexHash, VertexEqual> unique(
+      numCorners, VertexHash{&vertices, stride},
+      VertexEqual{&vertices, stride});
+  for (size_t i = 0; i < numCorners; i++) {
+    // Append the candidate, then drop it again if it is already present.
+    unsigned int candidate =
+        static_cast<unsigned int>(vertices.size() / stride);
+    vertices.insert(vertices.end(), buffer.begin() + i * stride,
+                    buffer.begin() + (i + 1) * stride);
+    auto result = unique.insert(candidate);
+    if (!result.second) {
+      vertices.resize(vertices.size() - stride);
+    }
+    indices.push_back(*result.first);
+  }
+  vertices.shrink_to_fit();
+}
 
-  float len2 = N[0] * N[0] + N[1] * N[1] + N[2] * N[2];
-  if (len2 > 0.0f) {
-    float len = sqrtf(len2);
+// Lay the vertices out again so that every range, with its levels, uses at
+// most 65536 consecutive vertices, and point the range's base vertex at the
+// first of them. Vertices keep the order of first use, but a vertex last
+// placed too far back for the current range is placed again, so only
+// vertices shared by ranges far apart in the index buffer are duplicated.
+// Fails without touching anything if a range uses more distinct vertices
+// than 16-bit indices reach.
+bool windowRanges(std::vector<float>* vertices, size_t stride,
+                  std::vector<unsigned int>* indices,
+                  std::vector<DrawRange>* ranges) {
+  const long kWindow = 65536;
+  size_t numVertices = vertices->size() / stride;
+  std::vector<size_t> order(ranges->size());
+  for (size_t r = 0; r < order.size(); r++) {
+    order[r] = r;
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return (*ranges)[a].first < (*ranges)[b].first;
+  });
+
+  // Distinct vertices of each range, the levels included.
+  std::vector<long> used(ranges->size(), 0);
+  std::vector<size_t> stamp(numVertices, ~size_t(0));
+  for (size_t r = 0; r < ranges->size(); r++) {
+    const DrawRange& range = (*ranges)[r];
+    for (int l = 0; l <= range.num_lods; l++) {
+      int first = l == 0 ? range.first : range.lods[l - 1].first;
+      int count = l == 0 ? range.count : range.lods[l - 1].count;
+      for (int i = first; i < first + count; i++) {
+        unsigned int v = (*indices)[i];
+        if (stamp[v] != r) {
+          stamp[v] = r;
+          used[r]++;
+        }
+      }
+    }
+    if (used[r] > kWindow) {
+      return false;
+    }
+  }
 
-    N[0] /= len;
-    N[1] /= len;
-    N[2] /= len;
+  std::vector<float> out;
+  out.reserve(vertices->size());
+  std::vector<long> placed(numVertices, -1);
+  long outCount = 0;
+  for (size_t k = 0; k < order.size(); k++) {
+    DrawRange& range = (*ranges)[order[k]];
+    long window = std::max(0L, outCount + used[order[k]] - kWindow);
+    long lo = outCount;
+    for (int l = 0; l <= range.num_lods; l++) {
+      int first = l == 0 ? range.first : range.lods[l - 1].first;
+      int count = l == 0 ? range.count : range.lods[l - 1].count;
+      for (int i = first; i < first + count; i++) {
+        unsigned int v = (*indices)[i];
+        if (placed[v] < window) {
+          placed[v] = outCount++;
+          out.insert(out.end(), vertices->begin() + v * stride,
+                     vertices->begin() + (v + 1) * stride);
+        }
+        (*indices)[i] = static_cast<unsigned int>(placed[v]);
+        lo = std::min(lo, placed[v]);
+      }
+    }
+    range.base_vertex = range.count > 0 ? static_cast<int>(lo) : 0;
   }
+  vertices->swap(out);
+  return true;
 }
 
-namespace  // Local utility functions
-{
-struct vec3 {
-  float v[3];
-  vec3() {
-    v[0] = 0.0f;
-    v[1] = 0.0f;
-    v[2] = 0.0f;
+// Pack `indices` into `packed` as 16-bit indices whenever the shape is small
+// enough, and as 32-bit indices otherwise. With `rebase`, larger shapes
+// still get 16-bit indices, stored relative to the base vertex of each
+// range, after windowRanges() made every range fit.
+GLenum packIndices(std::vector<unsigned int>& indices,
+                   std::vector<float>* vertices, int* numVertices,
+                   bool rebase, std::vector<DrawRange>* ranges,
+                   std::vector<unsigned char>& packed) {
+  if (*numVertices <= 65536) {
+    packed.resize(indices.size() * sizeof(GLushort));
+    GLushort* dst = reinterpret_cast<GLushort*>(packed.data());
+    for (size_t i = 0; i < indices.size(); i++) {
+      dst[i] = static_cast<GLushort>(indices[i]);
+    }
+    return GL_UNSIGNED_SHORT;
   }
-};
+  if (rebase && windowRanges(vertices, kVertexStride, &indices, ranges)) {
+    *numVertices = vertices->size() / kVertexStride;
+    // The ranges and their levels cover every index exactly once.
+    packed.resize(indices.size() * sizeof(GLushort));
+    GLushort* dst = reinterpret_cast<GLushort*>(packed.data());
+    for (size_t r = 0; r < ranges->size(); r++) {
+      const DrawRange& range = (*ranges)[r];
+      for (int l = 0; l <= range.num_lods; l++) {
+        int first = l == 0 ? range.first : range.lods[l - 1].first;
+        int count = l == 0 ? range.count : range.lods[l - 1].count;
+        for (int i = first; i < first + count; i++) {
+          dst[i] = static_cast<GLushort>(indices[i] - range.base_vertex);
+        }
+      }
+    }
+    return GL_UNSIGNED_SHORT;
+  }
+  packed.resize(indices.size() * sizeof(GLuint));
+  memcpy(packed.data(), indices.data(), packed.size());
+  return GL_UNSIGNED_INT;
+}
 
-void normalizeVector(vec3& v) {
-  float len2 = v.v[0] * v.v[0] + v.v[1] * v.v[1] + v.v[2] * v.v[2];
-  if (len2 > 0.0f) {
-    float len = sqrtf(len2);
+// Parse `filename` with the selected parser.
+bool parseObj(ObjParser parser, tinyobj::attrib_t* attrib,
+              std::vector<tinyobj::shape_t>* shapes,
+              std::vector<tinyobj::material_t>* materials, std::string* warn,
+              std::string* err, const char* filename,
+              const std::string& base_dir) {
+  PROFILE_ZONE("parse");
+  if (parser == kParserParallel) {
+    return LoadObjParallel(attrib, shapes, materials, warn, err, filename,
+                           base_dir.c_str());
+  }
+  return tinyobj::LoadObj(attrib, shapes, materials, warn, err, filename,
+                          base_dir.c_str());
+}
 
-    v.v[0] /= len;
-    v.v[1] /= len;
-    v.v[2] /= len;
+// Faces per culling cluster. Material runs above this are split.
+const size_t kClusterFaces = 2048;
+
+// Median split of `faces` along the longest axis of their centroids until
+// each part has at most kClusterFaces faces. Emits one range per part, in
+// order, starting at face position `first`.
+void splitCluster(const std::vector<float>& centroids, unsigned int* faces,
+                  size_t count, size_t first, size_t material_id,
+                  std::vector<DrawRange>* ranges) {
+  if (count <= kClusterFaces) {
+    DrawRange r;
+    r.material_id = material_id;
+    r.first = 3 * first;
+    r.count = 3 * count;
+    r.base_vertex = 0;
+    r.num_lods = 0;
+    ranges->push_back(r);
+    return;
   }
+  Bounds b;
+  for (size_t i = 0; i < count; i++) {
+    const float* c = &centroids[3 * faces[i]];
+    for (int k = 0; k < 3; k++) {
+      b.bmin[k] = std::min(b.bmin[k], c[k]);
+      b.bmax[k] = std::max(b.bmax[k], c[k]);
+    }
+  }
+  int axis = 0;
+  for (int k = 1; k < 3; k++) {
+    if (b.bmax[k] - b.bmin[k] > b.bmax[axis] - b.bmin[axis]) {
+      axis = k;
+    }
+  }
+  size_t half = count / 2;
+  std::nth_element(faces, faces + half, faces + count,
+                   [&](unsigned int a, unsigned int c) {
+                     return centroids[3 * a + axis] < centroids[3 * c + axis];
+                   });
+  splitCluster(centroids, faces, half, first, material_id, ranges);
+  splitCluster(centroids, faces + half, count - half, first + half,
+               material_id, ranges);
 }
 
-/*
-  There are 2 approaches here to automatically generating vertex normals. The
-  old approach (computeSmoothingNormals) doesn't handle multiple smoothing
-  groups properly, as it effectively merges all smoothing groups present in the
-  OBJ file into a single group. However, it can be useful when the OBJ file
-  contains vertex normals which you want to use, but is missing some, as it
-  will attempt to fill in the missing normals without generating new shapes.
-
-  The new approach (computeSmoothingShapes, computeAllSmoothingNormals) handles
-  multiple smoothing groups but is a bit more complicated, as handling this
-  correctly requires potentially generating new vertices (and hence shapes).
-  In general, the new approach is most useful if your OBJ file is missing
-  vertex normals entirely, and instead relies on smoothing groups to correctly
-  generate them as a pre-process. That said, it can be used to reliably
-  generate vertex normals in the general case. If you want to always generate
-  normals in this way, simply force set regen_all_normals to true below. By
-  default, it's only true when there are no vertex normals present. One other
-  thing to keep in mind is that the statistics printed apply to the model
-  *prior* to shape regeneration, so you'd need to print them again if you want
-  to see the new statistics.
-
-  TODO(syoyo): import computeSmoothingShapes and computeAllSmoothingNormals to
-  tinyobjloader as utility functions.
-*/
-
-// Check if `mesh_t` contains smoothing group id.
-bool hasSmoothingGroup(const tinyobj::shape_t& shape) {
-  for (size_t i = 0; i < shape.mesh.smoothing_group_ids.size(); i++) {
-    if (shape.mesh.smoothing_group_ids[i] > 0) {
-      return true;
+// Split the material runs of `ranges` into spatially coherent clusters,
+// reordering `faceOrder` to match.
+void clusterFaces(const tinyobj::attrib_t& attrib,
+                  const tinyobj::shape_t& shape,
+                  std::vector<unsigned int>* faceOrder,
+                  std::vector<DrawRange>* ranges) {
+  if (faceOrder->size() <= kClusterFaces) {
+    return;
+  }
+  size_t numFaces = faceOrder->size();
+  std::vector<float> centroids(3 * numFaces);
+  for (size_t f = 0; f < numFaces; f++) {
+    for (int k = 0; k < 3; k++) {
+      float sum = 0.0f;
+      for (int v = 0; v < 3; v++) {
+        sum += attrib.vertices[3 * shape.mesh.indices[3 * f + v].vertex_index +
+                               k];
+      }
+      centroids[3 * f + k] = sum / 3.0f;
     }
   }
-  return false;
+  std::vector<DrawRange> materialRanges;
+  materialRanges.swap(*ranges);
+  for (size_t i = 0; i < materialRanges.size(); i++) {
+    const DrawRange& r = materialRanges[i];
+    splitCluster(centroids, &(*faceOrder)[r.first / 3], r.count / 3,
+                 r.first / 3, r.material_id, ranges);
+  }
 }
 
-void computeSmoothingNormals(const tinyobj::attrib_t& attrib,
-                             const tinyobj::shape_t& shape,
-                             std::map<int, vec3>& smoothVertexNormals) {
-  smoothVertexNormals.clear();
-  std::map<int, vec3>::iterator iter;
+// Build the welded, indexed vertex data of one shape, with its faces grouped
+// by material. The vertices are left as floats in `vertices` for encoding
+// once the quantization is known. Large shapes are split into face ranges
+// that fill disjoint parts of a preallocated buffer. Safe to call from
+// worker threads; nothing here touches GL. The shape's largest triangles are
+// appended to `occluders` as candidates for occlusion culling, and the
+// vertex cache behaviour before and after optimizing to `cacheStats`.
+void convertShape(const tinyobj::attrib_t& attrib,
+                  const tinyobj::shape_t& shape,
+                  const std::vector<tinyobj::material_t>& materials,
+                  bool smoothing, DrawObject* o, ShapeBuffer* sb,
+                  std::vector<float>* vertices, Bounds* bounds,
+                  std::vector<float>* occluders,
+                  VertexCacheStats cacheStats[2]) {
+  PROFILE_ZONE("convert shape");
+  // Check for smoothing group and compute smoothing normals
+  VertexNormals smoothNormals;
+  if (smoothing) {
+    ComputeSmoothingNormals(attrib, shape, smoothNormals);
+  }
+
+  size_t numFaces = shape.mesh.indices.size() / 3;
+  std::vector<unsigned int> faceOrder;
+  {
+    PROFILE_ZONE("cluster faces");
+    SortFacesByMaterial(shape, materials.size(), &faceOrder, &o->ranges);
+    clusterFaces(attrib, shape, &faceOrder, &o->ranges);
+  }
+
+  // pos(3float), normal(3float), color(3float), texcoord(2float)
+  std::vector<float> buffer(numFaces * 3 * kVertexStride);
+  size_t numTasks = (numFaces + kFacesPerTask - 1) / kFacesPerTask;
+  std::vector<Bounds> taskBounds(numTasks);
+  ParallelFor(0, numTasks, 1, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) {
+      ConvertFaces(attrib, shape, materials, smoothNormals, faceOrder,
+                   t * kFacesPerTask,
+                   std::min(numFaces, (t + 1) * kFacesPerTask), buffer.data(),
+                   &taskBounds[t]);
+    }
+  });
+  for (size_t t = 0; t < numTasks; t++) {
+    bounds->merge(taskBounds[t]);
+  }
+  ParallelFor(0, o->ranges.size(), 16, [&](size_t begin, size_t end) {
+    for (size_t r = begin; r < end; r++) {
+      RangeBounds(buffer, &o->ranges[r]);
+    }
+  });
+  SelectOccluders(buffer.data(), kVertexStride, numFaces,
+                  kMaxOccluderTriangles, occluders);
+
+  o->vb_id = 0;
+  o->ib_id = 0;
+  o->vao_id = 0;
+  o->instance_vb_id = 0;
+  o->index_type = GL_UNSIGNED_INT;
+  o->numVertices = 0;
+  o->numTriangles = 0;
+  o->vertex_format = kVertexFormatFloat;
+  for (int k = 0; k < 3; k++) {
+    o->position_offset[k] = 0.0f;
+    o->position_scale[k] = 1.0f;
+  }
 
-  for (size_t f = 0; f < shape.mesh.indices.size() / 3; f++) {
-    // Get the three indexes of the face (all faces are triangular)
-    tinyobj::index_t idx0 = shape.mesh.indices[3 * f + 0];
-    tinyobj::index_t idx1 = shape.mesh.indices[3 * f + 1];
-    tinyobj::index_t idx2 = shape.mesh.indices[3 * f + 2];
+  if (buffer.size() > 0) {
+    std::vector<unsigned int> indices;
+    {
+      PROFILE_ZONE("weld vertices");
+      weldVertices(buffer, kVertexStride, *vertices, indices);
+    }
+    o->numVertices = vertices->size() / kVertexStride;
+    o->numTriangles = indices.size() / 3;
+    // The simplified levels follow the full detail in the index buffer.
+    {
+      PROFILE_ZONE("build LODs");
+      BuildLods(*vertices, kVertexStride, &indices, &o->ranges);
+    }
 
-    // Get the three vertex indexes and coordinates
-    int vi[3];      // indexes
-    float v[3][3];  // coordinates
+    // Reorder the triangles of each range and level for the vertex cache,
+    // then the vertices in the order the triangles use them.
+    SimulateVertexCache(indices.data(), 3 * o->numTriangles, o->numVertices,
+                        &cacheStats[0]);
+    ParallelFor(0, o->ranges.size(), 4, [&](size_t begin, size_t end) {
+      PROFILE_ZONE("optimize vertex cache");
+      for (size_t r = begin; r < end; r++) {
+        const DrawRange& range = o->ranges[r];
+        OptimizeVertexCache(&indices[range.first], range.count);
+        for (int l = 0; l < range.num_lods; l++) {
+          OptimizeVertexCache(&indices[range.lods[l].first],
+                              range.lods[l].count);
+        }
+      }
+    });
+    OptimizeVertexFetch(vertices, kVertexStride, &indices);
+    SimulateVertexCache(indices.data(), 3 * o->numTriangles, o->numVertices,
+                        &cacheStats[1]);
 
-    for (int k = 0; k < 3; k++) {
-      vi[0] = idx0.vertex_index;
-      vi[1] = idx1.vertex_index;
-      vi[2] = idx2.vertex_index;
-      assert(vi[0] >= 0);
-      assert(vi[1] >= 0);
-      assert(vi[2] >= 0);
-
-      v[0][k] = attrib.vertices[3 * vi[0] + k];
-      v[1][k] = attrib.vertices[3 * vi[1] + k];
-      v[2][k] = attrib.vertices[3 * vi[2] + k];
-    }
-
-    // Compute the normal of the face
-    float normal[3];
-    CalcNormal(normal, v[0], v[1], v[2]);
-
-    // Add the normal to the three vertexes
-    for (size_t i = 0; i < 3; ++i) {
-      iter = smoothVertexNormals.find(vi[i]);
-      if (iter != smoothVertexNormals.end()) {
-        // add
-        iter->second.v[0] += normal[0];
-        iter->second.v[1] += normal[1];
-        iter->second.v[2] += normal[2];
-      } else {
-        smoothVertexNormals[vi[i]].v[0] = normal[0];
-        smoothVertexNormals[vi[i]].v[1] = normal[1];
-        smoothVertexNormals[vi[i]].v[2] = normal[2];
+    o->index_type = packIndices(indices, vertices, &o->numVertices,
+                                g_base_vertex, &o->ranges, sb->indices);
+  }
+}
+
+// Triangles of the whole model at each level of detail. Ranges with fewer
+// levels count with their coarsest one.
+void printLodStats(const std::vector<DrawObject>& objects) {
+  printf("LOD triangles:");
+  for (int l = 0; l <= kMaxLods; l++) {
+    size_t triangles = 0;
+    for (size_t i = 0; i < objects.size(); i++) {
+      for (size_t r = 0; r < objects[i].ranges.size(); r++) {
+        const DrawRange& range = objects[i].ranges[r];
+        int level = std::min(l, range.num_lods);
+        triangles += (level == 0 ? range.count
+                                 : range.lods[level - 1].count) / 3;
       }
     }
+    printf(" %d", (int)triangles);
+  }
+  printf("\n");
+}
 
-  }  // f
-
-  // Normalize the normals, that is, make them unit vectors
-  for (iter = smoothVertexNormals.begin(); iter != smoothVertexNormals.end();
-       iter++) {
-    normalizeVector(iter->second);
+// ACMR and ATVR of the whole model before and after reordering, from
+// before/after pairs of per-shape statistics.
+void printCacheStats(const std::vector<VertexCacheStats>& shapeStats) {
+  VertexCacheStats total[2] = {{0, 0, 0}, {0, 0, 0}};
+  for (size_t i = 0; i < shapeStats.size(); i++) {
+    VertexCacheStats& t = total[i % 2];
+    t.triangles += shapeStats[i].triangles;
+    t.vertices += shapeStats[i].vertices;
+    t.misses += shapeStats[i].misses;
+  }
+  if (total[0].triangles == 0) {
+    return;
   }
+  printf("Vertex cache (%d entry FIFO): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+         (int)kVertexCacheSize,
+         double(total[0].misses) / total[0].triangles,
+         double(total[1].misses) / total[1].triangles,
+         double(total[0].misses) / total[0].vertices,
+         double(total[1].misses) / total[1].vertices);
+}
 
-}  // computeSmoothingNormals
+// Positions of a translated copy may differ from the original by this much,
+// relative to the size of the shape plus a little for its distance from the
+// origin, since OBJ exporters round the moved coordinates. Normals computed
+// from the rounded positions differ more, so the other attributes have an
+// absolute tolerance of their own.
+const float kCopyTolerance = 1e-4f;
+const float kCopyDistanceTolerance = 1e-6f;
+const float kCopyAttributeTolerance = 1e-3f;
+
+// Hash of what translated copies have exactly in common: the ranges and the
+// index data. Shapes that only differ in their vertices collide and are
+// told apart by isTranslatedCopy().
+size_t topologyHash(const DrawObject& o, const ShapeBuffer& sb) {
+  size_t h = static_cast<size_t>(
+      HashBytes(sb.indices.data(), sb.indices.size()));
+  auto mix = [&h](size_t v) { h ^= v + 0x9e3779b9 + (h << 6) + (h >> 2); };
+  mix(o.numVertices);
+  mix(o.index_type);
+  for (size_t r = 0; r < o.ranges.size(); r++) {
+    mix(o.ranges[r].material_id);
+    mix(o.ranges[r].count);
+  }
+  return h;
+}
 
-static void computeAllSmoothingNormals(tinyobj::attrib_t& attrib,
-                                       std::vector<tinyobj::shape_t>& shapes) {
-  vec3 p[3];
-  for (size_t s = 0, slen = shapes.size(); s < slen; ++s) {
-    const tinyobj::shape_t& shape(shapes[s]);
-    size_t facecount = shape.mesh.num_face_vertices.size();
-    assert(shape.mesh.smoothing_group_ids.size());
+bool sameRanges(const DrawObject& a, const DrawObject& b) {
+  if (a.ranges.size() != b.ranges.size()) {
+    return false;
+  }
+  for (size_t r = 0; r < a.ranges.size(); r++) {
+    const DrawRange& ra = a.ranges[r];
+    const DrawRange& rb = b.ranges[r];
+    if (ra.material_id != rb.material_id || ra.first != rb.first ||
+        ra.count != rb.count || ra.base_vertex != rb.base_vertex ||
+        ra.num_lods != rb.num_lods) {
+      return false;
+    }
+    for (int l = 0; l < ra.num_lods; l++) {
+      if (ra.lods[l].first != rb.lods[l].first ||
+          ra.lods[l].count != rb.lods[l].count) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
 
-    for (size_t f = 0, flen = facecount; f < flen; ++f) {
-      for (unsigned int v = 0; v < 3; ++v) {
-        tinyobj::index_t idx = shape.mesh.indices[3 * f + v];
-        assert(idx.vertex_index != -1);
-        p[v].v[0] = attrib.vertices[3 * idx.vertex_index];
-        p[v].v[1] = attrib.vertices[3 * idx.vertex_index + 1];
-        p[v].v[2] = attrib.vertices[3 * idx.vertex_index + 2];
+// True if shape `b` is shape `a` moved by `t`, the offset of their bounding
+// boxes. Both are welded, not yet encoded.
+bool isTranslatedCopy(const DrawObject& a, const ShapeBuffer& sa,
+                      const std::vector<float>& va, const Bounds& ba,
+                      const DrawObject& b, const ShapeBuffer& sb,
+                      const std::vector<float>& vb, const Bounds& bb,
+                      float t[3]) {
+  if (a.numVertices != b.numVertices || a.numTriangles != b.numTriangles ||
+      a.index_type != b.index_type || va.size() != vb.size() ||
+      sa.indices != sb.indices || !sameRanges(a, b)) {
+    return false;
+  }
+  float diagonal = 0.0f, distance = 0.0f;
+  for (int k = 0; k < 3; k++) {
+    float e = ba.bmax[k] - ba.bmin[k];
+    diagonal += e * e;
+    distance = std::max(distance, std::max(std::fabs(bb.bmin[k]),
+                                           std::fabs(bb.bmax[k])));
+    t[k] = bb.bmin[k] - ba.bmin[k];
+  }
+  float tolerance = kCopyTolerance * std::sqrt(diagonal) +
+                    kCopyDistanceTolerance * distance;
+  for (int k = 0; k < 3; k++) {
+    if (std::fabs(bb.bmax[k] - ba.bmax[k] - t[k]) > 2.0f * tolerance) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < va.size(); i += kVertexStride) {
+    for (size_t k = 0; k < 3; k++) {
+      if (std::fabs(vb[i + k] - va[i + k] - t[k]) > tolerance) {
+        return false;
+      }
+    }
+    for (size_t k = 3; k < kVertexStride; k++) {
+      if (std::fabs(vb[i + k] - va[i + k]) > kCopyAttributeTolerance) {
+        return false;
       }
+    }
+  }
+  return true;
+}
 
-      // cross(p[1] - p[0], p[2] - p[0])
-      float nx = (p[1].v[1] - p[0].v[1]) * (p[2].v[2] - p[0].v[2]) -
-                 (p[1].v[2] - p[0].v[2]) * (p[2].v[1] - p[0].v[1]);
-      float ny = (p[1].v[2] - p[0].v[2]) * (p[2].v[0] - p[0].v[0]) -
-                 (p[1].v[0] - p[0].v[0]) * (p[2].v[2] - p[0].v[2]);
-      float nz = (p[1].v[0] - p[0].v[0]) * (p[2].v[1] - p[0].v[1]) -
-                 (p[1].v[1] - p[0].v[1]) * (p[2].v[0] - p[0].v[0]);
-
-      // Don't normalize here.
-      for (unsigned int v = 0; v < 3; ++v) {
-        tinyobj::index_t idx = shape.mesh.indices[3 * f + v];
-        attrib.normals[3 * idx.normal_index] += nx;
-        attrib.normals[3 * idx.normal_index + 1] += ny;
-        attrib.normals[3 * idx.normal_index + 2] += nz;
+// Find shapes that are translated copies of an earlier shape. The first
+// copy keeps its geometry and gets one instance per copy, itself included;
+// the others are flagged in `duplicate` for removal. Prints the memory
+// saved per instanced shape.
+void instanceCopies(const std::vector<tinyobj::shape_t>& shapes,
+                    const std::vector<std::vector<float> >& welded,
+                    const std::vector<Bounds>& bounds,
+                    std::vector<DrawObject>* objects,
+                    const std::vector<ShapeBuffer>& shapeBuffers,
+                    std::vector<char>* duplicate) {
+  PROFILE_ZONE("instance copies");
+  duplicate->assign(objects->size(), 0);
+  std::unordered_multimap<size_t, size_t> originals;
+  std::vector<int> copies(objects->size(), 0);
+  for (size_t s = 0; s < objects->size(); s++) {
+    DrawObject& o = (*objects)[s];
+    if (o.numTriangles == 0) {
+      continue;
+    }
+    size_t h = topologyHash(o, shapeBuffers[s]);
+    auto candidates = originals.equal_range(h);
+    for (auto it = candidates.first; it != candidates.second; ++it) {
+      size_t a = it->second;
+      DrawObject& original = (*objects)[a];
+      float t[3];
+      if (!isTranslatedCopy(original, shapeBuffers[a], welded[a], bounds[a],
+                            o, shapeBuffers[s], welded[s], bounds[s], t)) {
+        continue;
+      }
+      if (original.instances.empty()) {
+        const float identity[16] = {1, 0, 0, 0, 0, 1, 0, 0,
+                                    0, 0, 1, 0, 0, 0, 0, 1};
+        original.instances.assign(identity, identity + 16);
       }
+      float m[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, t[0], t[1], t[2], 1};
+      original.instances.insert(original.instances.end(), m, m + 16);
+      (*duplicate)[s] = 1;
+      copies[a]++;
+      break;
+    }
+    if (!(*duplicate)[s]) {
+      originals.insert(std::make_pair(h, s));
     }
   }
 
-  assert(attrib.normals.size() % 3 == 0);
-  for (size_t i = 0, nlen = attrib.normals.size() / 3; i < nlen; ++i) {
-    tinyobj::real_t& nx = attrib.normals[3 * i];
-    tinyobj::real_t& ny = attrib.normals[3 * i + 1];
-    tinyobj::real_t& nz = attrib.normals[3 * i + 2];
-    tinyobj::real_t len = sqrtf(nx * nx + ny * ny + nz * nz);
-    tinyobj::real_t scale = len == 0 ? 0 : 1 / len;
-    nx *= scale;
-    ny *= scale;
-    nz *= scale;
+  size_t stride = GetVertexLayout(g_vertex_format).stride;
+  size_t totalSaved = 0;
+  int instanced = 0, removed = 0;
+  for (size_t s = 0; s < objects->size(); s++) {
+    if (copies[s] == 0) {
+      continue;
+    }
+    const DrawObject& o = (*objects)[s];
+    size_t bytes = o.numVertices * stride + shapeBuffers[s].indices.size();
+    // Every copy, the original too, now costs a matrix instead.
+    size_t matrices = o.instances.size() * sizeof(float);
+    size_t saved = copies[s] * bytes > matrices ? copies[s] * bytes - matrices
+                                                : 0;
+    printf("Instanced shape[%d] %s: %d copies, %d [KB] saved\n", int(s),
+           shapes[s].name.c_str(), copies[s] + 1, (int)(saved / 1024));
+    totalSaved += saved;
+    instanced++;
+    removed += copies[s];
+  }
+  if (instanced > 0) {
+    printf("Instancing: %d shapes drawn as copies of %d, %d [KB] saved\n",
+           instanced + removed, instanced, (int)(totalSaved / 1024));
   }
 }
 
-static void computeSmoothingShape(
-    tinyobj::attrib_t& inattrib, tinyobj::shape_t& inshape,
-    std::vector<std::pair<unsigned int, unsigned int> >& sortedids,
-    unsigned int idbegin, unsigned int idend,
-    std::vector<tinyobj::shape_t>& outshapes, tinyobj::attrib_t& outattrib) {
-  unsigned int sgroupid = sortedids[idbegin].first;
-  bool hasmaterials = inshape.mesh.material_ids.size();
-  // Make a new shape from the set of faces in the range [idbegin, idend).
-  outshapes.emplace_back();
-  tinyobj::shape_t& outshape = outshapes.back();
-  outshape.name = inshape.name;
-  // Skip lines and points.
-
-  std::unordered_map<unsigned int, unsigned int> remap;
-  for (unsigned int id = idbegin; id < idend; ++id) {
-    unsigned int face = sortedids[id].second;
-
-    outshape.mesh.num_face_vertices.push_back(3);  // always triangles
-    if (hasmaterials)
-      outshape.mesh.material_ids.push_back(inshape.mesh.material_ids[face]);
-    outshape.mesh.smoothing_group_ids.push_back(sgroupid);
-    // Skip tags.
-
-    for (unsigned int v = 0; v < 3; ++v) {
-      tinyobj::index_t inidx = inshape.mesh.indices[3 * face + v], outidx;
-      assert(inidx.vertex_index != -1);
-      auto iter = remap.find(inidx.vertex_index);
-      // Smooth group 0 disables smoothing so no shared vertices in that case.
-      if (sgroupid && iter != remap.end()) {
-        outidx.vertex_index = (*iter).second;
-        outidx.normal_index = outidx.vertex_index;
-        outidx.texcoord_index =
-            (inidx.texcoord_index == -1) ? -1 : outidx.vertex_index;
-      } else {
-        assert(outattrib.vertices.size() % 3 == 0);
-        unsigned int offset =
-            static_cast<unsigned int>(outattrib.vertices.size() / 3);
-        outidx.vertex_index = outidx.normal_index = offset;
-        outidx.texcoord_index = (inidx.texcoord_index == -1) ? -1 : offset;
-        outattrib.vertices.push_back(inattrib.vertices[3 * inidx.vertex_index]);
-        outattrib.vertices.push_back(
-            inattrib.vertices[3 * inidx.vertex_index + 1]);
-        outattrib.vertices.push_back(
-            inattrib.vertices[3 * inidx.vertex_index + 2]);
-        outattrib.normals.push_back(0.0f);
-        outattrib.normals.push_back(0.0f);
-        outattrib.normals.push_back(0.0f);
-        if (inidx.texcoord_index != -1) {
-          outattrib.texcoords.push_back(
-              inattrib.texcoords[2 * inidx.texcoord_index]);
-          outattrib.texcoords.push_back(
-              inattrib.texcoords[2 * inidx.texcoord_index + 1]);
-        }
-        remap[inidx.vertex_index] = offset;
+void printDrawStats(const char* label, const std::vector<DrawObject>& objects,
+                    const std::vector<tinyobj::material_t>& materials,
+                    const std::map<std::string, GLuint>& textures) {
+  std::vector<DrawBatch> batches;
+  BuildDrawBatches(objects, materials, textures, &batches);
+  DrawStats stats = CountDrawStats(batches);
+  printf("%s: %d draw calls, %d buffer binds, %d texture binds\n", label,
+         stats.drawCalls, stats.bufferBinds, stats.textureBinds);
+}
+
+// Limits of one page of a paged model: 16-bit indices, and few
+// enough triangles that a page streams in within a frame or two.
+const size_t kPageVertices = 65536;
+const size_t kPageTriangles = 32768;
+
+// Triangles of a bin of a model that is paged out of core; see FaceBins.
+// A few pages' worth, so pages still cluster well.
+const size_t kBinTriangles = 4 * kPageTriangles;
+
+// Vertex of index `i` of `range` in a packed index buffer.
+unsigned int unpackIndex(const DrawObject& o, const ShapeBuffer& sb,
+                         const DrawRange& range, int i) {
+  if (o.index_type == GL_UNSIGNED_SHORT) {
+    GLushort v;
+    memcpy(&v, &sb.indices[i * sizeof(v)], sizeof(v));
+    return v + range.base_vertex;
+  }
+  GLuint v;
+  memcpy(&v, &sb.indices[i * sizeof(v)], sizeof(v));
+  return v + range.base_vertex;
+}
+
+// Number the vertices of `range` and its levels that are new to the page.
+// Fails, leaving the page as it was, if they do not fit.
+bool addRangeVertices(const DrawObject& o, const ShapeBuffer& sb,
+                      const DrawRange& range, std::vector<int>* local,
+                      std::vector<unsigned int>* pageVertices) {
+  size_t before = pageVertices->size();
+  for (int l = 0; l <= range.num_lods; l++) {
+    int first = l == 0 ? range.first : range.lods[l - 1].first;
+    int count = l == 0 ? range.count : range.lods[l - 1].count;
+    for (int i = first; i < first + count; i++) {
+      unsigned int v = unpackIndex(o, sb, range, i);
+      if ((*local)[v] < 0) {
+        (*local)[v] = pageVertices->size();
+        pageVertices->push_back(v);
       }
-      outshape.mesh.indices.push_back(outidx);
     }
   }
+  if (pageVertices->size() <= kPageVertices) {
+    return true;
+  }
+  for (size_t i = before; i < pageVertices->size(); i++) {
+    (*local)[(*pageVertices)[i]] = -1;
+  }
+  pageVertices->resize(before);
+  return false;
 }
 
-static void computeSmoothingShapes(tinyobj::attrib_t& inattrib,
-                                   std::vector<tinyobj::shape_t>& inshapes,
-                                   std::vector<tinyobj::shape_t>& outshapes,
-                                   tinyobj::attrib_t& outattrib) {
-  for (size_t s = 0, slen = inshapes.size(); s < slen; ++s) {
-    tinyobj::shape_t& inshape = inshapes[s];
-
-    unsigned int numfaces =
-        static_cast<unsigned int>(inshape.mesh.smoothing_group_ids.size());
-    assert(numfaces);
-    std::vector<std::pair<unsigned int, unsigned int> > sortedids(numfaces);
-    for (unsigned int i = 0; i < numfaces; ++i)
-      sortedids[i] = std::make_pair(inshape.mesh.smoothing_group_ids[i], i);
-    sort(sortedids.begin(), sortedids.end());
-
-    unsigned int activeid = sortedids[0].first;
-    unsigned int id = activeid, idbegin = 0, idend = 0;
-    // Faces are now bundled by smoothing group id, create shapes from these.
-    while (idbegin < numfaces) {
-      while (activeid == id && ++idend < numfaces) id = sortedids[idend].first;
-      computeSmoothingShape(inattrib, inshape, sortedids, idbegin, idend,
-                            outshapes, outattrib);
-      activeid = id;
-      idbegin = idend;
+// Split a converted shape into pages of consecutive ranges, which are
+// spatial clusters of one material, and append them to `writer`. Each page
+// gets its own vertices, quantization and 16-bit indices.
+bool writePages(const DrawObject& o, const ShapeBuffer& sb,
+                const std::vector<float>& vertices, PageFileWriter* writer) {
+  std::vector<int> local(o.numVertices, -1);
+  size_t r = 0;
+  while (r < o.ranges.size()) {
+    std::vector<unsigned int> pageVertices;
+    size_t end = r;
+    int triangles = 0;
+    while (end < o.ranges.size() &&
+           (end == r ||
+            size_t(triangles + o.ranges[end].count / 3) <= kPageTriangles) &&
+           addRangeVertices(o, sb, o.ranges[end], &local, &pageVertices)) {
+      triangles += o.ranges[end].count / 3;
+      end++;
+    }
+    assert(end > r);
+
+    DrawObject p = o;
+    p.ranges.assign(o.ranges.begin() + r, o.ranges.begin() + end);
+    p.index_type = GL_UNSIGNED_SHORT;
+    p.numVertices = pageVertices.size();
+    p.numTriangles = triangles;
+    p.vertex_format = g_vertex_format;
+
+    // Full detail of every range first, then the levels, as BuildLods does.
+    std::vector<GLushort> indices;
+    auto append = [&](const DrawRange& range, int first, int count) {
+      int start = indices.size();
+      for (int i = first; i < first + count; i++) {
+        indices.push_back(local[unpackIndex(o, sb, range, i)]);
+      }
+      return start;
+    };
+    for (size_t j = 0; j < p.ranges.size(); j++) {
+      DrawRange& range = p.ranges[j];
+      range.first = append(o.ranges[r + j], range.first, range.count);
+    }
+    for (int l = 0; l < kMaxLods; l++) {
+      for (size_t j = 0; j < p.ranges.size(); j++) {
+        DrawRange& range = p.ranges[j];
+        if (l < range.num_lods) {
+          range.lods[l].first = append(o.ranges[r + j], range.lods[l].first,
+                                       range.lods[l].count);
+        }
+      }
+    }
+    for (size_t j = 0; j < p.ranges.size(); j++) {
+      p.ranges[j].base_vertex = 0;
+    }
+
+    std::vector<float> pageFloats(pageVertices.size() * kVertexStride);
+    for (size_t i = 0; i < pageVertices.size(); i++) {
+      memcpy(&pageFloats[i * kVertexStride],
+             &vertices[pageVertices[i] * kVertexStride],
+             kVertexStride * sizeof(float));
+      local[pageVertices[i]] = -1;
     }
+    if (p.vertex_format == kVertexFormatCompact) {
+      ComputePositionQuantization(pageFloats, p.position_offset,
+                                  p.position_scale);
+    }
+    ShapeBuffer pb;
+    EncodeVertices(p.vertex_format, pageFloats, p.position_offset,
+                   p.position_scale, &pb.vertices);
+    pb.indices.resize(indices.size() * sizeof(GLushort));
+    memcpy(pb.indices.data(), indices.data(), pb.indices.size());
+    if (!writer->addPage(p, pb)) {
+      return false;
+    }
+    r = end;
   }
+  return true;
 }
 
+// Convert `filename` into the page file `page_filename` out of core. The
+// OBJ is binned spatially on disk by FaceBins, and every bin is smoothed,
+// converted and written on its own, so only one bin is in memory at a
+// time, never the model.
+bool buildPageFile(const std::string& page_filename, const char* filename,
+                   const std::string& base_dir) {
+  std::vector<tinyobj::material_t> materials;
+  std::string warn;
+  std::string err;
+  Stopwatch tm;
+  tm.start();
+  FaceBins bins;
+  bool ret = bins.build(filename, base_dir.c_str(), page_filename,
+                        kBinTriangles, &materials, &warn, &err);
+  if (!warn.empty()) {
+    std::cout << "WARN: " << warn << std::endl;
+  }
+  if (!err.empty()) {
+    std::cerr << err << std::endl;
+  }
+  tm.end();
+  if (!ret) {
+    std::cerr << "Failed to load " << filename << std::endl;
+    return false;
+  }
+  printf("Binning time: %d [ms], %d bins\n", (int)tm.msec(),
+         (int)bins.numBins());
+  g_load_times.parse_ms = tm.msec();
+
+  // Append `default` material
+  materials.push_back(tinyobj::material_t());
+  ResolveTextureNames(base_dir, &materials);
+
+  tm.start();
+  PageFileWriter writer;
+  if (!writer.open(page_filename)) {
+    std::cerr << "Unable to write page file: " << page_filename << std::endl;
+    return false;
+  }
+  Bounds bounds;
+  std::vector<float> candidates;
+  std::vector<VertexCacheStats> cacheStats;
+  bool ok = true;
+  for (size_t b = 0; b < bins.numBins() && ok; b++) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<unsigned int> shapeIds;
+    std::vector<size_t> numOwned;
+    if (!bins.readBin(b, &attrib, &shapes, &shapeIds, &numOwned)) {
+      ok = false;
+      break;
+    }
+    // Once the normals are smoothed per shape, the halo of the bin is
+    // dropped and the rest converted as one shape.
+    tinyobj::shape_t bin;
+    tinyobj::mesh_t& mesh = bin.mesh;
+    for (size_t s = 0; s < shapes.size(); s++) {
+      if (!bins.hasNormals() || bins.hasSmoothingGroup(shapeIds[s])) {
+        BakeSmoothingNormals(attrib, shapes[s], !bins.hasNormals());
+      }
+      const tinyobj::mesh_t& in = shapes[s].mesh;
+      size_t n = numOwned[s];
+      mesh.indices.insert(mesh.indices.end(), in.indices.begin(),
+                          in.indices.begin() + 3 * n);
+      mesh.num_face_vertices.insert(mesh.num_face_vertices.end(), n, 3);
+      mesh.material_ids.insert(mesh.material_ids.end(),
+                               in.material_ids.begin(),
+                               in.material_ids.begin() + n);
+      mesh.smoothing_group_ids.insert(mesh.smoothing_group_ids.end(),
+                                      in.smoothing_group_ids.begin(),
+                                      in.smoothing_group_ids.begin() + n);
+      shapes[s] = tinyobj::shape_t();
+    }
+
+    DrawObject o;
+    ShapeBuffer sb;
+    std::vector<float> welded;
+    Bounds binBounds;
+    std::vector<float> binOccluders;
+    cacheStats.resize(cacheStats.size() + 2, VertexCacheStats{0, 0, 0});
+    convertShape(attrib, bin, materials, false, &o, &sb, &welded, &binBounds,
+                 &binOccluders, &cacheStats[cacheStats.size() - 2]);
+    bounds.merge(binBounds);
+    candidates.insert(candidates.end(), binOccluders.begin(),
+                      binOccluders.end());
+    ok = o.numTriangles == 0 || writePages(o, sb, welded, &writer);
+  }
+  std::vector<float> occluders;
+  SelectOccluders(candidates.data(), 3, candidates.size() / 9,
+                  kMaxOccluderTriangles, &occluders);
+  if (!ok || !writer.finish(filename, g_angle_weighted_normals, bounds.bmin,
+                            bounds.bmax, occluders, materials)) {
+    std::cerr << "Unable to write page file: " << page_filename << std::endl;
+    return false;
+  }
+  tm.end();
+  printf("Paging time: %d [ms], %d pages\n", (int)tm.msec(),
+         (int)writer.numPages());
+  g_load_times.convert_ms = tm.msec();
+  printCacheStats(cacheStats);
+  return true;
+}
 }  // namespace
 
-bool LoadObjAndConvert(float bmin[3], float bmax[3],
-                       std::vector<DrawObject>* drawObjects,
-                       std::vector<tinyobj::material_t>& materials,
-                       std::map<std::string, GLuint>& textures,
-                       const char* filename) {
+void UploadDrawObject(DrawObject* o, const void* vertices, size_t vertexBytes,
+                      const void* indices, size_t indexBytes) {
+  PROFILE_ZONE("upload");
+  glGenBuffers(1, &o->vb_id);
+  glBindBuffer(GL_ARRAY_BUFFER, o->vb_id);
+  glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices, GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glGenBuffers(1, &o->ib_id);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, o->ib_id);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void BufferInstances(const std::vector<float>& instances) {
+  size_t numCopies = instances.size() / 16;
+  std::vector<float> data(numCopies * kInstanceBufferFloats);
+  for (size_t i = 0; i < numCopies; i++) {
+    float* d = &data[i * kInstanceBufferFloats];
+    memcpy(d, &instances[16 * i], 16 * sizeof(float));
+    NormalMatrix(&instances[16 * i], d + 16);
+  }
+  glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(),
+               GL_STATIC_DRAW);
+}
+
+void UploadInstances(DrawObject* o) {
+  if (o->instances.empty()) {
+    return;
+  }
+  if (o->instance_vb_id == 0) {
+    glGenBuffers(1, &o->instance_vb_id);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, o->instance_vb_id);
+  BufferInstances(o->instances);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool ReadObjGeometry(const char* filename, TextureLoader* textureLoader,
+                     const std::map<std::string, GLuint>& textures,
+                     ObjGeometry* g) {
   tinyobj::attrib_t inattrib;
   std::vector<tinyobj::shape_t> inshapes;
+  std::vector<tinyobj::material_t>& materials = g->materials;
+  g->filename = filename;
+  g->cached = false;
+  g->parse_ms = g->convert_ms = g->upload_ms = 0.0;
 
-  timerutil tm;
+  Stopwatch tm;
 
   tm.start();
 
@@ -324,10 +899,33 @@ bool LoadObjAndConvert(float bmin[3], float bmax[3],
   base_dir += "/";
 #endif
 
+  // Skip parsing entirely when an up-to-date mesh cache exists.
+  std::string cache_filename = MeshCacheFilename(filename);
+  if (g_use_mesh_cache) {
+    if (g->cache.open(cache_filename) &&
+        ReadMeshCache(g->cache, filename, g_vertex_format, g_merge_draws,
+                      g_instance_shapes, g_angle_weighted_normals,
+                      g_base_vertex, g->bmin, g->bmax, &g->occluders,
+                      &g->objects, materials, &g->cachedShapes)) {
+      textureLoader->start(materials, textures);
+      tm.end();
+      g->cached = true;
+      printf("Read mesh cache %s in %d [ms]\n", cache_filename.c_str(),
+             (int)tm.msec());
+      printf("# of shapes    = %d\n", (int)g->objects.size());
+      return true;
+    }
+    g->cache.close();
+    g->occluders.clear();
+    g->objects.clear();
+    g->cachedShapes.clear();
+    materials.clear();
+  }
+
   std::string warn;
   std::string err;
-  bool ret = tinyobj::LoadObj(&inattrib, &inshapes, &materials, &warn, &err,
-                              filename, base_dir.c_str());
+  bool ret = parseObj(g_obj_parser, &inattrib, &inshapes, &materials, &warn,
+                      &err, filename, base_dir);
   if (!warn.empty()) {
     std::cout << "WARN: " << warn << std::endl;
   }
@@ -342,7 +940,35 @@ bool LoadObjAndConvert(float bmin[3], float bmax[3],
     return false;
   }
 
-  printf("Parsing time: %d [ms]\n", (int)tm.msec());
+  printf("Parsing time: %d [ms] (%s)\n", (int)tm.msec(),
+         g_obj_parser == kParserParallel ? "parallel" : "tinyobj");
+  g->parse_ms = tm.msec();
+
+  if (g_verify_parser) {
+    // Parse again with the other parser and make sure both agree.
+    ObjParser other =
+        g_obj_parser == kParserParallel ? kParserTinyObj : kParserParallel;
+    tinyobj::attrib_t checkattrib;
+    std::vector<tinyobj::shape_t> checkshapes;
+    std::vector<tinyobj::material_t> checkmaterials;
+    std::string checkwarn, checkerr, diff;
+    tm.start();
+    bool checkret = parseObj(other, &checkattrib, &checkshapes,
+                             &checkmaterials, &checkwarn, &checkerr, filename,
+                             base_dir);
+    tm.end();
+    printf("Parsing time: %d [ms] (%s)\n", (int)tm.msec(),
+           other == kParserParallel ? "parallel" : "tinyobj");
+    if (!checkret) {
+      std::cerr << "Parser check: the other parser failed: " << checkerr
+                << std::endl;
+    } else if (!CompareObjData(inattrib, inshapes, materials, checkattrib,
+                               checkshapes, checkmaterials, &diff)) {
+      std::cerr << "Parser check: outputs differ: " << diff << std::endl;
+    } else {
+      printf("Parser check: outputs are identical\n");
+    }
+  }
 
   printf("# of vertices  = %d\n", (int)(inattrib.vertices.size()) / 3);
   printf("# of normals   = %d\n", (int)(inattrib.normals.size()) / 3);
@@ -352,294 +978,299 @@ bool LoadObjAndConvert(float bmin[3], float bmax[3],
 
   // Append `default` material
   materials.push_back(tinyobj::material_t());
+  ResolveTextureNames(base_dir, &materials);
 
   for (size_t i = 0; i < materials.size(); i++) {
     printf("material[%d].diffuse_texname = %s\n", int(i),
            materials[i].diffuse_texname.c_str());
   }
 
-  // Load diffuse textures
-  {
-    for (size_t m = 0; m < materials.size(); m++) {
-      tinyobj::material_t* mp = &materials[m];
-
-      if (mp->diffuse_texname.length() > 0) {
-        // Only load the texture if it is not already loaded
-        if (textures.find(mp->diffuse_texname) == textures.end()) {
-          GLuint texture_id;
-          int w, h;
-          int comp;
-
-          std::string texture_filename = mp->diffuse_texname;
-          if (!FileExists(texture_filename)) {
-            // Append base dir.
-            texture_filename = base_dir + mp->diffuse_texname;
-            if (!FileExists(texture_filename)) {
-              std::cerr << "Unable to find file: " << mp->diffuse_texname
-                        << std::endl;
-              exit(1);
-            }
-          }
-
-          unsigned char* image =
-              stbi_load(texture_filename.c_str(), &w, &h, &comp, STBI_default);
-          if (!image) {
-            std::cerr << "Unable to load texture: " << texture_filename
-                      << std::endl;
-            exit(1);
-          }
-          std::cout << "Loaded texture: " << texture_filename << ", w = " << w
-                    << ", h = " << h << ", comp = " << comp << std::endl;
-
-          glGenTextures(1, &texture_id);
-          glBindTexture(GL_TEXTURE_2D, texture_id);
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-          if (comp == 3) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB,
-                         GL_UNSIGNED_BYTE, image);
-          } else if (comp == 4) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA,
-                         GL_UNSIGNED_BYTE, image);
-          } else {
-            assert(0);  // TODO
-          }
-          glBindTexture(GL_TEXTURE_2D, 0);
-          stbi_image_free(image);
-          textures.insert(std::make_pair(mp->diffuse_texname, texture_id));
-        }
-      }
-    }
-  }
-
-  bmin[0] = bmin[1] = bmin[2] = std::numeric_limits<float>::max();
-  bmax[0] = bmax[1] = bmax[2] = -std::numeric_limits<float>::max();
+  // Decode textures on the worker pool while the geometry is converted.
+  textureLoader->start(materials, textures);
 
   bool regen_all_normals = inattrib.normals.size() == 0;
   tinyobj::attrib_t outattrib;
   std::vector<tinyobj::shape_t> outshapes;
   if (regen_all_normals) {
-    computeSmoothingShapes(inattrib, inshapes, outshapes, outattrib);
-    computeAllSmoothingNormals(outattrib, outshapes);
+    ComputeSmoothingShapes(inattrib, inshapes, outshapes, outattrib);
+    ComputeAllSmoothingNormals(outattrib, outshapes);
   }
 
   std::vector<tinyobj::shape_t>& shapes =
       regen_all_normals ? outshapes : inshapes;
   tinyobj::attrib_t& attrib = regen_all_normals ? outattrib : inattrib;
 
-  {
-    for (size_t s = 0; s < shapes.size(); s++) {
-      DrawObject o;
-      std::vector<float> buffer;  // pos(3float), normal(3float), color(3float)
-
-      // Check for smoothing group and compute smoothing normals
-      std::map<int, vec3> smoothVertexNormals;
-      if (!regen_all_normals && (hasSmoothingGroup(shapes[s]) > 0)) {
-        std::cout << "Compute smoothingNormal for shape [" << s << "]"
-                  << std::endl;
-        computeSmoothingNormals(attrib, shapes[s], smoothVertexNormals);
+  // Assemble every shape on the worker pool. Each shape fills its own slot,
+  // so the only shared result is the bounding box, which is merged from
+  // per-shape boxes afterwards. GL uploads stay on this thread.
+  std::vector<DrawObject>& objects = g->objects;
+  std::vector<ShapeBuffer>& shapeBuffers = g->shapeBuffers;
+  objects.resize(shapes.size());
+  shapeBuffers.resize(shapes.size());
+  std::vector<std::vector<float> > welded(shapes.size());
+  std::vector<Bounds> shapeBounds(shapes.size());
+  std::vector<std::vector<float> > shapeOccluders(shapes.size());
+  // Before and after the vertex cache optimization.
+  std::vector<VertexCacheStats> cacheStats(2 * shapes.size(),
+                                           VertexCacheStats{0, 0, 0});
+  std::vector<char> smoothed(shapes.size(), 0);
+  tm.start();
+  ParallelFor(0, shapes.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t s = begin; s < end; s++) {
+      smoothed[s] = !regen_all_normals && HasSmoothingGroup(shapes[s]);
+      convertShape(attrib, shapes[s], materials, smoothed[s], &objects[s],
+                   &shapeBuffers[s], &welded[s], &shapeBounds[s],
+                   &shapeOccluders[s], &cacheStats[2 * s]);
+    }
+  });
+
+  Bounds bounds;
+  std::vector<float> candidates;
+  for (size_t s = 0; s < shapes.size(); s++) {
+    bounds.merge(shapeBounds[s]);
+    candidates.insert(candidates.end(), shapeOccluders[s].begin(),
+                      shapeOccluders[s].end());
+  }
+  // Keep the largest triangles of the whole model as occluders.
+  SelectOccluders(candidates.data(), 3, candidates.size() / 9,
+                  kMaxOccluderTriangles, &g->occluders);
+
+  // Keep one buffer for shapes repeated at different positions. The copies
+  // stay occluder candidates above.
+  std::vector<char> duplicate(shapes.size(), 0);
+  if (g_instance_shapes) {
+    instanceCopies(shapes, welded, shapeBounds, &objects, shapeBuffers,
+                   &duplicate);
+  }
+
+  // Encode the vertices. Merged shapes share one buffer, so they are all
+  // quantized against the bounding box of the whole model.
+  ParallelFor(0, shapes.size(), 1, [&](size_t begin, size_t end) {
+    PROFILE_ZONE("encode vertices");
+    for (size_t s = begin; s < end; s++) {
+      if (duplicate[s]) {
+        continue;
+      }
+      DrawObject& o = objects[s];
+      o.vertex_format = g_vertex_format;
+      if (g_vertex_format == kVertexFormatCompact) {
+        if (g_merge_draws) {
+          QuantizationFromBounds(bounds.bmin, bounds.bmax, o.position_offset,
+                                 o.position_scale);
+        } else {
+          ComputePositionQuantization(welded[s], o.position_offset,
+                                      o.position_scale);
+        }
+      }
+      EncodeVertices(g_vertex_format, welded[s], o.position_offset,
+                     o.position_scale, &shapeBuffers[s].vertices);
+      std::vector<float>().swap(welded[s]);
+    }
+  });
+  tm.end();
+
+  size_t vertexBytes = 0;
+  for (size_t s = 0; s < shapes.size(); s++) {
+    vertexBytes += shapeBuffers[s].vertices.size();
+    const DrawObject& o = objects[s];
+    if (smoothed[s]) {
+      std::cout << "Compute smoothingNormal for shape [" << s << "]"
+                << std::endl;
+    }
+    for (size_t r = 0; r < o.ranges.size(); r++) {
+      printf("shape[%d] material_id %d: %d triangles\n", int(s),
+             int(o.ranges[r].material_id), o.ranges[r].count / 3);
+    }
+    if (o.numTriangles > 0) {
+      printf("shape[%d] # of triangles = %d\n", static_cast<int>(s),
+             o.numTriangles);
+      printf("shape[%d] # of vertices = %d (welded from %d)\n",
+             static_cast<int>(s), o.numVertices, 3 * o.numTriangles);
+    }
+  }
+  for (int k = 0; k < 3; k++) {
+    g->bmin[k] = bounds.bmin[k];
+    g->bmax[k] = bounds.bmax[k];
+  }
+  printf("Conversion time: %d [ms] (%u threads)\n", (int)tm.msec(),
+         NumWorkerThreads());
+  g->convert_ms = tm.msec();
+  printf("Occluders: %d triangles\n", (int)(g->occluders.size() / 9));
+  printf("Vertex data: %d [KB] (%s, %d bytes per vertex)\n",
+         (int)(vertexBytes / 1024),
+         g_vertex_format == kVertexFormatCompact ? "compact" : "float",
+         (int)GetVertexLayout(g_vertex_format).stride);
+  printLodStats(objects);
+  printCacheStats(cacheStats);
+
+  size_t kept = 0;
+  for (size_t s = 0; s < shapes.size(); s++) {
+    if (!duplicate[s]) {
+      if (kept != s) {
+        objects[kept] = std::move(objects[s]);
+        shapeBuffers[kept] = std::move(shapeBuffers[s]);
       }
+      kept++;
+    }
+  }
+  objects.resize(kept);
+  shapeBuffers.resize(kept);
+  return true;
+}
 
-      for (size_t f = 0; f < shapes[s].mesh.indices.size() / 3; f++) {
-        tinyobj::index_t idx0 = shapes[s].mesh.indices[3 * f + 0];
-        tinyobj::index_t idx1 = shapes[s].mesh.indices[3 * f + 1];
-        tinyobj::index_t idx2 = shapes[s].mesh.indices[3 * f + 2];
+void UploadObjGeometry(ObjGeometry* g,
+                       const std::map<std::string, GLuint>& textures,
+                       std::vector<DrawObject>* drawObjects) {
+  std::vector<DrawObject>& objects = g->objects;
+  Stopwatch tm;
+  if (g->cached) {
+    tm.start();
+    for (size_t i = 0; i < objects.size(); i++) {
+      const CachedShape& cs = g->cachedShapes[i];
+      if (objects[i].numTriangles > 0) {
+        UploadDrawObject(&objects[i], cs.vertices, cs.vertexBytes,
+                         cs.indices, cs.indexBytes);
+        UploadInstances(&objects[i]);
+      }
+    }
+    tm.end();
+    g->upload_ms = tm.msec();
+    drawObjects->insert(drawObjects->end(), objects.begin(), objects.end());
+    return;
+  }
 
-        int current_material_id = shapes[s].mesh.material_ids[f];
+  const std::vector<tinyobj::material_t>& materials = g->materials;
+  std::vector<ShapeBuffer>& shapeBuffers = g->shapeBuffers;
+  if (g_merge_draws) {
+    printDrawStats("Before merging", objects, materials, textures);
+    {
+      PROFILE_ZONE("merge draws");
+      MergeDrawObjects(&objects, &shapeBuffers);
+    }
+    printDrawStats("After merging", objects, materials, textures);
+  } else {
+    printDrawStats("Drawing", objects, materials, textures);
+  }
 
-        if ((current_material_id < 0) ||
-            (current_material_id >= static_cast<int>(materials.size()))) {
-          // Invaid material ID. Use default material.
-          current_material_id =
-              materials.size() -
-              1;  // Default material is added to the last item in `materials`.
-        }
-        // if (current_material_id >= materials.size()) {
-        //    std::cerr << "Invalid material index: " << current_material_id <<
-        //    std::endl;
-        //}
-        //
-        float diffuse[3];
-        for (size_t i = 0; i < 3; i++) {
-          diffuse[i] = materials[current_material_id].diffuse[i];
-        }
-        float tc[3][2];
-        if (attrib.texcoords.size() > 0) {
-          if ((idx0.texcoord_index < 0) || (idx1.texcoord_index < 0) ||
-              (idx2.texcoord_index < 0)) {
-            // face does not contain valid uv index.
-            tc[0][0] = 0.0f;
-            tc[0][1] = 0.0f;
-            tc[1][0] = 0.0f;
-            tc[1][1] = 0.0f;
-            tc[2][0] = 0.0f;
-            tc[2][1] = 0.0f;
-          } else {
-            assert(attrib.texcoords.size() >
-                   size_t(2 * idx0.texcoord_index + 1));
-            assert(attrib.texcoords.size() >
-                   size_t(2 * idx1.texcoord_index + 1));
-            assert(attrib.texcoords.size() >
-                   size_t(2 * idx2.texcoord_index + 1));
-
-            // Flip Y coord.
-            tc[0][0] = attrib.texcoords[2 * idx0.texcoord_index];
-            tc[0][1] = 1.0f - attrib.texcoords[2 * idx0.texcoord_index + 1];
-            tc[1][0] = attrib.texcoords[2 * idx1.texcoord_index];
-            tc[1][1] = 1.0f - attrib.texcoords[2 * idx1.texcoord_index + 1];
-            tc[2][0] = attrib.texcoords[2 * idx2.texcoord_index];
-            tc[2][1] = 1.0f - attrib.texcoords[2 * idx2.texcoord_index + 1];
-          }
-        } else {
-          tc[0][0] = 0.0f;
-          tc[0][1] = 0.0f;
-          tc[1][0] = 0.0f;
-          tc[1][1] = 0.0f;
-          tc[2][0] = 0.0f;
-          tc[2][1] = 0.0f;
-        }
+  tm.start();
+  for (size_t i = 0; i < objects.size(); i++) {
+    DrawObject& o = objects[i];
+    const ShapeBuffer& sb = shapeBuffers[i];
+    if (o.numTriangles > 0) {
+      UploadDrawObject(&o, sb.vertices.data(), sb.vertices.size(),
+                       sb.indices.data(), sb.indices.size());
+      UploadInstances(&o);
+    }
+  }
+  tm.end();
+  g->upload_ms = tm.msec();
+
+  std::string cache_filename = MeshCacheFilename(g->filename);
+  if (g_use_mesh_cache &&
+      !WriteMeshCache(cache_filename, g->filename, g_merge_draws,
+                      g_instance_shapes, g_angle_weighted_normals,
+                      g_base_vertex, g->bmin, g->bmax, g->occluders,
+                      materials, objects, shapeBuffers)) {
+    std::cerr << "Unable to write mesh cache: " << cache_filename << std::endl;
+  }
+  drawObjects->insert(drawObjects->end(), objects.begin(), objects.end());
+}
 
-        float v[3][3];
-        for (int k = 0; k < 3; k++) {
-          int f0 = idx0.vertex_index;
-          int f1 = idx1.vertex_index;
-          int f2 = idx2.vertex_index;
-          assert(f0 >= 0);
-          assert(f1 >= 0);
-          assert(f2 >= 0);
-
-          v[0][k] = attrib.vertices[3 * f0 + k];
-          v[1][k] = attrib.vertices[3 * f1 + k];
-          v[2][k] = attrib.vertices[3 * f2 + k];
-          bmin[k] = std::min(v[0][k], bmin[k]);
-          bmin[k] = std::min(v[1][k], bmin[k]);
-          bmin[k] = std::min(v[2][k], bmin[k]);
-          bmax[k] = std::max(v[0][k], bmax[k]);
-          bmax[k] = std::max(v[1][k], bmax[k]);
-          bmax[k] = std::max(v[2][k], bmax[k]);
-        }
+bool LoadObjAndConvert(float bmin[3], float bmax[3],
+                       std::vector<DrawObject>* drawObjects,
+                       std::vector<float>* occluders,
+                       std::vector<tinyobj::material_t>& materials,
+                       std::map<std::string, GLuint>& textures,
+                       const char* filename) {
+  ObjGeometry g;
+  TextureLoader textureLoader;
+  if (!ReadObjGeometry(filename, &textureLoader, textures, &g)) {
+    return false;
+  }
 
-        float n[3][3];
-        {
-          bool invalid_normal_index = false;
-          if (attrib.normals.size() > 0) {
-            int nf0 = idx0.normal_index;
-            int nf1 = idx1.normal_index;
-            int nf2 = idx2.normal_index;
-
-            if ((nf0 < 0) || (nf1 < 0) || (nf2 < 0)) {
-              // normal index is missing from this face.
-              invalid_normal_index = true;
-            } else {
-              for (int k = 0; k < 3; k++) {
-                assert(size_t(3 * nf0 + k) < attrib.normals.size());
-                assert(size_t(3 * nf1 + k) < attrib.normals.size());
-                assert(size_t(3 * nf2 + k) < attrib.normals.size());
-                n[0][k] = attrib.normals[3 * nf0 + k];
-                n[1][k] = attrib.normals[3 * nf1 + k];
-                n[2][k] = attrib.normals[3 * nf2 + k];
-              }
-            }
-          } else {
-            invalid_normal_index = true;
-          }
-
-          if (invalid_normal_index && !smoothVertexNormals.empty()) {
-            // Use smoothing normals
-            int f0 = idx0.vertex_index;
-            int f1 = idx1.vertex_index;
-            int f2 = idx2.vertex_index;
-
-            if (f0 >= 0 && f1 >= 0 && f2 >= 0) {
-              n[0][0] = smoothVertexNormals[f0].v[0];
-              n[0][1] = smoothVertexNormals[f0].v[1];
-              n[0][2] = smoothVertexNormals[f0].v[2];
-
-              n[1][0] = smoothVertexNormals[f1].v[0];
-              n[1][1] = smoothVertexNormals[f1].v[1];
-              n[1][2] = smoothVertexNormals[f1].v[2];
-
-              n[2][0] = smoothVertexNormals[f2].v[0];
-              n[2][1] = smoothVertexNormals[f2].v[1];
-              n[2][2] = smoothVertexNormals[f2].v[2];
-
-              invalid_normal_index = false;
-            }
-          }
-
-          if (invalid_normal_index) {
-            // compute geometric normal
-            CalcNormal(n[0], v[0], v[1], v[2]);
-            n[1][0] = n[0][0];
-            n[1][1] = n[0][1];
-            n[1][2] = n[0][2];
-            n[2][0] = n[0][0];
-            n[2][1] = n[0][1];
-            n[2][2] = n[0][2];
-          }
-        }
+  // Cached models upload while the textures decode. Converted ones print
+  // draw statistics, which need the texture IDs.
+  Stopwatch tm;
+  if (g.cached) {
+    UploadObjGeometry(&g, textures, drawObjects);
+  }
+  tm.start();
+  textureLoader.finish(textures);
+  tm.end();
+  if (!g.cached) {
+    UploadObjGeometry(&g, textures, drawObjects);
+  }
 
-        for (int k = 0; k < 3; k++) {
-          buffer.push_back(v[k][0]);
-          buffer.push_back(v[k][1]);
-          buffer.push_back(v[k][2]);
-          buffer.push_back(n[k][0]);
-          buffer.push_back(n[k][1]);
-          buffer.push_back(n[k][2]);
-          // Combine normal and diffuse to get color.
-          float normal_factor = 0.2;
-          float diffuse_factor = 1 - normal_factor;
-          float c[3] = {n[k][0] * normal_factor + diffuse[0] * diffuse_factor,
-                        n[k][1] * normal_factor + diffuse[1] * diffuse_factor,
-                        n[k][2] * normal_factor + diffuse[2] * diffuse_factor};
-          float len2 = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
-          if (len2 > 0.0f) {
-            float len = sqrtf(len2);
-
-            c[0] /= len;
-            c[1] /= len;
-            c[2] /= len;
-          }
-          buffer.push_back(c[0] * 0.5 + 0.5);
-          buffer.push_back(c[1] * 0.5 + 0.5);
-          buffer.push_back(c[2] * 0.5 + 0.5);
-
-          buffer.push_back(tc[k][0]);
-          buffer.push_back(tc[k][1]);
-        }
-      }
+  g_load_times.cached = g.cached;
+  g_load_times.parse_ms = g.parse_ms;
+  g_load_times.convert_ms = g.convert_ms;
+  g_load_times.upload_ms = g.upload_ms;
+  g_load_times.texture_ms = tm.msec();
+  for (int k = 0; k < 3; k++) {
+    bmin[k] = g.bmin[k];
+    bmax[k] = g.bmax[k];
+  }
+  occluders->swap(g.occluders);
+  materials.swap(g.materials);
 
-      o.vb_id = 0;
-      o.numTriangles = 0;
+  printf("bmin = %f, %f, %f\n", bmin[0], bmin[1], bmin[2]);
+  printf("bmax = %f, %f, %f\n", bmax[0], bmax[1], bmax[2]);
 
-      // OpenGL viewer does not support texturing with per-face material.
-      if (shapes[s].mesh.material_ids.size() > 0 &&
-          shapes[s].mesh.material_ids.size() > s) {
-        o.material_id = shapes[s].mesh.material_ids[0];  // use the material ID
-                                                         // of the first face.
-      } else {
-        o.material_id = materials.size() - 1;  // = ID for default material.
-      }
-      printf("shape[%d] material_id %d\n", int(s), int(o.material_id));
-
-      if (buffer.size() > 0) {
-        glGenBuffers(1, &o.vb_id);
-        glBindBuffer(GL_ARRAY_BUFFER, o.vb_id);
-        glBufferData(GL_ARRAY_BUFFER, buffer.size() * sizeof(float),
-                     &buffer.at(0), GL_STATIC_DRAW);
-        o.numTriangles = buffer.size() / (3 + 3 + 3 + 2) /
-                         3;  // 3:vtx, 3:normal, 3:col, 2:texcoord
-
-        printf("shape[%d] # of triangles = %d\n", static_cast<int>(s),
-               o.numTriangles);
-      }
+  return true;
+}
+
+bool LoadObjPaged(float bmin[3], float bmax[3], MappedFile* pageFile,
+                  std::vector<Page>* pages, std::vector<float>* occluders,
+                  std::vector<tinyobj::material_t>& materials,
+                  std::map<std::string, GLuint>& textures,
+                  const char* filename) {
+  std::string base_dir = GetBaseDir(filename);
+  if (base_dir.empty()) {
+    base_dir = ".";
+  }
+#ifdef _WIN32
+  base_dir += "\\";
+#else
+  base_dir += "/";
+#endif
 
-      drawObjects->push_back(o);
+  // The page file is the backing store of the model, so it is written even
+  // with the mesh cache disabled; that only forces it to be rebuilt.
+  std::string page_filename = PageFileFilename(filename);
+  g_load_times.cached = true;
+  if (!g_use_mesh_cache || !pageFile->open(page_filename) ||
+      !ReadPageFile(*pageFile, filename, g_vertex_format,
+                    g_angle_weighted_normals, bmin, bmax, occluders,
+                    materials, pages)) {
+    g_load_times.cached = false;
+    pageFile->close();
+    if (!buildPageFile(page_filename, filename, base_dir)) {
+      return false;
+    }
+    if (!pageFile->open(page_filename) ||
+        !ReadPageFile(*pageFile, filename, g_vertex_format,
+                      g_angle_weighted_normals, bmin, bmax, occluders,
+                      materials, pages)) {
+      std::cerr << "Unable to read page file: " << page_filename
+                << std::endl;
+      return false;
     }
   }
 
+  TextureLoader textureLoader;
+  textureLoader.start(materials, textures);
+  size_t bytes = 0;
+  for (size_t i = 0; i < pages->size(); i++) {
+    bytes += (*pages)[i].data.vertexBytes + (*pages)[i].data.indexBytes;
+  }
+  printf("Page file %s: %d pages, %d [MB]\n", page_filename.c_str(),
+         (int)pages->size(), (int)(bytes >> 20));
+  Stopwatch tm;
+  tm.start();
+  textureLoader.finish(textures);
+  tm.end();
+  g_load_times.texture_ms = tm.msec();
   printf("bmin = %f, %f, %f\n", bmin[0], bmin[1], bmin[2]);
   printf("bmax = %f, %f, %f\n", bmax[0], bmax[1], bmax[2]);
-
   return true;
-}
\ No newline at end of file
+}
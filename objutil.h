@@ -1,4 +1,15 @@
+#include <GL/glew.h>
 
+#include <tiny_obj_loader.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "drawobject.h"
+#include "mappedfile.h"
+#include "meshcache.h"
+#include "texutil.h"
 
 #ifndef OBJUTIL_H
 #define OBJUTIL_H
@@ -7,10 +18,62 @@
 // struct material_t;
 // }
 
+// One model read from disk but not yet uploaded. The cached shapes point
+// into `cache`, so the struct must outlive the upload.
+struct ObjGeometry {
+  std::string filename;
+  std::vector<tinyobj::material_t> materials;  // ends with the default one
+  std::vector<DrawObject> objects;
+  std::vector<ShapeBuffer> shapeBuffers;  // when converted
+  MappedFile cache;
+  std::vector<CachedShape> cachedShapes;  // when read from the mesh cache
+  bool cached;
+  std::vector<float> occluders;
+  float bmin[3], bmax[3];
+  double parse_ms, convert_ms, upload_ms;
+};
+
+// Parse and convert `filename`, or read its mesh cache, without touching
+// GL, so several models can be read at once. Texture decoding is started on
+// `textureLoader`; the caller finishes it.
+bool ReadObjGeometry(const char* filename, TextureLoader* textureLoader,
+                     const std::map<std::string, GLuint>& textures,
+                     ObjGeometry* g);
+
+// Create the GL buffers of `g`, write its mesh cache if it was converted and
+// append its objects to `drawObjects`. Must run on the GL thread.
+void UploadObjGeometry(ObjGeometry* g,
+                       const std::map<std::string, GLuint>& textures,
+                       std::vector<DrawObject>* drawObjects);
+
 bool LoadObjAndConvert(float bmin[3], float bmax[3],
                        std::vector<DrawObject>* drawObjects,
+                       std::vector<float>* occluders,
                        std::vector<tinyobj::material_t>& materials,
                        std::map<std::string, GLuint>& textures,
                        const char* filename);
 
-#endif
\ No newline at end of file
+// Open the page file of `filename` for streaming, converting the model
+// first if the file is missing or stale. `pages` points into `pageFile`
+// and comes without GL buffers; see PageStreamer. The page file is built
+// out of core from spatial bins on disk (see FaceBins), always with the
+// parallel parser, so the model never has to fit in memory.
+bool LoadObjPaged(float bmin[3], float bmax[3], MappedFile* pageFile,
+                  std::vector<Page>* pages, std::vector<float>* occluders,
+                  std::vector<tinyobj::material_t>& materials,
+                  std::map<std::string, GLuint>& textures,
+                  const char* filename);
+
+// Create the vertex and index buffers of `o` from already packed data.
+void UploadDrawObject(DrawObject* o, const void* vertices, size_t vertexBytes,
+                      const void* indices, size_t indexBytes);
+
+// Fill the bound GL_ARRAY_BUFFER with the instance buffer layout of the
+// model matrices `instances`; see kInstanceBufferFloats.
+void BufferInstances(const std::vector<float>& instances);
+
+// Create or refill the instance buffer of `o` from its `instances`. Does
+// nothing for objects drawn once.
+void UploadInstances(DrawObject* o);
+
+#endif
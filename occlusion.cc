@@ -0,0 +1,286 @@
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "parallel.h"
+#include "profiler.h"
+
+namespace  // Local utility functions
+{
+// Vertices closer than this in clip space w reject the triangle (as an
+// occluder) or accept the box (as an occludee).
+const float kMinW = 1e-4f;
+
+// Rows per rasterization task. Each task owns its rows, so no two threads
+// write the same pixel.
+const int kBandRows = 8;
+
+// Slack for depth comparisons, in normalized depth.
+const float kDepthEpsilon = 1e-5f;
+
+// A triangle set up for rasterization in pixel coordinates.
+struct ScreenTriangle {
+  float xmin, xmax, ymin, ymax;
+  float e[3][3];  // edge functions A * x + B * y + C >= 0 inside
+  float z[3];     // depth plane A * x + B * y + C
+};
+
+void transform(const float m[16], const float p[3], float out[4]) {
+  for (int r = 0; r < 4; r++) {
+    out[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r];
+  }
+}
+
+// Project and set up one triangle. False if it cannot safely occlude.
+bool setupTriangle(const float* tri, const float mvp[16], int width,
+                   int height, ScreenTriangle* t) {
+  float x[3], y[3], z[3];
+  for (int v = 0; v < 3; v++) {
+    float clip[4];
+    transform(mvp, tri + 3 * v, clip);
+    if (clip[3] < kMinW) {
+      return false;
+    }
+    x[v] = (clip[0] / clip[3] * 0.5f + 0.5f) * width;
+    y[v] = (clip[1] / clip[3] * 0.5f + 0.5f) * height;
+    z[v] = clip[2] / clip[3] * 0.5f + 0.5f;
+  }
+  float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if (fabsf(area) < 1e-6f) {
+    return false;
+  }
+  if (area < 0.0f) {
+    std::swap(x[1], x[2]);
+    std::swap(y[1], y[2]);
+    std::swap(z[1], z[2]);
+    area = -area;
+  }
+  t->xmin = std::min(x[0], std::min(x[1], x[2]));
+  t->xmax = std::max(x[0], std::max(x[1], x[2]));
+  t->ymin = std::min(y[0], std::min(y[1], y[2]));
+  t->ymax = std::max(y[0], std::max(y[1], y[2]));
+  if (t->xmax < 0.0f || t->ymax < 0.0f || t->xmin >= width ||
+      t->ymin >= height) {
+    return false;
+  }
+  for (int i = 0; i < 3; i++) {
+    int j = (i + 1) % 3;
+    float dx = x[j] - x[i], dy = y[j] - y[i];
+    t->e[i][0] = -dy;
+    t->e[i][1] = dx;
+    t->e[i][2] = dy * x[i] - dx * y[i];
+  }
+  t->z[0] = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) /
+            area;
+  t->z[1] = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) /
+            area;
+  t->z[2] = z[0] - t->z[0] * x[0] - t->z[1] * y[0];
+  return true;
+}
+
+// Rasterize the rows [yBegin, yEnd) of `t`, keeping the nearest depth.
+// `width` is a multiple of 4.
+void rasterize(const ScreenTriangle& t, int yBegin, int yEnd, int width,
+               float* depth) {
+  int x0 = std::max(0, int(floorf(t.xmin)));
+  int x1 = std::min(width - 1, int(ceilf(t.xmax)));
+  int y0 = std::max(yBegin, int(floorf(t.ymin)));
+  int y1 = std::min(yEnd - 1, int(ceilf(t.ymax)));
+  x0 &= ~3;
+  for (int y = y0; y <= y1; y++) {
+    float py = y + 0.5f;
+    float* row = depth + size_t(y) * width;
+#if defined(__SSE2__)
+    __m128 e0 = _mm_set1_ps(t.e[0][1] * py + t.e[0][2]);
+    __m128 e1 = _mm_set1_ps(t.e[1][1] * py + t.e[1][2]);
+    __m128 e2 = _mm_set1_ps(t.e[2][1] * py + t.e[2][2]);
+    __m128 zr = _mm_set1_ps(t.z[1] * py + t.z[2]);
+    __m128 a0 = _mm_set1_ps(t.e[0][0]);
+    __m128 a1 = _mm_set1_ps(t.e[1][0]);
+    __m128 a2 = _mm_set1_ps(t.e[2][0]);
+    __m128 za = _mm_set1_ps(t.z[0]);
+    __m128 zero = _mm_setzero_ps();
+    for (int x = x0; x <= x1; x += 4) {
+      __m128 px = _mm_add_ps(_mm_set1_ps(float(x)),
+                             _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+      __m128 inside = _mm_and_ps(
+          _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), e0), zero),
+          _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), e1), zero),
+                     _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), e2), zero)));
+      if (_mm_movemask_ps(inside) == 0) {
+        continue;
+      }
+      __m128 z = _mm_add_ps(_mm_mul_ps(za, px), zr);
+      __m128 old = _mm_loadu_ps(row + x);
+      __m128 nearer = _mm_min_ps(old, z);
+      _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer),
+                                       _mm_andnot_ps(inside, old)));
+    }
+#else
+    for (int x = x0; x <= x1; x++) {
+      float px = x + 0.5f;
+      if (t.e[0][0] * px + t.e[0][1] * py + t.e[0][2] >= 0.0f &&
+          t.e[1][0] * px + t.e[1][1] * py + t.e[1][2] >= 0.0f &&
+          t.e[2][0] * px + t.e[2][1] * py + t.e[2][2] >= 0.0f) {
+        float z = t.z[0] * px + t.z[1] * py + t.z[2];
+        row[x] = std::min(row[x], z);
+      }
+    }
+#endif
+  }
+}
+
+float triangleArea(const float* a, const float* b, const float* c) {
+  float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+  float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0]};
+  return 0.5f * sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+}
+}  // namespace
+
+void SelectOccluders(const float* vertices, size_t stride,
+                     size_t numTriangles, size_t maxTriangles,
+                     std::vector<float>* occluders) {
+  std::vector<std::pair<float, size_t> > areas(numTriangles);
+  for (size_t t = 0; t < numTriangles; t++) {
+    const float* v = vertices + 3 * t * stride;
+    areas[t] = std::make_pair(triangleArea(v, v + stride, v + 2 * stride), t);
+  }
+  if (numTriangles > maxTriangles) {
+    std::nth_element(areas.begin(), areas.begin() + maxTriangles, areas.end(),
+                     std::greater<std::pair<float, size_t> >());
+    areas.resize(maxTriangles);
+  }
+  for (size_t i = 0; i < areas.size(); i++) {
+    const float* v = vertices + 3 * areas[i].second * stride;
+    for (int k = 0; k < 3; k++) {
+      occluders->insert(occluders->end(), v + k * stride, v + k * stride + 3);
+    }
+  }
+}
+
+void OcclusionBuffer::render(const std::vector<float>& occluders,
+                             const float mvp[16], float aspect) {
+  PROFILE_ZONE("occlusion buffer");
+  width_ = kOcclusionWidth;
+  height_ = std::max(4, int(kOcclusionWidth / std::max(aspect, 0.01f)));
+  memcpy(mvp_, mvp, sizeof(mvp_));
+
+  // Level 0 is the depth buffer; coarser levels keep the farthest depth
+  // of the texels they cover.
+  int w = width_, h = height_;
+  levels_.resize(1);
+  levelWidths_.assign(1, w);
+  levelHeights_.assign(1, h);
+  while (w > 1 || h > 1) {
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+    levels_.resize(levels_.size() + 1);
+    levelWidths_.push_back(w);
+    levelHeights_.push_back(h);
+  }
+  for (size_t l = 0; l < levels_.size(); l++) {
+    levels_[l].assign(size_t(levelWidths_[l]) * levelHeights_[l], 1.0f);
+  }
+
+  size_t numTriangles = occluders.size() / 9;
+  std::vector<ScreenTriangle> triangles(numTriangles);
+  std::vector<char> valid(numTriangles);
+  ParallelFor(0, numTriangles, 512, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) {
+      valid[t] = setupTriangle(&occluders[9 * t], mvp_, width_, height_,
+                               &triangles[t]);
+    }
+  });
+
+  int numBands = (height_ + kBandRows - 1) / kBandRows;
+  float* depth = levels_[0].data();
+  ParallelFor(0, numBands, 1, [&](size_t begin, size_t end) {
+    for (size_t band = begin; band < end; band++) {
+      int yBegin = int(band) * kBandRows;
+      int yEnd = std::min(height_, yBegin + kBandRows);
+      for (size_t t = 0; t < numTriangles; t++) {
+        if (valid[t] && triangles[t].ymax >= yBegin &&
+            triangles[t].ymin < yEnd) {
+          rasterize(triangles[t], yBegin, yEnd, width_, depth);
+        }
+      }
+    }
+  });
+
+  for (size_t l = 1; l < levels_.size(); l++) {
+    const std::vector<float>& src = levels_[l - 1];
+    int sw = levelWidths_[l - 1], sh = levelHeights_[l - 1];
+    for (int y = 0; y < levelHeights_[l]; y++) {
+      for (int x = 0; x < levelWidths_[l]; x++) {
+        int x0 = 2 * x, y0 = 2 * y;
+        int x1 = std::min(x0 + 1, sw - 1), y1 = std::min(y0 + 1, sh - 1);
+        levels_[l][size_t(y) * levelWidths_[l] + x] = std::max(
+            std::max(src[size_t(y0) * sw + x0], src[size_t(y0) * sw + x1]),
+            std::max(src[size_t(y1) * sw + x0], src[size_t(y1) * sw + x1]));
+      }
+    }
+  }
+  valid_ = true;
+}
+
+bool OcclusionBuffer::boxVisible(const float bmin[3],
+                                 const float bmax[3]) const {
+  if (!valid_) {
+    return true;
+  }
+  float xmin = 1e30f, xmax = -1e30f, ymin = 1e30f, ymax = -1e30f;
+  float zmin = 1e30f;
+  for (int c = 0; c < 8; c++) {
+    float p[3] = {(c & 1) ? bmax[0] : bmin[0], (c & 2) ? bmax[1] : bmin[1],
+                  (c & 4) ? bmax[2] : bmin[2]};
+    float clip[4];
+    transform(mvp_, p, clip);
+    if (clip[3] < kMinW) {
+      return true;  // crosses the eye plane
+    }
+    float x = (clip[0] / clip[3] * 0.5f + 0.5f) * width_;
+    float y = (clip[1] / clip[3] * 0.5f + 0.5f) * height_;
+    xmin = std::min(xmin, x);
+    xmax = std::max(xmax, x);
+    ymin = std::min(ymin, y);
+    ymax = std::max(ymax, y);
+    zmin = std::min(zmin, clip[2] / clip[3] * 0.5f + 0.5f);
+  }
+  // Grow by a pixel to make up for the coarse rasterization.
+  int x0 = std::max(0, int(floorf(xmin)) - 1);
+  int x1 = std::min(width_ - 1, int(floorf(xmax)) + 1);
+  int y0 = std::max(0, int(floorf(ymin)) - 1);
+  int y1 = std::min(height_ - 1, int(floorf(ymax)) + 1);
+  if (x0 > x1 || y0 > y1) {
+    return true;  // off screen, left to the frustum test
+  }
+
+  // Pick the level where the rectangle spans at most 2x2 texels.
+  size_t level = 0;
+  while ((x1 - x0 > 1 || y1 - y0 > 1) && level + 1 < levels_.size()) {
+    x0 >>= 1;
+    x1 >>= 1;
+    y0 >>= 1;
+    y1 >>= 1;
+    level++;
+  }
+  const std::vector<float>& hiz = levels_[level];
+  int w = levelWidths_[level];
+  float farthest = 0.0f;
+  for (int y = y0; y <= y1; y++) {
+    for (int x = x0; x <= x1; x++) {
+      farthest = std::max(farthest, hiz[size_t(y) * w + x]);
+    }
+  }
+  return zmin <= farthest + kDepthEpsilon;
+}
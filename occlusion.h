@@ -0,0 +1,47 @@
+#include <cstddef>
+#include <vector>
+
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+// Most triangles kept as occluders for the whole model.
+const size_t kMaxOccluderTriangles = 4096;
+
+// Width of the software depth buffer. The height follows the window's
+// aspect ratio.
+const int kOcclusionWidth = 256;
+
+// Append the positions (9 floats) of the up to `maxTriangles` largest of
+// the `numTriangles` triangles in `vertices` to `occluders`. `stride` is
+// the # of floats per vertex, the position being the first three.
+void SelectOccluders(const float* vertices, size_t stride,
+                     size_t numTriangles, size_t maxTriangles,
+                     std::vector<float>* occluders);
+
+// Low resolution depth buffer rasterized on the CPU from a set of occluder
+// triangles, with a pyramid of max depths (hierarchical Z) for conservative
+// visibility tests of bounding boxes. Needs no GPU support.
+class OcclusionBuffer {
+ public:
+  OcclusionBuffer() : width_(0), height_(0), valid_(false) {}
+
+  // Rasterize `occluders` (9 floats per model space triangle) as seen
+  // through the column-major `mvp` into a buffer with the aspect ratio
+  // `aspect`, and rebuild the pyramid. Runs on the worker pool.
+  void render(const std::vector<float>& occluders, const float mvp[16],
+              float aspect);
+
+  // False if the box [bmin, bmax] is certainly behind the occluders.
+  bool boxVisible(const float bmin[3], const float bmax[3]) const;
+
+ private:
+  int width_;
+  int height_;
+  bool valid_;
+  float mvp_[16];
+  std::vector<std::vector<float> > levels_;  // [0]: width_ x height_
+  std::vector<int> levelWidths_;
+  std::vector<int> levelHeights_;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "pager.h"
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <tiny_obj_loader.h>
+
+#include "corerenderer.h"
+#include "global.h"
+#include "mappedfile.h"
+#include "objutil.h"
+#include "parallel.h"
+#include "profiler.h"
+
+// A page read from the page file, on its way to the GL thread.
+struct LoadedPage {
+  size_t page;
+  std::vector<unsigned char> vertices;
+  std::vector<unsigned char> indices;
+};
+
+struct PageQueue {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<LoadedPage> loaded;
+  size_t pending;
+};
+
+namespace  // Local utility functions
+{
+enum PageState { kPageOut, kPageLoading, kPageResident };
+
+// Pages read at the same time. Bounds the staging memory outside the
+// budget's control and keeps the most important pages at the front.
+const size_t kMaxPagesInFlight = 8;
+
+// Upload at most this much per frame, so streaming does not stall frames.
+const size_t kUploadBytesPerFrame = 16 << 20;
+
+size_t pageBytes(const Page& page) {
+  return page.data.vertexBytes + page.data.indexBytes;
+}
+
+// Projected radius of `page` in pixels; pages around the eye come first.
+float pageImportance(const LodParams& view, const Page& page) {
+  const float* m = view.modelview;
+  const float* c = page.center;
+  float eye[3];
+  for (int k = 0; k < 3; k++) {
+    eye[k] = m[k] * c[0] + m[4 + k] * c[1] + m[8 + k] * c[2] + m[12 + k];
+  }
+  float radius = page.radius * view.scale;
+  float distance =
+      sqrtf(eye[0] * eye[0] + eye[1] * eye[1] + eye[2] * eye[2]) - radius;
+  if (distance <= 0.0f) {
+    return 1e30f;
+  }
+  return radius * view.pixelsPerUnit / distance;
+}
+}  // namespace
+
+PageStreamer::PageStreamer()
+    : queue_(std::make_shared<PageQueue>()),
+      pages_(NULL),
+      objects_(NULL),
+      budget_(0),
+      residentBytes_(0),
+      frame_(0) {
+  queue_->pending = 0;
+}
+
+PageStreamer::~PageStreamer() {
+  // The reads point into the page file, which the caller closes after us.
+  std::unique_lock<std::mutex> lock(queue_->mutex);
+  queue_->cv.wait(lock, [this] { return queue_->pending == 0; });
+  queue_->loaded.clear();
+}
+
+void PageStreamer::start(const std::vector<Page>* pages,
+                         std::vector<DrawObject>* objects,
+                         size_t budgetBytes) {
+  pages_ = pages;
+  objects_ = objects;
+  budget_ = budgetBytes;
+  state_.assign(pages->size(), kPageOut);
+  lastVisible_.assign(pages->size(), 0);
+}
+
+void PageStreamer::upload(size_t page,
+                          const std::vector<unsigned char>& vertices,
+                          const std::vector<unsigned char>& indices) {
+  DrawObject& o = (*objects_)[page];
+  UploadDrawObject(&o, vertices.data(), vertices.size(), indices.data(),
+                   indices.size());
+  if (g_renderer == kRendererCore) {
+    CreateVertexArray(&o);
+  }
+  state_[page] = kPageResident;
+}
+
+void PageStreamer::evict(size_t page) {
+  DrawObject& o = (*objects_)[page];
+  glDeleteBuffers(1, &o.vb_id);
+  glDeleteBuffers(1, &o.ib_id);
+  if (o.vao_id) {
+    glDeleteVertexArrays(1, &o.vao_id);
+  }
+  o.vb_id = o.ib_id = o.vao_id = 0;
+  state_[page] = kPageOut;
+  residentBytes_ -= pageBytes((*pages_)[page]);
+}
+
+// Evict resident pages that are out of view, least recently seen first,
+// until `bytes` more fit into the budget.
+bool PageStreamer::makeRoom(size_t bytes) {
+  while (residentBytes_ + bytes > budget_) {
+    size_t victim = state_.size();
+    for (size_t i = 0; i < state_.size(); i++) {
+      if (state_[i] == kPageResident && lastVisible_[i] != frame_ &&
+          (victim == state_.size() || lastVisible_[i] < lastVisible_[victim])) {
+        victim = i;
+      }
+    }
+    if (victim == state_.size()) {
+      return false;
+    }
+    evict(victim);
+  }
+  return true;
+}
+
+bool PageStreamer::busy() const {
+  std::lock_guard<std::mutex> lock(queue_->mutex);
+  return queue_->pending > 0 || !queue_->loaded.empty();
+}
+
+bool PageStreamer::update(const Frustum& frustum, const LodParams& view) {
+  PROFILE_ZONE("stream pages");
+  frame_++;
+
+  // Upload what the workers have read, a bounded amount per frame.
+  size_t uploaded = 0;
+  while (uploaded < kUploadBytesPerFrame) {
+    LoadedPage p;
+    {
+      std::lock_guard<std::mutex> lock(queue_->mutex);
+      if (queue_->loaded.empty()) {
+        break;
+      }
+      p = std::move(queue_->loaded.front());
+      queue_->loaded.pop_front();
+    }
+    upload(p.page, p.vertices, p.indices);
+    uploaded += p.vertices.size() + p.indices.size();
+  }
+
+  // Missing pages in view, by their size on screen.
+  std::vector<std::pair<float, size_t> > wanted;
+  for (size_t i = 0; i < pages_->size(); i++) {
+    const Page& page = (*pages_)[i];
+    if (!SphereVisible(frustum, page.center, page.radius)) {
+      continue;
+    }
+    lastVisible_[i] = frame_;
+    if (state_[i] == kPageOut) {
+      wanted.push_back(std::make_pair(pageImportance(view, page), i));
+    }
+  }
+  std::sort(wanted.begin(), wanted.end(),
+            std::greater<std::pair<float, size_t> >());
+
+  size_t inFlight;
+  {
+    std::lock_guard<std::mutex> lock(queue_->mutex);
+    inFlight = queue_->pending + queue_->loaded.size();
+  }
+  for (size_t w = 0; w < wanted.size() && inFlight < kMaxPagesInFlight;
+       w++, inFlight++) {
+    size_t i = wanted[w].second;
+    const Page& page = (*pages_)[i];
+    if (!makeRoom(pageBytes(page))) {
+      break;
+    }
+    state_[i] = kPageLoading;
+    residentBytes_ += pageBytes(page);
+    {
+      std::lock_guard<std::mutex> lock(queue_->mutex);
+      queue_->pending++;
+    }
+    std::shared_ptr<PageQueue> queue = queue_;
+    CachedShape data = page.data;
+    RunAsync([queue, data, i] {
+      // Touching the mapped bytes here keeps the disk reads off the GL
+      // thread.
+      const unsigned char* vertices =
+          static_cast<const unsigned char*>(data.vertices);
+      const unsigned char* indices =
+          static_cast<const unsigned char*>(data.indices);
+      LoadedPage p;
+      p.page = i;
+      p.vertices.assign(vertices, vertices + data.vertexBytes);
+      p.indices.assign(indices, indices + data.indexBytes);
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      queue->loaded.push_back(std::move(p));
+      queue->pending--;
+      queue->cv.notify_all();
+    });
+  }
+  return uploaded > 0;
+}
@@ -0,0 +1,60 @@
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "culling.h"
+#include "drawobject.h"
+#include "lod.h"
+#include "meshcache.h"
+
+#ifndef PAGER_H
+#define PAGER_H
+
+struct PageQueue;
+
+// Streams the pages of a paged model between its mapped page file and GL
+// buffers. Pages in view are read on the worker pool, most important first,
+// and the least recently visible pages are evicted to keep the resident
+// geometry within a memory budget.
+class PageStreamer {
+ public:
+  PageStreamer();
+  ~PageStreamer();
+
+  // Stream `pages` into `objects`, which has one DrawObject per page. Both
+  // have to outlive the streamer.
+  void start(const std::vector<Page>* pages, std::vector<DrawObject>* objects,
+             size_t budgetBytes);
+
+  // Call once per frame on the GL thread. Uploads the pages read since the
+  // last call, then evicts and queues pages for the view of `frustum` and
+  // `view`. Returns true if a page was uploaded.
+  bool update(const Frustum& frustum, const LodParams& view);
+
+  // True while pages are read or wait for their upload, so the view has to
+  // be drawn again for update() to bring them in.
+  bool busy() const;
+
+  size_t residentBytes() const { return residentBytes_; }
+  size_t budgetBytes() const { return budget_; }
+
+ private:
+  PageStreamer(const PageStreamer&);
+  PageStreamer& operator=(const PageStreamer&);
+
+  void upload(size_t page, const std::vector<unsigned char>& vertices,
+              const std::vector<unsigned char>& indices);
+  void evict(size_t page);
+  bool makeRoom(size_t bytes);
+
+  std::shared_ptr<PageQueue> queue_;
+  const std::vector<Page>* pages_;
+  std::vector<DrawObject>* objects_;
+  size_t budget_;
+  size_t residentBytes_;  // uploaded pages and pages being read
+  std::vector<char> state_;
+  std::vector<unsigned int> lastVisible_;  // frame a page was last in view
+  unsigned int frame_;
+};
+
+#endif
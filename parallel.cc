@@ -0,0 +1,147 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "global.h"
+#include "profiler.h"
+
+namespace  // Local utility functions
+{
+class ThreadPool {
+ public:
+  explicit ThreadPool(unsigned int numThreads) : stop_(false) {
+    // The thread calling ParallelFor() works too, so start one less.
+    for (unsigned int i = 1; i < numThreads; i++) {
+      workers_.emplace_back(&ThreadPool::work, this);
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++) {
+      workers_[i].join();
+    }
+  }
+
+  unsigned int size() const { return workers_.size() + 1; }
+
+  void submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  void work() {
+    ProfileThreadName("worker");
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (stop_ && tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()> > tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_;
+};
+
+ThreadPool& pool() {
+  static ThreadPool instance(
+      g_num_threads > 0
+          ? g_num_threads
+          : std::max(1u, std::thread::hardware_concurrency()));
+  return instance;
+}
+
+// State of one ParallelFor() call. It is shared with the helper tasks, which
+// may only get to run after the call has returned.
+struct ParallelForState {
+  std::function<void(size_t, size_t)> fn;
+  size_t begin, end, grain, numRanges;
+  std::atomic<size_t> next;
+  std::atomic<size_t> done;
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  // Claim and run ranges until none are left.
+  void run() {
+    size_t r;
+    while ((r = next.fetch_add(1)) < numRanges) {
+      size_t b = begin + r * grain;
+      fn(b, std::min(end, b + grain));
+      if (done.fetch_add(1) + 1 == numRanges) {
+        std::lock_guard<std::mutex> lock(mutex);
+        cv.notify_all();
+      }
+    }
+  }
+};
+
+}  // namespace
+
+unsigned int NumWorkerThreads() { return pool().size(); }
+
+void RunAsync(std::function<void()> task) {
+  // Without worker threads nobody else would ever run the task.
+  if (pool().size() == 1) {
+    task();
+    return;
+  }
+  pool().submit(std::move(task));
+}
+
+void ParallelFor(size_t begin, size_t end, size_t grain,
+                 const std::function<void(size_t, size_t)>& fn) {
+  if (end <= begin) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+  size_t numRanges = (end - begin + grain - 1) / grain;
+  if (numRanges == 1 || pool().size() == 1) {
+    fn(begin, end);
+    return;
+  }
+
+  std::shared_ptr<ParallelForState> state =
+      std::make_shared<ParallelForState>();
+  state->fn = fn;
+  state->begin = begin;
+  state->end = end;
+  state->grain = grain;
+  state->numRanges = numRanges;
+  state->next = 0;
+  state->done = 0;
+
+  size_t helpers = std::min<size_t>(numRanges, pool().size()) - 1;
+  for (size_t i = 0; i < helpers; i++) {
+    pool().submit([state] { state->run(); });
+  }
+  state->run();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cv.wait(lock, [&] { return state->done == state->numRanges; });
+}
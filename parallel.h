@@ -0,0 +1,22 @@
+
+#include <cstddef>
+#include <functional>
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// # of threads the worker pool runs, including the calling thread.
+unsigned int NumWorkerThreads();
+
+// Run `task` on the worker pool without waiting for it. With a single
+// thread the task runs before the call returns.
+void RunAsync(std::function<void()> task);
+
+// Split [begin, end) into ranges of about `grain` items and run `fn` on them
+// on the worker pool. The calling thread takes part and the call returns
+// once every range is done, so it is safe to nest and to call while
+// RunAsync() tasks keep the workers busy.
+void ParallelFor(size_t begin, size_t end, size_t grain,
+                 const std::function<void(size_t, size_t)>& fn);
+
+#endif
@@ -0,0 +1,115 @@
+#include "passtimer.h"
+
+#include <cstring>
+
+#include "profiler.h"
+
+const char* FramePassName(FramePass pass) {
+  switch (pass) {
+    case kPassCull:
+      return "cull";
+    case kPassOcclusion:
+      return "occlusion";
+    case kPassFill:
+      return "fill";
+    case kPassBackFace:
+      return "back face";
+    case kPassWire:
+      return "wire";
+    default:
+      return "";
+  }
+}
+
+PassTimers g_pass_timers;
+
+PassTimers::PassTimers() : enabled_(false), frame_(0) {
+  memset(queries_, 0, sizeof(queries_));
+  memset(issued_, 0, sizeof(issued_));
+  memset(cpuBegin_, 0, sizeof(cpuBegin_));
+  memset(cpuTotal_, 0, sizeof(cpuTotal_));
+  memset(gpuTotal_, 0, sizeof(gpuTotal_));
+  cpuFrames_ = gpuFrames_ = 0;
+}
+
+void PassTimers::init() {
+  if (GLEW_VERSION_3_3 || GLEW_ARB_timer_query) {
+    glGenQueries(kQueryFrames * kNumFramePasses, &queries_[0][0]);
+  }
+}
+
+void PassTimers::release() {
+  if (gpuTimed()) {
+    glDeleteQueries(kQueryFrames * kNumFramePasses, &queries_[0][0]);
+    memset(queries_, 0, sizeof(queries_));
+    memset(issued_, 0, sizeof(issued_));
+  }
+}
+
+void PassTimers::begin(FramePass pass) {
+  if (!enabled_) {
+    return;
+  }
+  cpuBegin_[pass] = ProfileClock();
+  if (gpuTimed() && pass != kPassCull && pass != kPassOcclusion) {
+    int slot = frame_ % kQueryFrames;
+    glBeginQuery(GL_TIME_ELAPSED, queries_[slot][pass]);
+    issued_[slot][pass] = true;
+  }
+}
+
+void PassTimers::end(FramePass pass) {
+  if (!enabled_) {
+    return;
+  }
+  cpuTotal_[pass] += ProfileClock() - cpuBegin_[pass];
+  if (issued_[frame_ % kQueryFrames][pass]) {
+    glEndQuery(GL_TIME_ELAPSED);
+  }
+}
+
+void PassTimers::endFrame() {
+  if (!enabled_) {
+    return;
+  }
+  cpuFrames_++;
+  frame_++;
+  // The slot the next frame reuses was issued kQueryFrames - 1 frames ago.
+  // If the GPU is further behind than that its results are dropped rather
+  // than waited for.
+  int slot = frame_ % kQueryFrames;
+  bool any = false;
+  for (int p = 0; p < kNumFramePasses; p++) {
+    if (!issued_[slot][p]) {
+      continue;
+    }
+    issued_[slot][p] = false;
+    GLint available = 0;
+    glGetQueryObjectiv(queries_[slot][p], GL_QUERY_RESULT_AVAILABLE,
+                       &available);
+    if (available) {
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(queries_[slot][p], GL_QUERY_RESULT, &ns);
+      gpuTotal_[p] += ns;
+      any = true;
+    }
+  }
+  if (any) {
+    gpuFrames_++;
+  }
+}
+
+void PassTimers::report(double cpuMs[kNumFramePasses],
+                        double gpuMs[kNumFramePasses]) {
+  for (int p = 0; p < kNumFramePasses; p++) {
+    if (cpuFrames_ > 0) {
+      cpuMs[p] = cpuTotal_[p] / 1e6 / cpuFrames_;
+    }
+    if (gpuFrames_ > 0) {
+      gpuMs[p] = gpuTotal_[p] / 1e6 / gpuFrames_;
+    }
+  }
+  memset(cpuTotal_, 0, sizeof(cpuTotal_));
+  memset(gpuTotal_, 0, sizeof(gpuTotal_));
+  cpuFrames_ = gpuFrames_ = 0;
+}
@@ -0,0 +1,74 @@
+#include <GL/glew.h>
+
+#include <cstdint>
+
+#ifndef PASSTIMER_H
+#define PASSTIMER_H
+
+// Stages of a frame timed by PassTimers. Culling runs on the CPU only, so
+// it has no GPU time.
+enum FramePass {
+  kPassCull,
+  kPassOcclusion,
+  kPassFill,
+  kPassBackFace,  // core renderer with face culling
+  kPassWire,      // wireframe drawn as lines
+  kNumFramePasses
+};
+
+// Name of `pass` for reports.
+const char* FramePassName(FramePass pass);
+
+// Frames of GL_TIME_ELAPSED queries in flight. Results are read when the
+// ring comes around, which is late enough that they never stall.
+const int kQueryFrames = 3;
+
+// CPU and GPU time of each pass, averaged over the frames between two
+// calls to report(). The CPU time is what submitting the pass costs; the
+// GPU time comes from GL_TIME_ELAPSED queries, which need OpenGL 3.3 or
+// ARB_timer_query. Passes must not overlap.
+class PassTimers {
+ public:
+  PassTimers();
+
+  // Create the queries. Without timer queries only the CPU is timed.
+  void init();
+  void release();
+
+  // Disabled timers do nothing. Call between frames.
+  void setEnabled(bool enabled) { enabled_ = enabled; }
+  bool enabled() const { return enabled_; }
+  bool gpuTimed() const { return queries_[0][0] != 0; }
+
+  void begin(FramePass pass);
+  void end(FramePass pass);
+
+  // Call once per frame after the last pass. Collects the results of the
+  // oldest frame in the ring.
+  void endFrame();
+
+  // Average milliseconds per frame of each pass since the last report. A
+  // pass that did not run reports 0. If no frame was timed, `cpuMs` and
+  // `gpuMs` are left as they are.
+  void report(double cpuMs[kNumFramePasses], double gpuMs[kNumFramePasses]);
+
+ private:
+  PassTimers(const PassTimers&);
+  PassTimers& operator=(const PassTimers&);
+
+  bool enabled_;
+  int frame_;
+  GLuint queries_[kQueryFrames][kNumFramePasses];
+  bool issued_[kQueryFrames][kNumFramePasses];
+  uint64_t cpuBegin_[kNumFramePasses];
+  uint64_t cpuTotal_[kNumFramePasses];  // nanoseconds since the last report
+  uint64_t gpuTotal_[kNumFramePasses];
+  int cpuFrames_;
+  int gpuFrames_;
+};
+
+// Timers of the viewer's frames. Not in global.h, which the GL-free
+// benchmarks link.
+extern PassTimers g_pass_timers;
+
+#endif
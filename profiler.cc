@@ -0,0 +1,139 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace  // Local utility functions
+{
+// Zones kept per thread. Older ones are overwritten.
+const size_t kProfileZones = 1 << 16;
+
+struct Zone {
+  const char* name;
+  uint64_t begin;
+  uint64_t end;
+};
+
+// Ring buffer of one thread. Only the owning thread writes it; `count` is
+// published with release semantics so WriteChromeTrace can read it.
+struct ThreadProfile {
+  int id;
+  const char* name;
+  std::vector<Zone> zones;
+  std::atomic<uint64_t> count;
+};
+
+std::mutex& registryMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Profiles of every thread that recorded a zone. They outlive their
+// threads, so zones of finished threads are still written.
+std::vector<std::unique_ptr<ThreadProfile> >& registry() {
+  static std::vector<std::unique_ptr<ThreadProfile> > profiles;
+  return profiles;
+}
+
+ThreadProfile* threadProfile() {
+  thread_local ThreadProfile* profile = NULL;
+  if (!profile) {
+    std::unique_ptr<ThreadProfile> p(new ThreadProfile);
+    p->name = NULL;
+    p->zones.resize(kProfileZones);
+    p->count = 0;
+    std::lock_guard<std::mutex> lock(registryMutex());
+    p->id = registry().size();
+    profile = p.get();
+    registry().push_back(std::move(p));
+  }
+  return profile;
+}
+}  // namespace
+
+void RecordZone(const char* name, uint64_t begin, uint64_t end) {
+  ThreadProfile* p = threadProfile();
+  uint64_t n = p->count.load(std::memory_order_relaxed);
+  Zone& z = p->zones[n % kProfileZones];
+  z.name = name;
+  z.begin = begin;
+  z.end = end;
+  p->count.store(n + 1, std::memory_order_release);
+}
+
+void ProfileThreadName(const char* name) {
+  if (g_profile) {
+    threadProfile()->name = name;
+  }
+}
+
+bool WriteChromeTrace(const std::string& filename) {
+  FILE* fp = fopen(filename.c_str(), "w");
+  if (!fp) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(registryMutex());
+  const std::vector<std::unique_ptr<ThreadProfile> >& profiles = registry();
+
+  // Timestamps start at the first zone.
+  uint64_t origin = UINT64_MAX;
+  for (size_t t = 0; t < profiles.size(); t++) {
+    const ThreadProfile& p = *profiles[t];
+    uint64_t n = p.count.load(std::memory_order_acquire);
+    for (uint64_t i = n > kProfileZones ? n - kProfileZones : 0; i < n; i++) {
+      origin = std::min(origin, p.zones[i % kProfileZones].begin);
+    }
+  }
+
+  fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  const char* separator = "";
+  uint64_t dropped = 0;
+  for (size_t t = 0; t < profiles.size(); t++) {
+    const ThreadProfile& p = *profiles[t];
+    if (p.name) {
+      fprintf(fp,
+              "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+              "\"tid\": %d, \"args\": {\"name\": %s}}",
+              separator, p.id, QuoteJson(p.name).c_str());
+      separator = ",\n";
+    }
+    uint64_t n = p.count.load(std::memory_order_acquire);
+    uint64_t first = n > kProfileZones ? n - kProfileZones : 0;
+    dropped += first;
+    for (uint64_t i = first; i < n; i++) {
+      const Zone& z = p.zones[i % kProfileZones];
+      fprintf(fp,
+              "%s{\"name\": %s, \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+              "\"ts\": %.3f, \"dur\": %.3f}",
+              separator, QuoteJson(z.name).c_str(), p.id,
+              (z.begin - origin) / 1e3, (z.end - z.begin) / 1e3);
+      separator = ",\n";
+    }
+  }
+  fprintf(fp, "\n]}\n");
+  if (dropped > 0) {
+    printf("Profile: %d oldest zones were overwritten\n", (int)dropped);
+  }
+  return fclose(fp) == 0;
+}
+
+std::string QuoteJson(const char* s) {
+  std::string q = "\"";
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      q += '\\';
+      q += *s;
+    } else if ((unsigned char)*s < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", *s);
+      q += escaped;
+    } else {
+      q += *s;
+    }
+  }
+  return q + "\"";
+}
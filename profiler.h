@@ -0,0 +1,74 @@
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "global.h"
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Nanoseconds on the monotonic clock.
+inline uint64_t ProfileClock() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Measures one interval on the monotonic clock.
+class Stopwatch {
+ public:
+  Stopwatch() : start_(0), end_(0) {}
+
+  void start() { start_ = ProfileClock(); }
+  void end() { end_ = ProfileClock(); }
+
+  double msec() const { return (end_ - start_) / 1e6; }
+  double usec() const { return (end_ - start_) / 1e3; }
+
+ private:
+  uint64_t start_;
+  uint64_t end_;
+};
+
+// Add the zone `name` from `begin` to `end` on ProfileClock() to the
+// calling thread's ring buffer. ProfileZone does this for scopes.
+void RecordZone(const char* name, uint64_t begin, uint64_t end);
+
+// Times the enclosing scope as a zone of the profile while g_profile is
+// set; otherwise it costs a branch. `name` has to outlive the profile,
+// which string literals do. Zones of one thread nest by scope.
+class ProfileZone {
+ public:
+  explicit ProfileZone(const char* name)
+      : name_(name), begin_(g_profile ? ProfileClock() : 0) {}
+  ~ProfileZone() {
+    if (begin_) {
+      RecordZone(name_, begin_, ProfileClock());
+    }
+  }
+
+ private:
+  ProfileZone(const ProfileZone&);
+  ProfileZone& operator=(const ProfileZone&);
+
+  const char* name_;
+  uint64_t begin_;
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) \
+  ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+// Name the calling thread in the trace while g_profile is set. `name` has
+// to outlive the profile.
+void ProfileThreadName(const char* name);
+
+// Write the zones still held by the ring buffers as Chrome trace JSON,
+// which chrome://tracing and Perfetto open.
+bool WriteChromeTrace(const std::string& filename);
+
+// `s` as a quoted JSON string, control characters escaped as \u00XX.
+std::string QuoteJson(const char* s);
+
+#endif
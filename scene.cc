@@ -0,0 +1,295 @@
+#include <GL/glew.h>
+
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "drawobject.h"
+#include "global.h"
+#include "objutil.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "scene.h"
+#include "texutil.h"
+#include "util.h"
+
+namespace  // Local utility functions
+{
+void identity(float m[16]) {
+  memset(m, 0, 16 * sizeof(float));
+  m[0] = m[5] = m[10] = m[15] = 1.0f;
+}
+
+bool isIdentity(const float m[16]) {
+  float id[16];
+  identity(id);
+  return memcmp(m, id, sizeof(id)) == 0;
+}
+
+// m = m * t, as the GL matrix stack composes.
+void compose(float m[16], const float t[16]) {
+  float r[16];
+  MultiplyMatrix(m, t, r);
+  memcpy(m, r, sizeof(r));
+}
+
+// Same as glRotatef.
+void rotationMatrix(float degrees, float x, float y, float z, float m[16]) {
+  identity(m);
+  float len = sqrtf(x * x + y * y + z * z);
+  if (len == 0.0f) {
+    return;
+  }
+  x /= len;
+  y /= len;
+  z /= len;
+  float a = degrees * 3.14159265f / 180.0f;
+  float c = cosf(a), s = sinf(a), t = 1.0f - c;
+  m[0] = t * x * x + c;
+  m[1] = t * x * y + s * z;
+  m[2] = t * x * z - s * y;
+  m[4] = t * x * y - s * z;
+  m[5] = t * y * y + c;
+  m[6] = t * y * z + s * x;
+  m[8] = t * x * z + s * y;
+  m[9] = t * y * z - s * x;
+  m[10] = t * z * z + c;
+}
+
+// Parse the transform keywords that follow the model on a scene line.
+bool parseTransform(std::istringstream& in, float m[16]) {
+  std::vector<std::string> words;
+  std::string word;
+  while (in >> word) {
+    words.push_back(word);
+  }
+  identity(m);
+  for (size_t i = 0; i < words.size();) {
+    // Up to four numbers follow the keyword.
+    float t[16];
+    identity(t);
+    float v[4];
+    size_t n = 0;
+    for (; n < 4 && i + 1 + n < words.size(); n++) {
+      char* end;
+      v[n] = strtof(words[i + 1 + n].c_str(), &end);
+      if (*end != '\0') {
+        break;
+      }
+    }
+    if (words[i] == "translate" && n >= 3) {
+      t[12] = v[0];
+      t[13] = v[1];
+      t[14] = v[2];
+      n = 3;
+    } else if (words[i] == "rotate" && n >= 4) {
+      rotationMatrix(v[0], v[1], v[2], v[3], t);
+      n = 4;
+    } else if (words[i] == "scale" && n >= 1) {
+      // One factor scales uniformly.
+      n = n >= 3 ? 3 : 1;
+      t[0] = v[0];
+      t[5] = n == 3 ? v[1] : v[0];
+      t[10] = n == 3 ? v[2] : v[0];
+    } else {
+      return false;
+    }
+    compose(m, t);
+    i += 1 + n;
+  }
+  return true;
+}
+
+// Grow [bmin, bmax] by the box [lo, hi] transformed by `m`.
+void mergeTransformedBox(const float lo[3], const float hi[3],
+                         const float m[16], float bmin[3], float bmax[3]) {
+  for (int corner = 0; corner < 8; corner++) {
+    float p[3] = {(corner & 1) ? hi[0] : lo[0], (corner & 2) ? hi[1] : lo[1],
+                  (corner & 4) ? hi[2] : lo[2]};
+    for (int k = 0; k < 3; k++) {
+      float v = m[k] * p[0] + m[4 + k] * p[1] + m[8 + k] * p[2] + m[12 + k];
+      bmin[k] = std::min(bmin[k], v);
+      bmax[k] = std::max(bmax[k], v);
+    }
+  }
+}
+}  // namespace
+
+bool IsSceneFile(const std::string& filename) {
+  const std::string suffix = ".scene";
+  return filename.size() > suffix.size() &&
+         filename.compare(filename.size() - suffix.size(), suffix.size(),
+                          suffix) == 0;
+}
+
+bool ReadScene(const std::string& filename, std::vector<SceneModel>* models) {
+  std::ifstream file(filename.c_str());
+  if (!file) {
+    std::cerr << "Unable to open scene " << filename << std::endl;
+    return false;
+  }
+  std::string base_dir = GetBaseDir(filename);
+  std::map<std::string, size_t> index;
+  std::string line;
+  int lineno = 0;
+  while (std::getline(file, line)) {
+    lineno++;
+    size_t comment = line.find('#');
+    if (comment != std::string::npos) {
+      line.erase(comment);
+    }
+    std::istringstream in(line);
+    std::string path;
+    if (!(in >> path)) {
+      continue;
+    }
+    float m[16];
+    if (!parseTransform(in, m)) {
+      std::cerr << filename << ":" << lineno << ": bad transform" << std::endl;
+      return false;
+    }
+    if (!base_dir.empty() && path[0] != '/') {
+      path = base_dir + "/" + path;
+    }
+    std::map<std::string, size_t>::iterator it = index.find(path);
+    if (it == index.end()) {
+      it = index.insert(std::make_pair(path, models->size())).first;
+      models->push_back(SceneModel());
+      models->back().filename = path;
+    }
+    std::vector<float>& instances = (*models)[it->second].instances;
+    instances.insert(instances.end(), m, m + 16);
+  }
+  return true;
+}
+
+bool LoadScene(float bmin[3], float bmax[3],
+               std::vector<DrawObject>* drawObjects,
+               std::vector<tinyobj::material_t>& materials,
+               std::map<std::string, GLuint>& textures,
+               const char* filename) {
+  std::vector<SceneModel> models;
+  if (!ReadScene(filename, &models)) {
+    return false;
+  }
+  if (models.empty()) {
+    std::cerr << "Scene " << filename << " has no models" << std::endl;
+    return false;
+  }
+
+  // Read the models in parallel; each one converts its shapes on the same
+  // pool. Only the uploads below need the GL thread.
+  Stopwatch tm;
+  tm.start();
+  TextureLoader textureLoader;
+  std::vector<ObjGeometry> geometry(models.size());
+  std::vector<char> ok(models.size(), 0);
+  ParallelFor(0, models.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      ok[i] = ReadObjGeometry(models[i].filename.c_str(), &textureLoader,
+                              textures, &geometry[i]);
+    }
+  });
+  tm.end();
+  double read_ms = tm.msec();
+  for (size_t i = 0; i < models.size(); i++) {
+    if (!ok[i]) {
+      std::cerr << "Failed to load scene model " << models[i].filename
+                << std::endl;
+      return false;
+    }
+  }
+  tm.start();
+  textureLoader.finish(textures);
+  tm.end();
+  g_load_times.texture_ms = tm.msec();
+
+  g_load_times.cached = true;
+  g_load_times.parse_ms = g_load_times.convert_ms = 0.0;
+  g_load_times.upload_ms = 0.0;
+  for (int k = 0; k < 3; k++) {
+    bmin[k] = std::numeric_limits<float>::max();
+    bmax[k] = -std::numeric_limits<float>::max();
+  }
+  int copies = 0;
+  long long uniqueTriangles = 0, sceneTriangles = 0;
+  for (size_t i = 0; i < models.size(); i++) {
+    ObjGeometry& g = geometry[i];
+    const std::vector<float>& instances = models[i].instances;
+    size_t first = drawObjects->size();
+    UploadObjGeometry(&g, textures, drawObjects);
+    g_load_times.cached = g_load_times.cached && g.cached;
+    g_load_times.parse_ms += g.parse_ms;
+    g_load_times.convert_ms += g.convert_ms;
+    g_load_times.upload_ms += g.upload_ms;
+
+    // Material IDs index the scene's list from here on.
+    size_t materialBase = materials.size();
+    materials.insert(materials.end(), g.materials.begin(), g.materials.end());
+
+    int numCopies = static_cast<int>(instances.size() / 16);
+    bool instanced = numCopies > 1 || !isIdentity(&instances[0]);
+    GLuint instance_vb_id = 0;
+    int uniqueModelTriangles = 0, modelTriangles = 0;
+    for (size_t j = first; j < drawObjects->size(); j++) {
+      DrawObject& o = (*drawObjects)[j];
+      for (size_t r = 0; r < o.ranges.size(); r++) {
+        o.ranges[r].material_id += materialBase;
+      }
+      uniqueModelTriangles += o.numTriangles;
+      modelTriangles += o.numTriangles * InstanceCount(o);
+      if (!instanced) {
+        continue;
+      }
+      if (!o.instances.empty()) {
+        // A shape repeated within the model: every copy of the model places
+        // every copy of the shape.
+        std::vector<float> placed(instances.size() * InstanceCount(o));
+        float* m = placed.data();
+        for (size_t c = 0; c < instances.size(); c += 16) {
+          for (size_t k = 0; k < o.instances.size(); k += 16, m += 16) {
+            MultiplyMatrix(&instances[c], &o.instances[k], m);
+          }
+        }
+        o.instances.swap(placed);
+        UploadInstances(&o);
+        continue;
+      }
+      if (instance_vb_id == 0) {
+        glGenBuffers(1, &instance_vb_id);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vb_id);
+        BufferInstances(instances);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+      }
+      o.instances = instances;
+      o.instance_vb_id = instance_vb_id;
+    }
+    for (size_t c = 0; c < instances.size(); c += 16) {
+      mergeTransformedBox(g.bmin, g.bmax, &instances[c], bmin, bmax);
+    }
+    copies += numCopies;
+    uniqueTriangles += uniqueModelTriangles;
+    sceneTriangles += (long long)modelTriangles * numCopies;
+    printf("Scene model %s: %d copies, %d triangles each\n",
+           models[i].filename.c_str(), numCopies, modelTriangles);
+  }
+  printf("Scene: %d models, %d copies, %lld unique / %lld drawn triangles "
+         "(read in %d [ms])\n",
+         (int)models.size(), copies, uniqueTriangles, sceneTriangles,
+         (int)read_ms);
+  printf("bmin = %f, %f, %f\n", bmin[0], bmin[1], bmin[2]);
+  printf("bmax = %f, %f, %f\n", bmax[0], bmax[1], bmax[2]);
+  return true;
+}
@@ -0,0 +1,46 @@
+#include <GL/glew.h>
+
+#include <tiny_obj_loader.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "drawobject.h"
+
+#ifndef SCENE_H
+#define SCENE_H
+
+// A scene file lists OBJ models, one copy per line:
+//
+//   # comment
+//   tree.obj translate 4 0 -2 rotate 90 0 1 0 scale 0.5
+//
+// Paths are relative to the scene file. The transforms apply in the order
+// given, like glTranslatef, glRotatef (degrees around an axis) and
+// glScalef with one or three factors.
+
+// Model of a scene with the model matrices of all its copies.
+typedef struct {
+  std::string filename;
+  std::vector<float> instances;  // column-major, 16 floats each
+} SceneModel;
+
+// True if `filename` names a scene file rather than an OBJ file.
+bool IsSceneFile(const std::string& filename);
+
+// Read the models of a scene, each listed once in the order of their first
+// copy.
+bool ReadScene(const std::string& filename, std::vector<SceneModel>* models);
+
+// Load every model of the scene once, reading the files in parallel. The
+// copies of a model become instances of its objects, sharing one matrix
+// buffer, unless the model is placed once without a transform. `materials`
+// and `bmin`, `bmax` cover the whole scene.
+bool LoadScene(float bmin[3], float bmax[3],
+               std::vector<DrawObject>* drawObjects,
+               std::vector<tinyobj::material_t>& materials,
+               std::map<std::string, GLuint>& textures,
+               const char* filename);
+
+#endif
@@ -0,0 +1,317 @@
+#include "texcache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace  // Local utility functions
+{
+const char kMagic[8] = {'T', 'E', 'X', 'C', 'A', 'C', 'H', 'E'};
+
+// Level data is aligned so the mapped file can be uploaded without copying.
+const size_t kLevelAlignment = 16;
+
+size_t alignUp(size_t n) {
+  return (n + kLevelAlignment - 1) & ~(kLevelAlignment - 1);
+}
+
+// Header of a cache file, followed by one CacheLevel per mip level.
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t internalFormat;
+  uint32_t format;
+  uint32_t compressed;
+  uint64_t hash;
+  uint32_t numLevels;
+  uint32_t pad;
+};
+
+struct CacheLevel {
+  int32_t w, h;
+  uint64_t offset;
+  uint64_t bytes;
+};
+
+// Halve an image with a 2x2 box filter. Odd edges repeat their last texel.
+void downsample(const unsigned char* src, int w, int h, int comp,
+                unsigned char* dst, int dw, int dh) {
+  for (int y = 0; y < dh; y++) {
+    int y0 = std::min(2 * y, h - 1);
+    int y1 = std::min(2 * y + 1, h - 1);
+    for (int x = 0; x < dw; x++) {
+      int x0 = std::min(2 * x, w - 1);
+      int x1 = std::min(2 * x + 1, w - 1);
+      for (int c = 0; c < comp; c++) {
+        int sum =
+            src[(y0 * w + x0) * comp + c] + src[(y0 * w + x1) * comp + c] +
+            src[(y1 * w + x0) * comp + c] + src[(y1 * w + x1) * comp + c];
+        dst[(y * dw + x) * comp + c] =
+            static_cast<unsigned char>((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+uint16_t packRGB565(const int c[3]) {
+  return static_cast<uint16_t>(((c[0] * 31 + 127) / 255) << 11 |
+                               ((c[1] * 63 + 127) / 255) << 5 |
+                               ((c[2] * 31 + 127) / 255));
+}
+
+void unpackRGB565(uint16_t v, int c[3]) {
+  int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+}
+
+// Encode the colors of a 4x4 block of RGBA texels as a BC1 color block.
+// Endpoints are the inset bounding box of the block's colors, which is fast
+// and good enough for preview rendering.
+void encodeColorBlock(const unsigned char block[16][4], unsigned char* out) {
+  int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < 3; c++) {
+      lo[c] = std::min(lo[c], int(block[i][c]));
+      hi[c] = std::max(hi[c], int(block[i][c]));
+    }
+  }
+  for (int c = 0; c < 3; c++) {
+    int inset = (hi[c] - lo[c]) / 16;
+    lo[c] += inset;
+    hi[c] -= inset;
+  }
+
+  uint16_t c0 = packRGB565(hi), c1 = packRGB565(lo);
+  uint32_t indices = 0;
+  if (c0 < c1) {
+    std::swap(c0, c1);
+  }
+  if (c0 != c1) {
+    // Four-color mode: c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1.
+    int palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    for (int i = 0; i < 16; i++) {
+      int best = 0, bestDist = 1 << 30;
+      for (int p = 0; p < 4; p++) {
+        int dr = block[i][0] - palette[p][0];
+        int dg = block[i][1] - palette[p][1];
+        int db = block[i][2] - palette[p][2];
+        int dist = dr * dr + dg * dg + db * db;
+        if (dist < bestDist) {
+          bestDist = dist;
+          best = p;
+        }
+      }
+      indices |= uint32_t(best) << (2 * i);
+    }
+  }
+  out[0] = c0 & 0xff;
+  out[1] = c0 >> 8;
+  out[2] = c1 & 0xff;
+  out[3] = c1 >> 8;
+  for (int i = 0; i < 4; i++) {
+    out[4 + i] = (indices >> (8 * i)) & 0xff;
+  }
+}
+
+// Encode the alpha of a 4x4 block as a BC3 alpha block in 8-alpha mode.
+void encodeAlphaBlock(const unsigned char block[16][4], unsigned char* out) {
+  int a0 = 0, a1 = 255;
+  for (int i = 0; i < 16; i++) {
+    a0 = std::max(a0, int(block[i][3]));
+    a1 = std::min(a1, int(block[i][3]));
+  }
+  out[0] = static_cast<unsigned char>(a0);
+  out[1] = static_cast<unsigned char>(a1);
+  uint64_t indices = 0;
+  if (a0 > a1) {
+    for (int i = 0; i < 16; i++) {
+      // Palette position 0..7 from a1 to a0, mapped to BC3's index order
+      // (0: a0, 1: a1, 2..7: interpolated from a0 towards a1).
+      int t = ((block[i][3] - a1) * 7 + (a0 - a1) / 2) / (a0 - a1);
+      int index = (t == 7) ? 0 : (t == 0) ? 1 : 8 - t;
+      indices |= uint64_t(index) << (3 * i);
+    }
+  }
+  for (int i = 0; i < 6; i++) {
+    out[2 + i] = (indices >> (8 * i)) & 0xff;
+  }
+}
+
+void compressLevel(const unsigned char* src, int w, int h, int comp,
+                   unsigned char* dst) {
+  size_t blockBytes = (comp == 4) ? 16 : 8;
+  for (int by = 0; by < (h + 3) / 4; by++) {
+    for (int bx = 0; bx < (w + 3) / 4; bx++) {
+      unsigned char block[16][4];
+      for (int i = 0; i < 16; i++) {
+        // Blocks past the edge repeat the last row/column.
+        int x = std::min(bx * 4 + (i & 3), w - 1);
+        int y = std::min(by * 4 + (i >> 2), h - 1);
+        const unsigned char* p = src + (size_t(y) * w + x) * comp;
+        block[i][0] = p[0];
+        block[i][1] = p[1];
+        block[i][2] = p[2];
+        block[i][3] = (comp == 4) ? p[3] : 255;
+      }
+      if (comp == 4) {
+        encodeAlphaBlock(block, dst);
+        encodeColorBlock(block, dst + 8);
+      } else {
+        encodeColorBlock(block, dst);
+      }
+      dst += blockBytes;
+    }
+  }
+}
+
+}  // namespace
+
+uint64_t HashBytes(const unsigned char* data, size_t size) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; i++) {
+    h = (h ^ data[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+std::string TextureCacheFilename(const std::string& texture_filename) {
+  return texture_filename + ".texcache";
+}
+
+void BuildTextureImage(const unsigned char* pixels, int w, int h, int comp,
+                       bool compress, TextureImage* image) {
+  image->format = (comp == 4) ? GL_RGBA : GL_RGB;
+  image->compressed = compress;
+  if (compress) {
+    image->internalFormat = (comp == 4) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+                                        : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  } else {
+    image->internalFormat = (comp == 4) ? GL_RGBA8 : GL_RGB8;
+  }
+  image->levels.clear();
+  image->storage.clear();
+  image->file.reset();
+
+  std::vector<unsigned char> level(pixels, pixels + size_t(w) * h * comp);
+  std::vector<unsigned char> next;
+  for (;;) {
+    TextureLevel l;
+    l.w = w;
+    l.h = h;
+    l.offset = alignUp(image->storage.size());
+    if (compress) {
+      l.bytes = size_t((w + 3) / 4) * ((h + 3) / 4) * ((comp == 4) ? 16 : 8);
+      image->storage.resize(l.offset + l.bytes);
+      compressLevel(level.data(), w, h, comp, &image->storage[l.offset]);
+    } else {
+      l.bytes = level.size();
+      image->storage.resize(l.offset + l.bytes);
+      memcpy(&image->storage[l.offset], level.data(), l.bytes);
+    }
+    image->levels.push_back(l);
+    if (w == 1 && h == 1) {
+      break;
+    }
+
+    int dw = std::max(1, w / 2), dh = std::max(1, h / 2);
+    next.resize(size_t(dw) * dh * comp);
+    downsample(level.data(), w, h, comp, next.data(), dw, dh);
+    level.swap(next);
+    w = dw;
+    h = dh;
+  }
+}
+
+bool ReadTextureCache(const std::string& cache_filename, uint64_t hash,
+                      bool compress, TextureImage* image) {
+  std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+  if (!file->open(cache_filename) || file->size() < sizeof(CacheHeader)) {
+    return false;
+  }
+  CacheHeader header;
+  memcpy(&header, file->data(), sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kTextureCacheVersion || header.hash != hash ||
+      (header.compressed != 0) != compress || header.numLevels == 0 ||
+      sizeof(CacheHeader) + header.numLevels * sizeof(CacheLevel) >
+          file->size()) {
+    return false;
+  }
+
+  image->internalFormat = header.internalFormat;
+  image->format = header.format;
+  image->compressed = header.compressed != 0;
+  image->levels.clear();
+  image->storage.clear();
+  for (uint32_t i = 0; i < header.numLevels; i++) {
+    CacheLevel cl;
+    memcpy(&cl, file->data() + sizeof(CacheHeader) + i * sizeof(CacheLevel),
+           sizeof(cl));
+    if (cl.offset + cl.bytes > file->size()) {
+      return false;
+    }
+    TextureLevel l;
+    l.w = cl.w;
+    l.h = cl.h;
+    l.offset = cl.offset;
+    l.bytes = cl.bytes;
+    image->levels.push_back(l);
+  }
+  image->file = file;
+  return true;
+}
+
+bool WriteTextureCache(const std::string& cache_filename, uint64_t hash,
+                       const TextureImage& image) {
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kTextureCacheVersion;
+  header.internalFormat = image.internalFormat;
+  header.format = image.format;
+  header.compressed = image.compressed ? 1 : 0;
+  header.hash = hash;
+  header.numLevels = image.levels.size();
+
+  // Level data follows the level table, keeping its relative layout.
+  size_t dataStart =
+      alignUp(sizeof(CacheHeader) + image.levels.size() * sizeof(CacheLevel));
+  std::vector<CacheLevel> table(image.levels.size());
+  for (size_t i = 0; i < image.levels.size(); i++) {
+    table[i].w = image.levels[i].w;
+    table[i].h = image.levels[i].h;
+    table[i].offset = dataStart + image.levels[i].offset;
+    table[i].bytes = image.levels[i].bytes;
+  }
+  const TextureLevel& last = image.levels.back();
+  size_t dataBytes = last.offset + last.bytes;
+
+  // Write to a temporary file first so readers never map a partial cache.
+  std::string tmp_filename = cache_filename + ".tmp";
+  FILE* fp = fopen(tmp_filename.c_str(), "wb");
+  if (!fp) {
+    return false;
+  }
+  static const unsigned char zeros[kLevelAlignment] = {0};
+  size_t pad =
+      dataStart - sizeof(CacheHeader) - table.size() * sizeof(CacheLevel);
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            fwrite(table.data(), sizeof(CacheLevel), table.size(), fp) ==
+                table.size() &&
+            fwrite(zeros, 1, pad, fp) == pad &&
+            fwrite(image.data(), 1, dataBytes, fp) == dataBytes;
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok || rename(tmp_filename.c_str(), cache_filename.c_str()) != 0) {
+    remove(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
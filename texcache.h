@@ -0,0 +1,57 @@
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+
+// Bump whenever the layout of the cache file or the mip filter changes.
+const unsigned int kTextureCacheVersion = 1;
+
+// One level of a mip chain. `offset` is relative to TextureImage::data().
+typedef struct {
+  int w, h;
+  size_t offset;
+  size_t bytes;
+} TextureLevel;
+
+// A full mip chain, either built in memory or read from a mapped cache file.
+struct TextureImage {
+  GLenum internalFormat;  // GL_RGB8, GL_RGBA8 or an S3TC format
+  GLenum format;          // GL_RGB or GL_RGBA
+  bool compressed;
+  std::vector<TextureLevel> levels;
+  std::vector<unsigned char> storage;
+  std::shared_ptr<MappedFile> file;
+
+  const unsigned char* data() const {
+    return file ? file->data() : storage.data();
+  }
+};
+
+// 64-bit FNV-1a hash of a file's contents, used to key the cache.
+uint64_t HashBytes(const unsigned char* data, size_t size);
+
+// Cache file that belongs to the texture `texture_filename`.
+std::string TextureCacheFilename(const std::string& texture_filename);
+
+// Build the mip chain of an 8-bit RGB (comp = 3) or RGBA (comp = 4) image
+// with a box filter. With `compress` every level is encoded to BC1 (RGB) or
+// BC3 (RGBA) in software.
+void BuildTextureImage(const unsigned char* pixels, int w, int h, int comp,
+                       bool compress, TextureImage* image);
+
+// Map a cache file. Fails if it was written for other contents, another
+// compression setting or another version.
+bool ReadTextureCache(const std::string& cache_filename, uint64_t hash,
+                      bool compress, TextureImage* image);
+
+bool WriteTextureCache(const std::string& cache_filename, uint64_t hash,
+                       const TextureImage& image);
+
+#endif
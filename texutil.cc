@@ -0,0 +1,216 @@
+#include "texutil.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <set>
+
+#include "global.h"
+#include "mappedfile.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "texcache.h"
+#include "util.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+// A decoded mip chain on its way from a worker to the GL thread. `levels`
+// is empty if the image could not be loaded.
+struct DecodedTexture {
+  std::string texname;
+  std::string filename;
+  bool found;
+  bool cached;  // read from the texture cache
+  TextureImage image;
+};
+
+struct TextureQueue {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<DecodedTexture> decoded;
+  size_t pending;
+  std::set<std::string> started;  // texture paths queued by start()
+};
+
+namespace  // Local utility functions
+{
+// Runs on a worker thread. Reads the mip chain from the texture cache if
+// it matches the file's contents, and decodes and caches it otherwise.
+DecodedTexture decodeTexture(const std::string& texname, bool compress) {
+  PROFILE_ZONE("decode texture");
+  DecodedTexture t;
+  t.texname = texname;
+  t.filename = texname;
+  t.found = false;
+  t.cached = false;
+  if (!FileExists(t.filename)) {
+    return t;
+  }
+  t.found = true;
+
+  MappedFile file;
+  if (!file.open(t.filename)) {
+    return t;
+  }
+  uint64_t hash = HashBytes(file.data(), file.size());
+  std::string cache_filename = TextureCacheFilename(t.filename);
+  if (g_use_mesh_cache &&
+      ReadTextureCache(cache_filename, hash, compress, &t.image)) {
+    t.cached = true;
+    return t;
+  }
+
+  // Have stb_image expand grey and grey+alpha images to RGB and RGBA.
+  int w, h, comp;
+  if (!stbi_info_from_memory(file.data(), file.size(), &w, &h, &comp)) {
+    return t;
+  }
+  int req_comp = (comp == 1) ? STBI_rgb : (comp == 2) ? STBI_rgb_alpha : comp;
+  if (req_comp != STBI_rgb && req_comp != STBI_rgb_alpha) {
+    return t;
+  }
+  unsigned char* pixels =
+      stbi_load_from_memory(file.data(), file.size(), &w, &h, &comp, req_comp);
+  if (!pixels) {
+    return t;
+  }
+  BuildTextureImage(pixels, w, h, req_comp, compress, &t.image);
+  stbi_image_free(pixels);
+
+  if (g_use_mesh_cache &&
+      !WriteTextureCache(cache_filename, hash, t.image)) {
+    std::cerr << "Unable to write texture cache: " << cache_filename
+              << std::endl;
+  }
+  return t;
+}
+
+GLuint uploadTexture(const TextureImage& image) {
+  PROFILE_ZONE("upload texture");
+  GLuint texture_id;
+  glGenTextures(1, &texture_id);
+  glBindTexture(GL_TEXTURE_2D, texture_id);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                  GLint(image.levels.size()) - 1);
+  // Rows of RGB levels are not necessarily 4-byte aligned.
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (size_t i = 0; i < image.levels.size(); i++) {
+    const TextureLevel& l = image.levels[i];
+    const unsigned char* pixels = image.data() + l.offset;
+    if (image.compressed) {
+      glCompressedTexImage2D(GL_TEXTURE_2D, GLint(i), image.internalFormat,
+                             l.w, l.h, 0, GLsizei(l.bytes), pixels);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, GLint(i), image.internalFormat, l.w, l.h, 0,
+                   image.format, GL_UNSIGNED_BYTE, pixels);
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return texture_id;
+}
+
+}  // namespace
+
+std::string TexturePath(const std::string& base_dir,
+                        const std::string& texname) {
+  if (texname.empty() || texname[0] == '/') {
+    return texname;
+  }
+#ifdef _WIN32
+  if (texname[0] == '\\' || (texname.size() > 1 && texname[1] == ':')) {
+    return texname;
+  }
+#endif
+  return base_dir + texname;
+}
+
+void ResolveTextureNames(const std::string& base_dir,
+                         std::vector<tinyobj::material_t>* materials) {
+  for (size_t m = 0; m < materials->size(); m++) {
+    std::string& texname = (*materials)[m].diffuse_texname;
+    texname = TexturePath(base_dir, texname);
+  }
+}
+
+TextureLoader::TextureLoader() : queue_(std::make_shared<TextureQueue>()) {
+  queue_->pending = 0;
+}
+
+TextureLoader::~TextureLoader() {
+  // Wait for outstanding decodes and drop whatever was not uploaded.
+  std::unique_lock<std::mutex> lock(queue_->mutex);
+  queue_->cv.wait(lock, [this] { return queue_->pending == 0; });
+  queue_->decoded.clear();
+}
+
+void TextureLoader::start(const std::vector<tinyobj::material_t>& materials,
+                          const std::map<std::string, GLuint>& textures) {
+  // Workers cannot query GL, so decide on compression here.
+  bool compress = g_compress_textures && GLEW_EXT_texture_compression_s3tc;
+  if (g_compress_textures && !compress) {
+    std::cerr << "S3TC is not supported, textures are not compressed"
+              << std::endl;
+  }
+  for (size_t m = 0; m < materials.size(); m++) {
+    const std::string& texname = materials[m].diffuse_texname;
+    // Only load the texture if it is not already loaded
+    if (texname.empty() || textures.find(texname) != textures.end()) {
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(queue_->mutex);
+      if (!queue_->started.insert(texname).second) {
+        continue;
+      }
+      queue_->pending++;
+    }
+    std::shared_ptr<TextureQueue> queue = queue_;
+    RunAsync([queue, texname, compress] {
+      DecodedTexture t = decodeTexture(texname, compress);
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      queue->decoded.push_back(std::move(t));
+      queue->pending--;
+      queue->cv.notify_all();
+    });
+  }
+}
+
+void TextureLoader::finish(std::map<std::string, GLuint>& textures) {
+  for (;;) {
+    DecodedTexture t;
+    {
+      std::unique_lock<std::mutex> lock(queue_->mutex);
+      queue_->cv.wait(lock, [this] {
+        return !queue_->decoded.empty() || queue_->pending == 0;
+      });
+      if (queue_->decoded.empty()) {
+        return;
+      }
+      t = std::move(queue_->decoded.front());
+      queue_->decoded.pop_front();
+    }
+
+    if (!t.found) {
+      std::cerr << "Unable to find file: " << t.texname << std::endl;
+      continue;
+    }
+    if (t.image.levels.empty()) {
+      std::cerr << "Unable to load texture: " << t.filename << std::endl;
+      continue;
+    }
+    std::cout << "Loaded texture: " << t.filename
+              << ", w = " << t.image.levels[0].w
+              << ", h = " << t.image.levels[0].h
+              << ", comp = " << (t.image.format == GL_RGBA ? 4 : 3)
+              << ", mip levels = " << t.image.levels.size()
+              << (t.image.compressed ? ", compressed" : "")
+              << (t.cached ? " (cached)" : "") << std::endl;
+    textures.insert(std::make_pair(t.texname, uploadTexture(t.image)));
+  }
+}
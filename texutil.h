@@ -0,0 +1,53 @@
+#include <GL/glew.h>
+
+#include <tiny_obj_loader.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef TEXUTIL_H
+#define TEXUTIL_H
+
+struct TextureQueue;
+
+// Path of the texture `texname` named by a material of a model in
+// `base_dir`, which ends in a separator. Textures are keyed by this path, so
+// models in different directories do not share textures of the same name.
+std::string TexturePath(const std::string& base_dir,
+                        const std::string& texname);
+
+// Replace the diffuse texture names of freshly parsed `materials` by their
+// paths. Mesh caches and page files store the resolved names.
+void ResolveTextureNames(const std::string& base_dir,
+                         std::vector<tinyobj::material_t>* materials);
+
+// Decodes the diffuse textures of a model on the worker pool while the
+// caller keeps converting geometry. Only finish() touches OpenGL, so it has
+// to be called on the thread that owns the context.
+class TextureLoader {
+ public:
+  TextureLoader();
+  ~TextureLoader();
+
+  // Queue every diffuse texture of `materials`, whose names are resolved by
+  // ResolveTextureNames(), that is not in `textures` or queued yet. Several
+  // threads may call this at once as long as `textures` does not change
+  // meanwhile.
+  void start(const std::vector<tinyobj::material_t>& materials,
+             const std::map<std::string, GLuint>& textures);
+
+  // Upload decoded textures as they arrive until all are done. Textures that
+  // could not be found or decoded are left out of `textures`, so their
+  // materials are drawn untextured.
+  void finish(std::map<std::string, GLuint>& textures);
+
+ private:
+  TextureLoader(const TextureLoader&);
+  TextureLoader& operator=(const TextureLoader&);
+
+  std::shared_ptr<TextureQueue> queue_;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include "vertexcache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace  // Local utility functions
+{
+// Cache modelled by the optimizer, an LRU of this many vertices.
+const int kOptimizerCacheSize = 32;
+
+const float kCacheDecayPower = 1.5f;
+const float kLastTriangleScore = 0.75f;
+const float kValenceBoostScale = 2.0f;
+const float kValenceBoostPower = 0.5f;
+
+// Valences above this share the score of the last entry.
+const int kMaxValenceScore = 32;
+
+struct ScoreTables {
+  float cache[kOptimizerCacheSize];
+  float valence[kMaxValenceScore + 1];
+
+  ScoreTables() {
+    for (int i = 0; i < kOptimizerCacheSize; i++) {
+      if (i < 3) {
+        // The vertices of the last triangle are reused no matter what, so
+        // they score low to avoid going back and forth.
+        cache[i] = kLastTriangleScore;
+      } else {
+        float scale = 1.0f / (kOptimizerCacheSize - 3);
+        cache[i] = powf(1.0f - (i - 3) * scale, kCacheDecayPower);
+      }
+    }
+    valence[0] = 0.0f;
+    for (int v = 1; v <= kMaxValenceScore; v++) {
+      valence[v] = kValenceBoostScale * powf(float(v), -kValenceBoostPower);
+    }
+  }
+};
+
+// Likelihood that drawing a triangle of a vertex soon pays off.
+float vertexScore(const ScoreTables& tables, int cachePosition,
+                  int remaining) {
+  if (remaining == 0) {
+    return -1.0f;  // no triangles left to draw
+  }
+  float score = 0.0f;
+  if (cachePosition >= 0) {
+    score = tables.cache[cachePosition];
+  }
+  return score + tables.valence[std::min(remaining, kMaxValenceScore)];
+}
+}  // namespace
+
+void SimulateVertexCache(const unsigned int* indices, size_t numIndices,
+                         size_t numVertices, VertexCacheStats* stats) {
+  // A vertex hits while fewer than kVertexCacheSize misses happened since
+  // it was loaded.
+  std::vector<size_t> loadedAt(numVertices, 0);
+  std::vector<char> seen(numVertices, 0);
+  size_t misses = 0;
+  size_t unique = 0;
+  for (size_t i = 0; i < numIndices; i++) {
+    unsigned int v = indices[i];
+    if (!seen[v]) {
+      seen[v] = 1;
+      unique++;
+    } else if (misses - loadedAt[v] < kVertexCacheSize) {
+      continue;
+    }
+    loadedAt[v] = misses;
+    misses++;
+  }
+  stats->triangles += numIndices / 3;
+  stats->vertices += unique;
+  stats->misses += misses;
+}
+
+void OptimizeVertexCache(unsigned int* indices, size_t numIndices) {
+  static const ScoreTables tables;
+  size_t numTriangles = numIndices / 3;
+  if (numTriangles < 2) {
+    return;
+  }
+
+  // Local vertex ids, so the work is proportional to the triangles.
+  std::vector<unsigned int> vertexIds(indices, indices + numIndices);
+  std::sort(vertexIds.begin(), vertexIds.end());
+  vertexIds.erase(std::unique(vertexIds.begin(), vertexIds.end()),
+                  vertexIds.end());
+  size_t n = vertexIds.size();
+  std::vector<unsigned int> local(numIndices);
+  for (size_t i = 0; i < numIndices; i++) {
+    local[i] = std::lower_bound(vertexIds.begin(), vertexIds.end(),
+                                indices[i]) -
+               vertexIds.begin();
+  }
+
+  // Triangles around each vertex; the first `remaining` are not drawn yet.
+  std::vector<unsigned int> adjacencyStart(n + 1, 0);
+  for (size_t i = 0; i < numIndices; i++) {
+    adjacencyStart[local[i] + 1]++;
+  }
+  for (size_t v = 0; v < n; v++) {
+    adjacencyStart[v + 1] += adjacencyStart[v];
+  }
+  std::vector<unsigned int> adjacency(numIndices);
+  std::vector<int> remaining(n, 0);
+  for (size_t i = 0; i < numIndices; i++) {
+    unsigned int v = local[i];
+    adjacency[adjacencyStart[v] + remaining[v]++] = i / 3;
+  }
+
+  std::vector<int> cachePosition(n, -1);
+  std::vector<float> score(n);
+  for (size_t v = 0; v < n; v++) {
+    score[v] = vertexScore(tables, -1, remaining[v]);
+  }
+  std::vector<float> triangleScore(numTriangles);
+  for (size_t t = 0; t < numTriangles; t++) {
+    triangleScore[t] = score[local[3 * t]] + score[local[3 * t + 1]] +
+                       score[local[3 * t + 2]];
+  }
+  std::vector<char> emitted(numTriangles, 0);
+
+  std::vector<unsigned int> cache, nextCache;
+  cache.reserve(kOptimizerCacheSize + 3);
+  nextCache.reserve(kOptimizerCacheSize + 3);
+  std::vector<unsigned int> out;
+  out.reserve(numIndices);
+
+  size_t best = std::max_element(triangleScore.begin(), triangleScore.end()) -
+                triangleScore.begin();
+  size_t scan = 0;  // every triangle before this is emitted
+  for (size_t emittedCount = 0; emittedCount < numTriangles;
+       emittedCount++) {
+    if (best == numTriangles) {
+      // Nothing in the cache has triangles left; start somewhere new.
+      while (emitted[scan]) {
+        scan++;
+      }
+      best = scan;
+    }
+    const unsigned int* tri = &local[3 * best];
+    emitted[best] = 1;
+    for (int k = 0; k < 3; k++) {
+      unsigned int v = tri[k];
+      out.push_back(vertexIds[v]);
+      // Move the triangle behind the ones still to draw.
+      unsigned int* begin = &adjacency[adjacencyStart[v]];
+      unsigned int* last = begin + remaining[v] - 1;
+      std::swap(*std::find(begin, last + 1, unsigned(best)), *last);
+      remaining[v]--;
+    }
+
+    // The triangle's vertices move to the front of the LRU cache.
+    nextCache.assign(tri, tri + 3);
+    for (size_t i = 0; i < cache.size(); i++) {
+      unsigned int v = cache[i];
+      if (v != tri[0] && v != tri[1] && v != tri[2]) {
+        nextCache.push_back(v);
+      }
+    }
+    for (size_t i = 0; i < nextCache.size(); i++) {
+      unsigned int v = nextCache[i];
+      cachePosition[v] = i < size_t(kOptimizerCacheSize) ? int(i) : -1;
+      float newScore = vertexScore(tables, cachePosition[v], remaining[v]);
+      float delta = newScore - score[v];
+      score[v] = newScore;
+      for (int j = 0; j < remaining[v]; j++) {
+        triangleScore[adjacency[adjacencyStart[v] + j]] += delta;
+      }
+    }
+    if (nextCache.size() > size_t(kOptimizerCacheSize)) {
+      nextCache.resize(kOptimizerCacheSize);
+    }
+    cache.swap(nextCache);
+
+    // The next triangle is the best one touching the cache.
+    best = numTriangles;
+    float bestScore = -1.0f;
+    for (size_t i = 0; i < cache.size(); i++) {
+      unsigned int v = cache[i];
+      for (int j = 0; j < remaining[v]; j++) {
+        unsigned int t = adjacency[adjacencyStart[v] + j];
+        if (triangleScore[t] > bestScore) {
+          bestScore = triangleScore[t];
+          best = t;
+        }
+      }
+    }
+  }
+  std::copy(out.begin(), out.end(), indices);
+}
+
+void OptimizeVertexFetch(std::vector<float>* vertices, size_t stride,
+                         std::vector<unsigned int>* indices) {
+  size_t numVertices = vertices->size() / stride;
+  const unsigned int kUnused = ~0u;
+  std::vector<unsigned int> remap(numVertices, kUnused);
+  unsigned int next = 0;
+  for (size_t i = 0; i < indices->size(); i++) {
+    unsigned int& v = (*indices)[i];
+    if (remap[v] == kUnused) {
+      remap[v] = next++;
+    }
+    v = remap[v];
+  }
+  // Keep vertices no index refers to at the end.
+  for (size_t v = 0; v < numVertices; v++) {
+    if (remap[v] == kUnused) {
+      remap[v] = next++;
+    }
+  }
+  std::vector<float> reordered(vertices->size());
+  for (size_t v = 0; v < numVertices; v++) {
+    std::copy(vertices->begin() + v * stride,
+              vertices->begin() + (v + 1) * stride,
+              reordered.begin() + remap[v] * stride);
+  }
+  vertices->swap(reordered);
+}
@@ -0,0 +1,174 @@
+#include "vertexformat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace  // Local utility functions
+{
+const int16_t kPositionRange = 32767;
+
+uint16_t floatToHalf(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint16_t sign = (x >> 16) & 0x8000;
+  int exponent = int((x >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = x & 0x7fffff;
+  if (exponent >= 31) {
+    // Overflow, infinity and NaN.
+    bool nan = ((x >> 23) & 0xff) == 0xff && mantissa != 0;
+    return sign | 0x7c00 | (nan ? 0x200 : 0);
+  }
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return sign;
+    }
+    // Denormal: shift in the implicit bit and round to nearest.
+    mantissa |= 0x800000;
+    int shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    if ((mantissa >> (shift - 1)) & 1) {
+      half++;
+    }
+    return sign | half;
+  }
+  uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+  // Round to nearest; a carry into the exponent is still correct.
+  if (mantissa & 0x1000) {
+    half++;
+  }
+  return half;
+}
+
+uint32_t packNormal(const float n[3]) {
+  uint32_t packed = 0;
+  for (int k = 0; k < 3; k++) {
+    float c = std::min(1.0f, std::max(-1.0f, n[k]));
+    int32_t q = static_cast<int32_t>(lrintf(c * 511.0f));
+    packed |= (static_cast<uint32_t>(q) & 0x3ff) << (10 * k);
+  }
+  return packed;
+}
+
+uint8_t unorm8(float c) {
+  return static_cast<uint8_t>(
+      lrintf(std::min(1.0f, std::max(0.0f, c)) * 255.0f));
+}
+
+VertexLayout makeFloatLayout() {
+  VertexLayout l;
+  l.stride = kVertexStride * sizeof(float);
+  l.position = {3, GL_FLOAT, GL_FALSE, 0};
+  l.normal = {3, GL_FLOAT, GL_FALSE, 3 * sizeof(float)};
+  l.color = {3, GL_FLOAT, GL_FALSE, 6 * sizeof(float)};
+  l.texcoord = {2, GL_FLOAT, GL_FALSE, 9 * sizeof(float)};
+  return l;
+}
+
+VertexLayout makeCompactLayout() {
+  VertexLayout l;
+  l.stride = sizeof(CompactVertex);
+  l.position = {3, GL_SHORT, GL_FALSE, offsetof(CompactVertex, position)};
+  l.normal = {4, GL_INT_2_10_10_10_REV, GL_TRUE,
+              offsetof(CompactVertex, normal)};
+  l.color = {4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(CompactVertex, color)};
+  l.texcoord = {2, GL_HALF_FLOAT, GL_FALSE,
+                offsetof(CompactVertex, texcoord)};
+  return l;
+}
+
+}  // namespace
+
+const VertexLayout& GetVertexLayout(VertexFormat format) {
+  static const VertexLayout floatLayout = makeFloatLayout();
+  static const VertexLayout compactLayout = makeCompactLayout();
+  return format == kVertexFormatCompact ? compactLayout : floatLayout;
+}
+
+void ComputePositionQuantization(const std::vector<float>& vertices,
+                                 float offset[3], float scale[3]) {
+  float bmin[3], bmax[3];
+  for (int k = 0; k < 3; k++) {
+    bmin[k] = std::numeric_limits<float>::max();
+    bmax[k] = -std::numeric_limits<float>::max();
+  }
+  for (size_t i = 0; i + kVertexStride <= vertices.size(); i += kVertexStride) {
+    for (int k = 0; k < 3; k++) {
+      bmin[k] = std::min(bmin[k], vertices[i + k]);
+      bmax[k] = std::max(bmax[k], vertices[i + k]);
+    }
+  }
+  QuantizationFromBounds(bmin, bmax, offset, scale);
+}
+
+void QuantizationFromBounds(const float bmin[3], const float bmax[3],
+                            float offset[3], float scale[3]) {
+  for (int k = 0; k < 3; k++) {
+    if (bmin[k] > bmax[k]) {
+      // Empty box.
+      offset[k] = 0.0f;
+      scale[k] = 1.0f;
+      continue;
+    }
+    offset[k] = 0.5f * (bmin[k] + bmax[k]);
+    float extent = 0.5f * (bmax[k] - bmin[k]);
+    scale[k] = extent > 0.0f ? extent / kPositionRange : 1.0f;
+  }
+}
+
+void EncodeVertices(VertexFormat format, const std::vector<float>& vertices,
+                    const float offset[3], const float scale[3],
+                    std::vector<unsigned char>* out) {
+  if (format == kVertexFormatFloat) {
+    const unsigned char* p =
+        reinterpret_cast<const unsigned char*>(vertices.data());
+    out->assign(p, p + vertices.size() * sizeof(float));
+    return;
+  }
+
+  size_t numVertices = vertices.size() / kVertexStride;
+  out->resize(numVertices * sizeof(CompactVertex));
+  for (size_t i = 0; i < numVertices; i++) {
+    const float* v = &vertices[i * kVertexStride];
+    CompactVertex cv;
+    for (int k = 0; k < 3; k++) {
+      float q = (v[k] - offset[k]) / scale[k];
+      q = std::min(float(kPositionRange), std::max(-float(kPositionRange), q));
+      cv.position[k] = static_cast<int16_t>(lrintf(q));
+    }
+    cv.position[3] = 0;
+    cv.normal = packNormal(v + 3);
+    for (int k = 0; k < 3; k++) {
+      cv.color[k] = unorm8(v[6 + k]);
+    }
+    cv.color[3] = 255;
+    cv.texcoord[0] = floatToHalf(v[9]);
+    cv.texcoord[1] = floatToHalf(v[10]);
+    memcpy(&(*out)[i * sizeof(CompactVertex)], &cv, sizeof(CompactVertex));
+  }
+}
+
+void SetVertexPointers(VertexFormat format, bool colors, bool texcoords) {
+  const VertexLayout& l = GetVertexLayout(format);
+  GLsizei stride = static_cast<GLsizei>(l.stride);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glVertexPointer(l.position.size, l.position.type, stride,
+                  (const void*)l.position.offset);
+  glNormalPointer(l.normal.type, stride, (const void*)l.normal.offset);
+  if (colors) {
+    glEnableClientState(GL_COLOR_ARRAY);
+    glColorPointer(l.color.size, l.color.type, stride,
+                   (const void*)l.color.offset);
+  } else {
+    glDisableClientState(GL_COLOR_ARRAY);
+  }
+  if (texcoords) {
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(l.texcoord.size, l.texcoord.type, stride,
+                      (const void*)l.texcoord.offset);
+  } else {
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  }
+}
@@ -0,0 +1,68 @@
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+// # of floats per vertex the loader assembles before encoding.
+// 3:vtx, 3:normal, 3:col, 2:texcoord
+const size_t kVertexStride = 3 + 3 + 3 + 2;
+
+// Layout of the vertices stored in a DrawObject's vertex buffer.
+enum VertexFormat {
+  kVertexFormatFloat,   // the kVertexStride floats as assembled, 44 bytes
+  kVertexFormatCompact  // CompactVertex, 20 bytes
+};
+
+// Compact vertex. The position is quantized against the object's bounding
+// box and restored at draw time from DrawObject::position_offset and
+// position_scale. The normal is packed as GL_INT_2_10_10_10_REV, the color
+// as RGBA8 and the texcoord as half floats.
+typedef struct {
+  int16_t position[4];  // [3] is padding
+  uint32_t normal;
+  uint8_t color[4];
+  uint16_t texcoord[2];
+} CompactVertex;
+
+// One interleaved attribute, in the terms of gl*Pointer.
+typedef struct {
+  GLint size;
+  GLenum type;
+  GLboolean normalized;
+  size_t offset;
+} VertexAttrib;
+
+typedef struct {
+  size_t stride;  // bytes per vertex
+  VertexAttrib position;
+  VertexAttrib normal;
+  VertexAttrib color;
+  VertexAttrib texcoord;
+} VertexLayout;
+
+// The single description of each format, shared by loader and renderer.
+const VertexLayout& GetVertexLayout(VertexFormat format);
+
+// Offset and scale that map the positions of `vertices` (kVertexStride
+// floats each) onto the compact position range. A position is restored as
+// offset + scale * stored value.
+void ComputePositionQuantization(const std::vector<float>& vertices,
+                                 float offset[3], float scale[3]);
+
+// Same, for positions within the box [bmin, bmax].
+void QuantizationFromBounds(const float bmin[3], const float bmax[3],
+                            float offset[3], float scale[3]);
+
+// Convert `vertices` (kVertexStride floats each) to `format`.
+void EncodeVertices(VertexFormat format, const std::vector<float>& vertices,
+                    const float offset[3], const float scale[3],
+                    std::vector<unsigned char>* out);
+
+// Point the fixed-function vertex arrays at the bound vertex buffer.
+void SetVertexPointers(VertexFormat format, bool colors, bool texcoords);
+
+#endif
@@ -3,7 +3,13 @@
 //
 #include <GL/glew.h>
 
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <iostream>
+#include <string>
 
 #ifdef __APPLE__
 #include <OpenGL/glu.h>
@@ -30,10 +36,29 @@
 // #endif
 
 #include "callbacks.h"
+#include "camera.h"
+#include "corerenderer.h"
+#include "drawbatch.h"
 #include "drawobject.h"
+#include "framestats.h"
+#include "gldebug.h"
 #include "global.h"
+#include "hud.h"
+#include "mappedfile.h"
+#include "meshcache.h"
 #include "objutil.h"
-#include "timerutil.h"
+#include "occlusion.h"
+#include "pager.h"
+#include "passtimer.h"
+#include "profiler.h"
+#include "scene.h"
+
+// Frames --benchmark renders without a count.
+static const int kBenchmarkFrames = 600;
+
+// Seconds an idle viewer sleeps between title updates when no event
+// arrives.
+static const double kIdleTimeout = 0.5;
 
 static void Init() {
   trackball(curr_quat, 0, 0, 0, 0);
@@ -51,20 +76,232 @@ static void Init() {
   up[2] = 0.0f;
 }
 
+// Passes over the visible batches each frame.
+static int DrawPasses() {
+  int passes = 1;
+  if (g_show_wire && g_wire_mode == kWireLines) {
+    passes++;
+  }
+  if (g_cull_face && g_renderer == kRendererCore) {
+    passes++;
+  }
+  return passes;
+}
+
+// Lines of the statistics overlay.
+static std::string HudText(double frameMs, int totalTriangles,
+                           const DrawStats& draw, size_t bufferBytes,
+                           const double cpuMs[kNumFramePasses],
+                           const double gpuMs[kNumFramePasses]) {
+  char line[128];
+  snprintf(line, sizeof(line), "frame %.2f ms (%.0f fps)\n", frameMs,
+           frameMs > 0.0 ? 1000.0 / frameMs : 0.0);
+  std::string text = line;
+  snprintf(line, sizeof(line), "triangles %d / %d\n",
+           g_cull_stats.visibleTriangles, totalTriangles);
+  text += line;
+  snprintf(line, sizeof(line), "draw calls %d, texture binds %d\n",
+           draw.drawCalls * DrawPasses(), draw.textureBinds);
+  text += line;
+  snprintf(line, sizeof(line), "buffers %.1f MB\n", bufferBytes / 1048576.0);
+  text += line;
+  text += "pass        cpu ms  gpu ms\n";
+  for (int p = 0; p < kNumFramePasses; p++) {
+    if (p == kPassCull || p == kPassOcclusion || !g_pass_timers.gpuTimed()) {
+      snprintf(line, sizeof(line), "%-10s %7.2f       -\n",
+               FramePassName(FramePass(p)), cpuMs[p]);
+    } else {
+      snprintf(line, sizeof(line), "%-10s %7.2f %7.2f\n",
+               FramePassName(FramePass(p)), cpuMs[p], gpuMs[p]);
+    }
+    text += line;
+  }
+  return text;
+}
+
+static void Usage() {
+  std::cout << "Usage: viewer [options] input.obj|input.scene\n";
+  std::cout << "  --no-cache : Ignore and do not write mesh/texture caches\n";
+  std::cout << "  --compress-textures : Store textures as BC1/BC3 (S3TC)\n";
+  std::cout << "  --parser=tinyobj|parallel : OBJ parser (default: tinyobj)\n";
+  std::cout << "  --verify-parser : Check that both parsers agree\n";
+  std::cout << "  --threads=N : # of loader threads (default: all cores)\n";
+  std::cout << "  --angle-weighted-normals : Weight smoothed normals by "
+               "corner angle\n";
+  std::cout << "  --vertex-format=float|compact : Vertex layout "
+               "(default: float)\n";
+  std::cout << "  --no-merge : Keep one vertex buffer per shape\n";
+  std::cout << "  --no-instancing : Keep a vertex buffer per copy of shapes "
+               "repeated at other positions\n";
+  std::cout << "  --no-frustum-cull : Draw clusters outside the view too\n";
+  std::cout << "  --no-lod : Always draw the full detail (key L)\n";
+  std::cout << "  --lod-error=PIXELS : Screen space error allowed by the "
+               "level of detail (default: 1)\n";
+  std::cout << "  --occlusion-cull : Skip clusters hidden behind large "
+               "triangles (key O)\n";
+  std::cout << "  --paged : Stream the model from a page file, for models "
+               "larger than memory\n";
+  std::cout << "  --memory-budget=MB : Geometry kept resident by --paged "
+               "(default: 512)\n";
+  std::cout << "  --renderer=legacy|core : Fixed-function or OpenGL 3.3 core "
+               "(default: legacy)\n";
+  std::cout << "  --wire=overlay|lines : One-pass (core renderer only) or "
+               "line wireframe (default: overlay with the core renderer, "
+               "lines with the legacy one)\n";
+  std::cout << "  --wire-width=PIXELS : Wireframe line width (default: 1)\n";
+  std::cout << "  --wire-color=R,G,B : Wireframe color (default: 0,0,0.4)\n";
+  std::cout << "  --benchmark[=FRAMES] : Render an orbit around the model "
+               "offscreen without vsync and print JSON statistics "
+               "(default: 600 frames)\n";
+  std::cout << "  --benchmark-out=FILE : Write the statistics to FILE\n";
+  std::cout << "  --continuous : Redraw every frame, also when nothing "
+               "changed\n";
+  std::cout << "  --idle-report=SECONDS : Quit after SECONDS and print the "
+               "frames drawn and the CPU use of the main loop\n";
+  std::cout << "  --profile=FILE : Write a Chrome trace of the loading and "
+               "frame zones to FILE, for Perfetto\n";
+  std::cout << "  --gl-debug : Debug context, log KHR_debug messages\n";
+  std::cout << "  --gl-validate : --gl-debug, and check every draw for "
+               "errors\n";
+}
+
 int main(int argc, char** argv) {
-  if (argc < 2) {
+  const char* obj_filename = NULL;
+  int benchmarkFrames = 0;
+  const char* benchmarkOut = NULL;
+  const char* profileOut = NULL;
+  bool continuous = false;
+  double idleReportSeconds = 0.0;
+  bool wireOverlay = false;  // asked for with --wire=overlay
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--no-cache") {
+      g_use_mesh_cache = false;
+    } else if (arg == "--compress-textures") {
+      g_compress_textures = true;
+    } else if (arg == "--parser=tinyobj") {
+      g_obj_parser = kParserTinyObj;
+    } else if (arg == "--parser=parallel") {
+      g_obj_parser = kParserParallel;
+    } else if (arg == "--verify-parser") {
+      // The check needs a real parse.
+      g_verify_parser = true;
+      g_use_mesh_cache = false;
+    } else if (arg == "--angle-weighted-normals") {
+      g_angle_weighted_normals = true;
+    } else if (arg == "--vertex-format=float") {
+      g_vertex_format = kVertexFormatFloat;
+    } else if (arg == "--vertex-format=compact") {
+      g_vertex_format = kVertexFormatCompact;
+    } else if (arg == "--renderer=legacy") {
+      g_renderer = kRendererLegacy;
+    } else if (arg == "--renderer=core") {
+      g_renderer = kRendererCore;
+    } else if (arg == "--wire=overlay") {
+      g_wire_mode = kWireOverlay;
+      wireOverlay = true;
+    } else if (arg == "--wire=lines") {
+      g_wire_mode = kWireLines;
+      wireOverlay = false;
+    } else if (arg.compare(0, 13, "--wire-width=") == 0) {
+      g_wire_width = atof(arg.c_str() + 13);
+    } else if (arg.compare(0, 13, "--wire-color=") == 0) {
+      if (sscanf(arg.c_str() + 13, "%f,%f,%f", &g_wire_color[0],
+                 &g_wire_color[1], &g_wire_color[2]) != 3) {
+        std::cerr << "Bad wire color: " << arg << std::endl;
+        Usage();
+        return -1;
+      }
+    } else if (arg == "--benchmark") {
+      benchmarkFrames = kBenchmarkFrames;
+    } else if (arg.compare(0, 12, "--benchmark=") == 0) {
+      benchmarkFrames = atoi(arg.c_str() + 12);
+    } else if (arg.compare(0, 16, "--benchmark-out=") == 0) {
+      benchmarkOut = argv[i] + 16;
+    } else if (arg == "--continuous") {
+      continuous = true;
+    } else if (arg.compare(0, 14, "--idle-report=") == 0) {
+      idleReportSeconds = atof(arg.c_str() + 14);
+    } else if (arg.compare(0, 10, "--profile=") == 0) {
+      profileOut = argv[i] + 10;
+      g_profile = true;
+    } else if (arg == "--gl-debug") {
+      g_gl_debug = true;
+    } else if (arg == "--gl-validate") {
+      g_gl_debug = true;
+      g_gl_validate = true;
+    } else if (arg == "--no-frustum-cull") {
+      g_frustum_cull = false;
+    } else if (arg == "--no-lod") {
+      g_lod = false;
+    } else if (arg.compare(0, 12, "--lod-error=") == 0) {
+      g_lod_pixel_error = atof(arg.c_str() + 12);
+    } else if (arg == "--occlusion-cull") {
+      g_occlusion_cull = true;
+    } else if (arg == "--no-merge") {
+      g_merge_draws = false;
+    } else if (arg == "--no-instancing") {
+      g_instance_shapes = false;
+    } else if (arg == "--paged") {
+      g_paged = true;
+    } else if (arg.compare(0, 16, "--memory-budget=") == 0) {
+      g_memory_budget_mb = atoi(arg.c_str() + 16);
+    } else if (arg.compare(0, 10, "--threads=") == 0) {
+      g_num_threads = atoi(arg.c_str() + 10);
+    } else if (arg.compare(0, 2, "--") == 0) {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      Usage();
+      return -1;
+    } else {
+      obj_filename = argv[i];
+    }
+  }
+  if (obj_filename == NULL) {
     std::cout << "Needs input.obj\n" << std::endl;
+    Usage();
     return 0;
   }
+  bool scene = IsSceneFile(obj_filename);
+  if (scene && g_paged) {
+    std::cerr << "Scenes cannot be paged." << std::endl;
+    return -1;
+  }
 
   Init();
+  ProfileThreadName("main");
 
   if (!glfwInit()) {
     std::cerr << "Failed to initialize GLFW." << std::endl;
     return -1;
   }
 
+  if (g_renderer == kRendererCore) {
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  }
+  if (g_gl_debug) {
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+  }
+  // Benchmarks render into an invisible window.
+  if (benchmarkFrames > 0) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  }
   window = glfwCreateWindow(width, height, "Obj viewer", NULL, NULL);
+  if (window == NULL && g_renderer == kRendererCore) {
+    std::cerr << "No OpenGL 3.3 core context, using the legacy renderer."
+              << std::endl;
+    g_renderer = kRendererLegacy;
+    glfwDefaultWindowHints();
+    if (g_gl_debug) {
+      glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+    }
+    if (benchmarkFrames > 0) {
+      glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+    window = glfwCreateWindow(width, height, "Obj viewer", NULL, NULL);
+  }
   if (window == NULL) {
     std::cerr << "Failed to open GLFW window. " << std::endl;
     glfwTerminate();
@@ -73,14 +310,18 @@ int main(int argc, char** argv) {
 
   std::cout << "W : Toggle wireframe\n";
   std::cout << "C : Toggle face culling\n";
+  std::cout << "F : Toggle view frustum culling\n";
+  std::cout << "H : Toggle frame statistics\n";
   // std::cout << "K, J, H, L, P, N : Move camera\n";
   std::cout << "Q, Esc : quit\n";
 
   glfwMakeContextCurrent(window);
-  glfwSwapInterval(1);
+  // Benchmarks measure the renderer, not the display's refresh rate.
+  glfwSwapInterval(benchmarkFrames > 0 ? 0 : 1);
 
   // Callback
   glfwSetWindowSizeCallback(window, reshapeFunc);
+  glfwSetWindowRefreshCallback(window, refreshFunc);
   glfwSetKeyCallback(window, keyboardFunc);
   glfwSetMouseButtonCallback(window, clickFunc);
   glfwSetCursorPosCallback(window, motionFunc);
@@ -90,16 +331,89 @@ int main(int argc, char** argv) {
     std::cerr << "Failed to initialize GLEW." << std::endl;
     return -1;
   }
+  // glewInit may leave GL_INVALID_ENUM behind on core profiles.
+  glGetError();
+  if (g_gl_debug) {
+    InstallGLDebugOutput();
+  }
+  if (g_renderer == kRendererCore && !InitCoreRenderer()) {
+    return -1;
+  }
+  // The fixed-function path can only draw the wireframe as lines.
+  if (g_renderer == kRendererLegacy) {
+    if (wireOverlay) {
+      std::cerr << "The legacy renderer has no wire overlay, drawing lines."
+                << std::endl;
+    }
+    g_wire_mode = kWireLines;
+  }
+  // Packed 2_10_10_10 normals need OpenGL 3.3.
+  if (g_vertex_format == kVertexFormatCompact && !GLEW_VERSION_3_3) {
+    std::cerr << "Compact vertices need OpenGL 3.3, using floats."
+              << std::endl;
+    g_vertex_format = kVertexFormatFloat;
+  }
+  // Merged buffers are drawn with per-shape base vertices, and large shapes
+  // with per-cluster ones.
+  g_base_vertex = GLEW_ARB_draw_elements_base_vertex;
+  // Every page has buffers of its own, which come and go.
+  if (g_paged) {
+    g_merge_draws = false;
+  }
+  if (g_merge_draws && !g_base_vertex) {
+    std::cerr << "No glMultiDrawElementsBaseVertex, not merging shapes."
+              << std::endl;
+    g_merge_draws = false;
+  }
 
   reshapeFunc(window, width, height);
+  g_pass_timers.init();
+  Hud hud;
+  if (!hud.init()) {
+    std::cerr << "No framebuffer objects, frame statistics are unavailable."
+              << std::endl;
+  }
 
   float bmin[3], bmax[3];
   std::vector<tinyobj::material_t> materials;
   std::map<std::string, GLuint> textures;
-  if (false == LoadObjAndConvert(bmin, bmax, &gDrawObjects, materials, textures,
-                                 argv[1])) {
+  std::vector<float> occluders;
+  double loadStart = glfwGetTime();
+  uint64_t loadBegin = ProfileClock();
+  MappedFile pageFile;
+  std::vector<Page> pages;
+  PageStreamer streamer;
+  if (g_paged) {
+    if (!LoadObjPaged(bmin, bmax, &pageFile, &pages, &occluders, materials,
+                      textures, obj_filename)) {
+      return -1;
+    }
+    for (size_t i = 0; i < pages.size(); i++) {
+      gDrawObjects.push_back(pages[i].object);
+    }
+    streamer.start(&pages, &gDrawObjects, size_t(g_memory_budget_mb) << 20);
+  } else if (scene) {
+    if (!LoadScene(bmin, bmax, &gDrawObjects, materials, textures,
+                   obj_filename)) {
+      return -1;
+    }
+  } else if (false == LoadObjAndConvert(bmin, bmax, &gDrawObjects,
+                                        &occluders, materials, textures,
+                                        obj_filename)) {
     return -1;
   }
+  BuildDrawBatches(gDrawObjects, materials, textures, &gDrawBatches);
+  if (g_renderer == kRendererCore) {
+    CreateVertexArrays(&gDrawObjects);
+  }
+  if (g_gl_debug) {
+    LabelDrawObjects(gDrawObjects);
+  }
+  g_load_times.total_ms = 1000.0 * (glfwGetTime() - loadStart);
+  g_redraw = true;
+  if (g_profile) {
+    RecordZone("load", loadBegin, ProfileClock());
+  }
 
   float maxExtent = 0.5f * (bmax[0] - bmin[0]);
   if (maxExtent < 0.5f * (bmax[1] - bmin[1])) {
@@ -109,34 +423,225 @@ int main(int argc, char** argv) {
     maxExtent = 0.5f * (bmax[2] - bmin[2]);
   }
 
+  const char* rendererName = g_renderer == kRendererCore ? "core" : "legacy";
+  std::vector<DrawBatch> visibleBatches;
+  const std::vector<DrawBatch>* batches = &gDrawBatches;
+  OcclusionBuffer occlusion;
+  int totalTriangles = 0;
+  for (size_t i = 0; i < gDrawObjects.size(); i++) {
+    totalTriangles +=
+        gDrawObjects[i].numTriangles * InstanceCount(gDrawObjects[i]);
+  }
+  FrameStats frameStats;
+  double passCpuMs[kNumFramePasses] = {0.0};
+  double passGpuMs[kNumFramePasses] = {0.0};
+
+  // Show the average frame time and the CPU use of the process, which
+  // includes idle time, in the title twice a second.
+  double titleTime = glfwGetTime();
+  std::clock_t titleClock = std::clock();
+  int titleFrames = 0;
+  double titleFrameSeconds = 0.0;
+  auto updateTitle = [&]() {
+    double now = glfwGetTime();
+    if (now - titleTime < 0.5) {
+      return;
+    }
+    std::clock_t clock = std::clock();
+    double cpu = 100.0 * (clock - titleClock) / CLOCKS_PER_SEC /
+                 (now - titleTime);
+    double frameMs =
+        titleFrames > 0 ? 1000.0 * titleFrameSeconds / titleFrames : 0.0;
+    const char* wireName = !g_show_wire                   ? ""
+                           : g_wire_mode == kWireOverlay ? ", wire overlay"
+                                                         : ", wire lines";
+    char resident[48] = "";
+    if (g_paged) {
+      snprintf(resident, sizeof(resident), ", %d/%d MB resident",
+               (int)(streamer.residentBytes() >> 20),
+               (int)(streamer.budgetBytes() >> 20));
+    }
+    char frameTime[32] = "idle";
+    if (titleFrames > 0) {
+      snprintf(frameTime, sizeof(frameTime), "%.2f ms/frame", frameMs);
+    }
+    char title[200];
+    snprintf(title, sizeof(title),
+             "Obj viewer (%s%s) %s, %.0f%% cpu, %d/%d triangles visible, "
+             "%d occluded%s",
+             rendererName, wireName, frameTime, cpu,
+             g_cull_stats.visibleTriangles, totalTriangles,
+             g_cull_stats.occludedTriangles, resident);
+    glfwSetWindowTitle(window, title);
+    if (g_show_hud) {
+      g_pass_timers.report(passCpuMs, passGpuMs);
+      hud.setText(HudText(frameMs, totalTriangles, CountDrawStats(*batches),
+                          BufferBytes(gDrawObjects), passCpuMs, passGpuMs));
+    }
+    titleTime = now;
+    titleClock = clock;
+    titleFrames = 0;
+    titleFrameSeconds = 0.0;
+  };
+
+  // --idle-report measures the loop as it runs without input, so the CPU
+  // use of the event wait can be compared with --continuous.
+  double loopTime = glfwGetTime();
+  std::clock_t loopClock = std::clock();
+  int framesDrawn = 0;
+
+  int frame = 0;
   while (glfwWindowShouldClose(window) == GL_FALSE) {
-    glfwPollEvents();
+    if (idleReportSeconds > 0.0 &&
+        glfwGetTime() - loopTime >= idleReportSeconds) {
+      break;
+    }
+    // Draw only when the view changed, and otherwise sleep until an event
+    // arrives. Benchmarks, the statistics overlay and pages still streaming
+    // in keep drawing.
+    bool animate = continuous || benchmarkFrames > 0 || g_show_hud ||
+                   (g_paged && streamer.busy());
+    if (animate || g_redraw) {
+      glfwPollEvents();
+    } else {
+      glfwWaitEventsTimeout(kIdleTimeout);
+      if (!g_redraw) {
+        updateTitle();
+        continue;
+      }
+    }
+    g_redraw = false;
+
+    PROFILE_ZONE("frame");
+    double frameStart = glfwGetTime();
+    g_pass_timers.setEnabled(g_show_hud);
+    if (benchmarkFrames > 0) {
+      OrbitCamera(frame, benchmarkFrames, curr_quat, eye);
+    }
     glClearColor(0.1f, 0.2f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     glEnable(GL_DEPTH_TEST);
-    glEnable(GL_TEXTURE_2D);
 
-    // camera & rotate
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    GLfloat mat[4][4];
-    gluLookAt(eye[0], eye[1], eye[2], lookat[0], lookat[1], lookat[2], up[0],
-              up[1], up[2]);
-    build_rotmatrix(mat, curr_quat);
-    glMultMatrixf(&mat[0][0]);
+    // The same camera the legacy path sets up on the matrix stack.
+    float projection[16], modelview[16];
+    PerspectiveMatrix(45.0f, (float)width / (float)height, 0.01f, 100.0f,
+                      projection);
+    ModelViewMatrix(eye, lookat, up, curr_quat, bmin, bmax, modelview);
+
+    Frustum frustum;
+    ExtractFrustum(projection, modelview, &frustum);
+    // Pick levels by the projected error of each range.
+    LodParams lod;
+    memcpy(lod.modelview, modelview, sizeof(modelview));
+    lod.scale = 1.0f / maxExtent;
+    lod.pixelsPerUnit =
+        0.5f * height / tanf(0.5f * 45.0f * float(M_PI) / 180.0f);
+    lod.maxPixelError = g_lod_pixel_error;
+    if (g_paged) {
+      streamer.update(frustum, lod);
+    }
+
+    batches = &gDrawBatches;
+    // Pages that are not resident have to be culled.
+    if (g_frustum_cull || g_occlusion_cull || g_lod || g_paged) {
+      if (g_occlusion_cull) {
+        float mvp[16];
+        MultiplyMatrix(projection, modelview, mvp);
+        g_pass_timers.begin(kPassOcclusion);
+        occlusion.render(occluders, mvp, (float)width / (float)height);
+        g_pass_timers.end(kPassOcclusion);
+      }
+      g_pass_timers.begin(kPassCull);
+      CullBatches(gDrawObjects, gDrawBatches,
+                  g_frustum_cull ? &frustum : NULL,
+                  g_occlusion_cull ? &occlusion : NULL, g_lod ? &lod : NULL,
+                  &visibleBatches, &g_cull_stats);
+      g_pass_timers.end(kPassCull);
+      batches = &visibleBatches;
+    } else {
+      g_cull_stats.visibleTriangles = totalTriangles;
+      g_cull_stats.culledTriangles = 0;
+      g_cull_stats.occludedTriangles = 0;
+    }
+
+    if (g_renderer == kRendererCore) {
+      DrawCore(gDrawObjects, *batches, projection, modelview);
+    } else {
+      glEnable(GL_TEXTURE_2D);
+
+      // camera & rotate
+      glMatrixMode(GL_MODELVIEW);
+      glLoadIdentity();
+      GLfloat mat[4][4];
+      gluLookAt(eye[0], eye[1], eye[2], lookat[0], lookat[1], lookat[2],
+                up[0], up[1], up[2]);
+      build_rotmatrix(mat, curr_quat);
+      glMultMatrixf(&mat[0][0]);
+
+      // Fit to -1, 1
+      glScalef(1.0f / maxExtent, 1.0f / maxExtent, 1.0f / maxExtent);
 
-    // Fit to -1, 1
-    glScalef(1.0f / maxExtent, 1.0f / maxExtent, 1.0f / maxExtent);
+      // Centerize object.
+      glTranslatef(-0.5 * (bmax[0] + bmin[0]), -0.5 * (bmax[1] + bmin[1]),
+                   -0.5 * (bmax[2] + bmin[2]));
 
-    // Centerize object.
-    glTranslatef(-0.5 * (bmax[0] + bmin[0]), -0.5 * (bmax[1] + bmin[1]),
-                 -0.5 * (bmax[2] + bmin[2]));
+      Draw(gDrawObjects, *batches);
+    }
+    g_pass_timers.endFrame();
+    if (g_show_hud) {
+      hud.draw(height);
+    }
 
-    Draw(gDrawObjects, materials, textures);
+    {
+      PROFILE_ZONE("swap");
+      glfwSwapBuffers(window);
+    }
+    titleFrames++;
+    titleFrameSeconds += glfwGetTime() - frameStart;
+    framesDrawn++;
 
-    glfwSwapBuffers(window);
+    if (benchmarkFrames > 0) {
+      // Without vsync the swap does not wait for the GPU, so the frame
+      // time would leave out most of the drawing.
+      PROFILE_ZONE("finish");
+      glFinish();
+      int drawCalls = CountDrawStats(*batches).drawCalls * DrawPasses();
+      frameStats.addFrame(glfwGetTime() - frameStart,
+                          g_cull_stats.visibleTriangles, drawCalls);
+      if (++frame == benchmarkFrames) {
+        break;
+      }
+    }
+
+    updateTitle();
+  }
+
+  if (idleReportSeconds > 0.0) {
+    double seconds = glfwGetTime() - loopTime;
+    printf("Main loop: %d frames drawn in %.1f [s], %.1f%% cpu\n",
+           framesDrawn, seconds,
+           100.0 * (std::clock() - loopClock) / CLOCKS_PER_SEC / seconds);
+  }
+  if (profileOut && !WriteChromeTrace(profileOut)) {
+    std::cerr << "Unable to write " << profileOut << std::endl;
+  }
+  if (benchmarkFrames > 0) {
+    FILE* fp = benchmarkOut ? fopen(benchmarkOut, "w") : stdout;
+    if (!fp) {
+      std::cerr << "Unable to write " << benchmarkOut << std::endl;
+      glfwTerminate();
+      return 1;
+    }
+    frameStats.writeJson(fp, obj_filename, rendererName,
+                         (const char*)glGetString(GL_RENDERER),
+                         g_load_times);
+    if (fp != stdout) {
+      fclose(fp);
+    }
   }
 
+  hud.release();
+  g_pass_timers.release();
   glfwTerminate();
 }
@@ -0,0 +1,428 @@
+//
+// Microbenchmarks for the loader stages. Build and run with `make bench`;
+// pass Google Benchmark flags in BENCHFLAGS, for example
+// BENCHFLAGS=--benchmark_filter=BM_ParseObj to time the parsers only.
+//
+#include <benchmark/benchmark.h>
+#include <tiny_obj_loader.h>
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "normals.h"
+#include "objconvert.h"
+#include "objparser.h"
+#include "parallel.h"
+
+namespace {
+// A w x h grid of quads split into triangles, gently curved so the face
+// normals differ.
+void MakeGrid(int w, int h, tinyobj::attrib_t* attrib,
+              tinyobj::shape_t* shape) {
+  attrib->vertices.clear();
+  shape->mesh.indices.clear();
+  for (int y = 0; y <= h; y++) {
+    for (int x = 0; x <= w; x++) {
+      attrib->vertices.push_back(float(x) / w);
+      attrib->vertices.push_back(float(y) / h);
+      attrib->vertices.push_back(0.1f * sinf(0.37f * x) * cosf(0.23f * y));
+    }
+  }
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      int v00 = y * (w + 1) + x, v10 = v00 + 1;
+      int v01 = v00 + w + 1, v11 = v01 + 1;
+      int tri[6] = {v00, v10, v11, v00, v11, v01};
+      for (int k = 0; k < 6; k++) {
+        tinyobj::index_t idx;
+        idx.vertex_index = idx.normal_index = tri[k];
+        idx.texcoord_index = -1;
+        shape->mesh.indices.push_back(idx);
+      }
+    }
+  }
+}
+
+// Grid with about `faces` triangles.
+void MakeGridWithFaces(int64_t faces, tinyobj::attrib_t* attrib,
+                       tinyobj::shape_t* shape) {
+  int side = std::max(1, int(sqrt(double(faces) / 2.0)));
+  MakeGrid(side, side, attrib, shape);
+}
+
+// The std::map based smoothing normals the loader used before, kept as the
+// baseline.
+struct vec3 {
+  float v[3];
+  vec3() { v[0] = v[1] = v[2] = 0.0f; }
+};
+
+void SmoothingNormalsMap(const tinyobj::attrib_t& attrib,
+                         const tinyobj::shape_t& shape,
+                         std::map<int, vec3>& smoothVertexNormals) {
+  smoothVertexNormals.clear();
+  for (size_t f = 0; f < shape.mesh.indices.size() / 3; f++) {
+    int vi[3];
+    float v[3][3];
+    for (int k = 0; k < 3; k++) {
+      vi[k] = shape.mesh.indices[3 * f + k].vertex_index;
+    }
+    for (int k = 0; k < 3; k++) {
+      for (int c = 0; c < 3; c++) {
+        v[k][c] = attrib.vertices[3 * vi[k] + c];
+      }
+    }
+    float e1[3], e2[3], n[3];
+    for (int c = 0; c < 3; c++) {
+      e1[c] = v[1][c] - v[0][c];
+      e2[c] = v[2][c] - v[0][c];
+    }
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len > 0.0f) {
+      n[0] /= len;
+      n[1] /= len;
+      n[2] /= len;
+    }
+    for (int k = 0; k < 3; k++) {
+      std::map<int, vec3>::iterator iter = smoothVertexNormals.find(vi[k]);
+      if (iter != smoothVertexNormals.end()) {
+        for (int c = 0; c < 3; c++) {
+          iter->second.v[c] += n[c];
+        }
+      } else {
+        for (int c = 0; c < 3; c++) {
+          smoothVertexNormals[vi[k]].v[c] = n[c];
+        }
+      }
+    }
+  }
+  for (std::map<int, vec3>::iterator iter = smoothVertexNormals.begin();
+       iter != smoothVertexNormals.end(); iter++) {
+    float* v = iter->second.v;
+    float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (len > 0.0f) {
+      v[0] /= len;
+      v[1] /= len;
+      v[2] /= len;
+    }
+  }
+}
+
+void BM_SmoothingNormalsMap(benchmark::State& state) {
+  tinyobj::attrib_t attrib;
+  tinyobj::shape_t shape;
+  MakeGridWithFaces(state.range(0), &attrib, &shape);
+  std::map<int, vec3> normals;
+  for (auto _ : state) {
+    SmoothingNormalsMap(attrib, shape, normals);
+    benchmark::DoNotOptimize(normals);
+  }
+  state.SetItemsProcessed(state.iterations() * shape.mesh.indices.size() / 3);
+}
+
+void BM_SmoothingNormalsFlat(benchmark::State& state) {
+  tinyobj::attrib_t attrib;
+  tinyobj::shape_t shape;
+  MakeGridWithFaces(state.range(0), &attrib, &shape);
+  VertexNormals normals;
+  NormalWeighting weighting = NormalWeighting(state.range(1));
+  for (auto _ : state) {
+    ComputeVertexNormals(attrib.vertices, shape.mesh.indices, false,
+                         weighting, &normals);
+    benchmark::DoNotOptimize(normals.x.data());
+  }
+  state.SetItemsProcessed(state.iterations() * shape.mesh.indices.size() / 3);
+}
+
+// Procedural meshes for the loader stages. Every face has a smoothing
+// group, as OBJ files without normals usually do.
+enum MeshKind {
+  kMeshGrid,    // one smoothing group
+  kMeshSphere,  // one smoothing group, with poles and a seam
+  kMeshSoup     // faces in random groups, 0 (flat) included
+};
+
+struct Mesh {
+  tinyobj::attrib_t attrib;
+  tinyobj::shape_t shape;
+};
+
+// A UV sphere with about `faces` triangles.
+void MakeSphere(int64_t faces, tinyobj::attrib_t* attrib,
+                tinyobj::shape_t* shape) {
+  int rings = std::max(2, int(sqrt(double(faces) / 4.0)));
+  int segments = std::max(3, int(faces / (2 * rings)));
+  attrib->vertices.clear();
+  shape->mesh.indices.clear();
+  for (int r = 0; r <= rings; r++) {
+    float theta = float(M_PI) * r / rings;
+    for (int s = 0; s <= segments; s++) {
+      float phi = 2.0f * float(M_PI) * s / segments;
+      attrib->vertices.push_back(sinf(theta) * cosf(phi));
+      attrib->vertices.push_back(cosf(theta));
+      attrib->vertices.push_back(sinf(theta) * sinf(phi));
+    }
+  }
+  for (int r = 0; r < rings; r++) {
+    for (int s = 0; s < segments; s++) {
+      int v00 = r * (segments + 1) + s, v10 = v00 + 1;
+      int v01 = v00 + segments + 1, v11 = v01 + 1;
+      int tri[6] = {v00, v11, v10, v00, v01, v11};
+      for (int k = 0; k < 6; k++) {
+        tinyobj::index_t idx;
+        idx.vertex_index = idx.normal_index = tri[k];
+        idx.texcoord_index = -1;
+        shape->mesh.indices.push_back(idx);
+      }
+    }
+  }
+}
+
+// The mesh of `kind` with about `faces` triangles. Large meshes take long to
+// build, so the last one is kept for the next benchmark.
+const Mesh& GetMesh(int kind, int64_t faces) {
+  static Mesh mesh;
+  static int meshKind = -1;
+  static int64_t meshFaces = 0;
+  if (kind == meshKind && faces == meshFaces) {
+    return mesh;
+  }
+  mesh = Mesh();
+  if (kind == kMeshSphere) {
+    MakeSphere(faces, &mesh.attrib, &mesh.shape);
+  } else {
+    MakeGridWithFaces(faces, &mesh.attrib, &mesh.shape);
+  }
+  size_t numFaces = mesh.shape.mesh.indices.size() / 3;
+  mesh.shape.mesh.num_face_vertices.assign(numFaces, 3);
+  mesh.shape.mesh.smoothing_group_ids.assign(numFaces, 1);
+  if (kind == kMeshSoup) {
+    unsigned int seed = 12345;
+    for (size_t f = 0; f < numFaces; f++) {
+      seed = seed * 1103515245u + 12345u;
+      mesh.shape.mesh.smoothing_group_ids[f] = (seed >> 16) % 9;
+    }
+  }
+  meshKind = kind;
+  meshFaces = faces;
+  return mesh;
+}
+
+// Write `mesh` as an OBJ file with positions, smoothing groups and faces.
+bool WriteObj(const Mesh& mesh, const std::string& filename) {
+  FILE* fp = fopen(filename.c_str(), "w");
+  if (!fp) {
+    return false;
+  }
+  const std::vector<tinyobj::real_t>& v = mesh.attrib.vertices;
+  for (size_t i = 0; i + 2 < v.size(); i += 3) {
+    fprintf(fp, "v %f %f %f\n", v[i], v[i + 1], v[i + 2]);
+  }
+  const tinyobj::mesh_t& m = mesh.shape.mesh;
+  unsigned int group = ~0u;
+  for (size_t f = 0; f < m.indices.size() / 3; f++) {
+    if (m.smoothing_group_ids[f] != group) {
+      group = m.smoothing_group_ids[f];
+      fprintf(fp, group ? "s %u\n" : "s off\n", group);
+    }
+    fprintf(fp, "f %d %d %d\n", m.indices[3 * f].vertex_index + 1,
+            m.indices[3 * f + 1].vertex_index + 1,
+            m.indices[3 * f + 2].vertex_index + 1);
+  }
+  return fclose(fp) == 0;
+}
+
+// Triangle counts the stages are run at, from 1K to 50M. The largest need
+// several GB of memory; pick sizes with --benchmark_filter.
+void FaceCounts(benchmark::internal::Benchmark* b, bool parsers) {
+  const int64_t faces[] = {1000, 10000, 100000, 1000000, 10000000, 50000000};
+  for (int kind = kMeshGrid; kind <= kMeshSoup; kind++) {
+    for (size_t i = 0; i < sizeof(faces) / sizeof(faces[0]); i++) {
+      if (parsers) {
+        b->Args({0, kind, faces[i]});
+        b->Args({1, kind, faces[i]});
+      } else {
+        b->Args({kind, faces[i]});
+      }
+    }
+  }
+  b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+void StageArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"mesh", "faces"});
+  FaceCounts(b, false);
+}
+
+void ParserArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"parallel", "mesh", "faces"});
+  FaceCounts(b, true);
+}
+
+// tinyobj::LoadObj (parallel=0) and LoadObjParallel (parallel=1) on the
+// mesh written to a temporary file.
+void BM_ParseObj(benchmark::State& state) {
+  bool parallel = state.range(0);
+  const Mesh& mesh = GetMesh(state.range(1), state.range(2));
+  std::string filename = "viewer_bench.obj";
+  if (!WriteObj(mesh, filename)) {
+    state.SkipWithError("Unable to write the OBJ file");
+    return;
+  }
+  for (auto _ : state) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+    bool ok = parallel ? LoadObjParallel(&attrib, &shapes, &materials, &warn,
+                                         &err, filename.c_str(), "./")
+                       : tinyobj::LoadObj(&attrib, &shapes, &materials,
+                                          &warn, &err, filename.c_str(), "./");
+    if (!ok) {
+      state.SkipWithError(err.c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(shapes.data());
+  }
+  remove(filename.c_str());
+  state.SetItemsProcessed(state.iterations() *
+                          mesh.shape.mesh.indices.size() / 3);
+}
+
+void BM_ComputeSmoothingShapes(benchmark::State& state) {
+  const Mesh& mesh = GetMesh(state.range(0), state.range(1));
+  tinyobj::attrib_t inattrib = mesh.attrib;
+  std::vector<tinyobj::shape_t> inshapes(1, mesh.shape);
+  for (auto _ : state) {
+    tinyobj::attrib_t outattrib;
+    std::vector<tinyobj::shape_t> outshapes;
+    ComputeSmoothingShapes(inattrib, inshapes, outshapes, outattrib);
+    benchmark::DoNotOptimize(outshapes.data());
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          mesh.shape.mesh.indices.size() / 3);
+}
+
+void BM_ComputeAllSmoothingNormals(benchmark::State& state) {
+  const Mesh& mesh = GetMesh(state.range(0), state.range(1));
+  tinyobj::attrib_t inattrib = mesh.attrib;
+  std::vector<tinyobj::shape_t> inshapes(1, mesh.shape);
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  ComputeSmoothingShapes(inattrib, inshapes, shapes, attrib);
+  for (auto _ : state) {
+    ComputeAllSmoothingNormals(attrib, shapes);
+    benchmark::DoNotOptimize(attrib.normals.data());
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          mesh.shape.mesh.indices.size() / 3);
+}
+
+void BM_ComputeSmoothingNormals(benchmark::State& state) {
+  const Mesh& mesh = GetMesh(state.range(0), state.range(1));
+  VertexNormals normals;
+  for (auto _ : state) {
+    ComputeSmoothingNormals(mesh.attrib, mesh.shape, normals);
+    benchmark::DoNotOptimize(normals.x.data());
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          mesh.shape.mesh.indices.size() / 3);
+}
+
+// Interleaved, unindexed vertices of a whole shape, split into tasks the
+// way the loader does.
+void AssembleBuffer(const Mesh& mesh,
+                    const std::vector<tinyobj::material_t>& materials,
+                    const VertexNormals& normals,
+                    const std::vector<unsigned int>& faceOrder,
+                    std::vector<float>* buffer, Bounds* bounds) {
+  size_t numFaces = faceOrder.size();
+  size_t numTasks = (numFaces + kFacesPerTask - 1) / kFacesPerTask;
+  std::vector<Bounds> taskBounds(numTasks);
+  buffer->resize(numFaces * 3 * kVertexStride);
+  ParallelFor(0, numTasks, 1, [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) {
+      ConvertFaces(mesh.attrib, mesh.shape, materials, normals, faceOrder,
+                   t * kFacesPerTask,
+                   std::min(numFaces, (t + 1) * kFacesPerTask),
+                   buffer->data(), &taskBounds[t]);
+    }
+  });
+  for (size_t t = 0; t < numTasks; t++) {
+    bounds->merge(taskBounds[t]);
+  }
+}
+
+void BM_AssembleBuffer(benchmark::State& state) {
+  const Mesh& mesh = GetMesh(state.range(0), state.range(1));
+  std::vector<tinyobj::material_t> materials(1);
+  VertexNormals normals;
+  ComputeSmoothingNormals(mesh.attrib, mesh.shape, normals);
+  std::vector<unsigned int> faceOrder;
+  std::vector<DrawRange> ranges;
+  SortFacesByMaterial(mesh.shape, materials.size(), &faceOrder, &ranges);
+  std::vector<float> buffer;
+  for (auto _ : state) {
+    Bounds bounds;
+    AssembleBuffer(mesh, materials, normals, faceOrder, &buffer, &bounds);
+    benchmark::DoNotOptimize(buffer.data());
+  }
+  state.SetItemsProcessed(state.iterations() * faceOrder.size());
+}
+
+// Bounding boxes and spheres of 2048 face clusters of the assembled buffer.
+void BM_RangeBounds(benchmark::State& state) {
+  const Mesh& mesh = GetMesh(state.range(0), state.range(1));
+  std::vector<tinyobj::material_t> materials(1);
+  VertexNormals normals;
+  std::vector<unsigned int> faceOrder;
+  std::vector<DrawRange> ranges;
+  SortFacesByMaterial(mesh.shape, materials.size(), &faceOrder, &ranges);
+  std::vector<float> buffer;
+  Bounds bounds;
+  AssembleBuffer(mesh, materials, normals, faceOrder, &buffer, &bounds);
+  const int kRangeFaces = 2048;
+  ranges.clear();
+  for (size_t f = 0; f < faceOrder.size(); f += kRangeFaces) {
+    DrawRange r = DrawRange();
+    r.first = 3 * f;
+    r.count = 3 * std::min<size_t>(kRangeFaces, faceOrder.size() - f);
+    ranges.push_back(r);
+  }
+  for (auto _ : state) {
+    ParallelFor(0, ranges.size(), 16, [&](size_t begin, size_t end) {
+      for (size_t r = begin; r < end; r++) {
+        RangeBounds(buffer, &ranges[r]);
+      }
+    });
+    benchmark::DoNotOptimize(ranges.data());
+  }
+  state.SetItemsProcessed(state.iterations() * faceOrder.size());
+}
+
+}  // namespace
+
+BENCHMARK(BM_SmoothingNormalsMap)
+    ->RangeMultiplier(10)
+    ->Range(1000, 1000000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SmoothingNormalsFlat)
+    ->ArgsProduct({benchmark::CreateRange(1000, 1000000, 10),
+                   {kWeightUniform, kWeightArea, kWeightAngle}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_ParseObj)->Apply(ParserArgs);
+BENCHMARK(BM_ComputeSmoothingShapes)->Apply(StageArgs);
+BENCHMARK(BM_ComputeAllSmoothingNormals)->Apply(StageArgs);
+BENCHMARK(BM_ComputeSmoothingNormals)->Apply(StageArgs);
+BENCHMARK(BM_AssembleBuffer)->Apply(StageArgs);
+BENCHMARK(BM_RangeBounds)->Apply(StageArgs);
+
+BENCHMARK_MAIN();